@@ -0,0 +1,55 @@
+//! Measures statements per second against pipeline depth, over a loopback connection to an in-process server.
+//! Run with `cargo run --release --example pipeline_benchmark [statements per depth]`.
+
+use stardust_db::{
+    server::{protocol::Response, Client, Server},
+    temporary_database::TemporaryDatabase,
+};
+use std::{io, net::TcpListener, thread, time::Instant};
+
+const DEPTHS: [usize; 8] = [1, 2, 4, 8, 16, 32, 64, 128];
+const DEFAULT_STATEMENTS: usize = 2048;
+
+fn main() -> io::Result<()> {
+    let num_statements = std::env::args()
+        .nth(1)
+        .and_then(|n| n.parse().ok())
+        .unwrap_or(DEFAULT_STATEMENTS);
+    let database = TemporaryDatabase::new()
+        .map_err(|e| io::Error::new(io::ErrorKind::Other, e.to_string()))?;
+    let server = Server::new(database, 4);
+    let listener = TcpListener::bind("127.0.0.1:0")?;
+    let address = listener.local_addr()?;
+    thread::spawn(move || server.serve_tcp(listener, |e| println!("Connection error: {}", e)));
+
+    let mut client = Client::connect_tcp(address)?;
+    expect_ok(client.query("CREATE TABLE bench (id int, name string);")?);
+
+    println!("{:>8} {:>14}", "depth", "statements/s");
+    let mut id = 0;
+    for &depth in DEPTHS.iter() {
+        let start = Instant::now();
+        let mut sent = 0;
+        while sent < num_statements {
+            let group = depth.min(num_statements - sent);
+            for _ in 0..group {
+                client.send(&format!("INSERT INTO bench VALUES ({}, 'row');", id))?;
+                id += 1;
+            }
+            client.flush()?;
+            for _ in 0..group {
+                expect_ok(client.receive()?);
+            }
+            sent += group;
+        }
+        let rate = num_statements as f64 / start.elapsed().as_secs_f64();
+        println!("{:>8} {:>14.0}", depth, rate);
+    }
+    Ok(())
+}
+
+fn expect_ok(response: Response) {
+    if let Response::Error(e) = response {
+        panic!("Query failed: {}", e)
+    }
+}
@@ -0,0 +1,309 @@
+use std::{
+    convert::TryFrom,
+    ffi::CString,
+    os::raw::{c_char, c_void},
+    ptr::{null, null_mut},
+};
+
+use crate::{
+    data_types::{IntegerStorage, TypeContents, Value},
+    error::{Error, Result},
+    relation::Relation,
+};
+
+/// Set on a child schema if the column may contain nulls.
+const ARROW_FLAG_NULLABLE: i64 = 2;
+
+/// An Arrow C data interface schema, describing the type of an `ArrowArray`.
+#[repr(C)]
+#[derive(Debug)]
+pub struct ArrowSchema {
+    pub format: *const c_char,
+    pub name: *const c_char,
+    pub metadata: *const c_char,
+    pub flags: i64,
+    pub n_children: i64,
+    pub children: *mut *mut ArrowSchema,
+    pub dictionary: *mut ArrowSchema,
+    pub release: Option<unsafe extern "C" fn(schema: *mut ArrowSchema)>,
+    pub private_data: *mut c_void,
+}
+
+/// An Arrow C data interface array, holding the buffers of a batch of values.
+#[repr(C)]
+#[derive(Debug)]
+pub struct ArrowArray {
+    pub length: i64,
+    pub null_count: i64,
+    pub offset: i64,
+    pub n_buffers: i64,
+    pub n_children: i64,
+    pub buffers: *mut *const c_void,
+    pub children: *mut *mut ArrowArray,
+    pub dictionary: *mut ArrowArray,
+    pub release: Option<unsafe extern "C" fn(array: *mut ArrowArray)>,
+    pub private_data: *mut c_void,
+}
+
+struct SchemaData {
+    _format: CString,
+    _name: CString,
+    children: Vec<*mut ArrowSchema>,
+}
+
+enum ColumnData {
+    Integer(Vec<IntegerStorage>),
+    String { offsets: Vec<i32>, data: Vec<u8> },
+}
+
+struct ArrayData {
+    _validity: Option<Vec<u8>>,
+    _column: Option<ColumnData>,
+    buffers: Vec<*const c_void>,
+    children: Vec<*mut ArrowArray>,
+}
+
+impl Relation {
+    /// Exports the `Relation` through the Arrow C data interface, as a struct array with one child per column.
+    /// Columns containing any strings are exported as utf8, and all other columns as int64.
+    /// The caller is responsible for calling the `release` callbacks of both returned values.
+    pub fn to_arrow(&self) -> Result<(ArrowSchema, ArrowArray)> {
+        let length = arrow_length(self.num_rows())?;
+        let mut schema_children = Vec::with_capacity(self.num_columns());
+        let mut array_children = Vec::with_capacity(self.num_columns());
+        for (index, name) in self.column_names().enumerate() {
+            let (schema, array) = export_column(self, index, name, length)?;
+            schema_children.push(Box::into_raw(Box::new(schema)));
+            array_children.push(Box::into_raw(Box::new(array)));
+        }
+        let schema = new_schema("+s", "", 0, schema_children)?;
+        let array = new_array(length, 0, vec![null()], None, None, array_children);
+        Ok((schema, array))
+    }
+}
+
+fn arrow_length(length: usize) -> Result<i64> {
+    i64::try_from(length)
+        .map_err(|_| Error::Internal(format!("Length {} is too large for Arrow", length)))
+}
+
+fn export_column(
+    relation: &Relation,
+    column: usize,
+    name: &str,
+    length: i64,
+) -> Result<(ArrowSchema, ArrowArray)> {
+    let values = (0..relation.num_rows()).filter_map(|row| relation.get_value(column, row));
+    let is_string = values
+        .clone()
+        .any(|v| matches!(v, Value::TypedValue(TypeContents::String(_))));
+
+    let mut validity = vec![0u8; (relation.num_rows() + 7) / 8];
+    let mut null_count = 0;
+    for (row, value) in values.clone().enumerate() {
+        if value.is_null() {
+            null_count += 1;
+        } else {
+            validity[row / 8] |= 1 << (row % 8);
+        }
+    }
+
+    let (format, column_data) = if is_string {
+        let mut offsets = Vec::with_capacity(relation.num_rows() + 1);
+        let mut data = Vec::new();
+        offsets.push(0);
+        for value in values {
+            if let Some(string) = value.cast_string() {
+                data.extend_from_slice(string.as_bytes());
+            }
+            let offset = i32::try_from(data.len()).map_err(|_| {
+                Error::Internal(format!("String column `{}` is too large for Arrow", name))
+            })?;
+            offsets.push(offset);
+        }
+        ("u", ColumnData::String { offsets, data })
+    } else {
+        let values = values.map(|v| v.cast_int().unwrap_or_default()).collect();
+        ("l", ColumnData::Integer(values))
+    };
+
+    let validity = if null_count > 0 { Some(validity) } else { None };
+    let mut buffers = vec![validity
+        .as_ref()
+        .map_or(null(), |v| v.as_ptr() as *const c_void)];
+    match &column_data {
+        ColumnData::Integer(values) => buffers.push(values.as_ptr() as *const c_void),
+        ColumnData::String { offsets, data } => {
+            buffers.push(offsets.as_ptr() as *const c_void);
+            buffers.push(data.as_ptr() as *const c_void);
+        }
+    }
+
+    let schema = new_schema(format, name, ARROW_FLAG_NULLABLE, Vec::new())?;
+    let array = new_array(
+        length,
+        null_count,
+        buffers,
+        validity,
+        Some(column_data),
+        Vec::new(),
+    );
+    Ok((schema, array))
+}
+
+fn new_schema(
+    format: &str,
+    name: &str,
+    flags: i64,
+    mut children: Vec<*mut ArrowSchema>,
+) -> Result<ArrowSchema> {
+    let format = CString::new(format).map_err(|e| Error::Internal(e.to_string()))?;
+    let name = CString::new(name)
+        .map_err(|_| Error::Internal(format!("Column name `{}` contains a nul byte", name)))?;
+    let schema = ArrowSchema {
+        format: format.as_ptr(),
+        name: name.as_ptr(),
+        metadata: null(),
+        flags,
+        n_children: children.len() as i64,
+        children: children_ptr(&mut children),
+        dictionary: null_mut(),
+        release: Some(release_schema),
+        private_data: null_mut(),
+    };
+    let private_data = Box::new(SchemaData {
+        _format: format,
+        _name: name,
+        children,
+    });
+    Ok(ArrowSchema {
+        private_data: Box::into_raw(private_data) as *mut c_void,
+        ..schema
+    })
+}
+
+fn new_array(
+    length: i64,
+    null_count: i64,
+    mut buffers: Vec<*const c_void>,
+    validity: Option<Vec<u8>>,
+    column: Option<ColumnData>,
+    mut children: Vec<*mut ArrowArray>,
+) -> ArrowArray {
+    let array = ArrowArray {
+        length,
+        null_count,
+        offset: 0,
+        n_buffers: buffers.len() as i64,
+        n_children: children.len() as i64,
+        buffers: buffers.as_mut_ptr(),
+        children: children_ptr(&mut children),
+        dictionary: null_mut(),
+        release: Some(release_array),
+        private_data: null_mut(),
+    };
+    let private_data = Box::new(ArrayData {
+        _validity: validity,
+        _column: column,
+        buffers,
+        children,
+    });
+    ArrowArray {
+        private_data: Box::into_raw(private_data) as *mut c_void,
+        ..array
+    }
+}
+
+fn children_ptr<T>(children: &mut Vec<*mut T>) -> *mut *mut T {
+    if children.is_empty() {
+        null_mut()
+    } else {
+        children.as_mut_ptr()
+    }
+}
+
+unsafe extern "C" fn release_schema(schema: *mut ArrowSchema) {
+    let schema = option_to_error!(schema.as_mut());
+    if schema.private_data.is_null() {
+        return;
+    }
+    let private_data = Box::from_raw(schema.private_data as *mut SchemaData);
+    for child in private_data.children.iter().copied() {
+        if let Some(release) = (*child).release {
+            release(child);
+        }
+        let _ = Box::from_raw(child);
+    }
+    schema.private_data = null_mut();
+    schema.release = None;
+}
+
+unsafe extern "C" fn release_array(array: *mut ArrowArray) {
+    let array = option_to_error!(array.as_mut());
+    if array.private_data.is_null() {
+        return;
+    }
+    let private_data = Box::from_raw(array.private_data as *mut ArrayData);
+    debug_assert_eq!(private_data.buffers.as_ptr(), array.buffers as *const _);
+    for child in private_data.children.iter().copied() {
+        if let Some(release) = (*child).release {
+            release(child);
+        }
+        let _ = Box::from_raw(child);
+    }
+    array.private_data = null_mut();
+    array.release = None;
+}
+
+#[cfg(test)]
+mod tests {
+    use std::{ffi::CStr, slice};
+
+    use crate::{data_types::Value, relation::Relation};
+
+    #[test]
+    fn export_relation() {
+        let mut relation = Relation::new(vec!["id".to_owned(), "name".to_owned()]);
+        relation.add_row(vec![1.into(), "User".into()]).unwrap();
+        relation.add_row(vec![Value::Null, 25.into()]).unwrap();
+        relation.add_row(vec![3.into(), Value::Null]).unwrap();
+        let (mut schema, mut array) = relation.to_arrow().unwrap();
+        unsafe {
+            assert_eq!(CStr::from_ptr(schema.format).to_str().unwrap(), "+s");
+            assert_eq!(schema.n_children, 2);
+            let children = slice::from_raw_parts(schema.children, 2);
+            assert_eq!(CStr::from_ptr((*children[0]).format).to_str().unwrap(), "l");
+            assert_eq!(CStr::from_ptr((*children[0]).name).to_str().unwrap(), "id");
+            assert_eq!(CStr::from_ptr((*children[1]).format).to_str().unwrap(), "u");
+            assert_eq!(
+                CStr::from_ptr((*children[1]).name).to_str().unwrap(),
+                "name"
+            );
+
+            assert_eq!(array.length, 3);
+            assert_eq!(array.n_children, 2);
+            let children = slice::from_raw_parts(array.children, 2);
+
+            let ids = &*children[0];
+            assert_eq!(ids.null_count, 1);
+            let buffers = slice::from_raw_parts(ids.buffers, 2);
+            assert_eq!(*(buffers[0] as *const u8), 0b101);
+            let values = slice::from_raw_parts(buffers[1] as *const i64, 3);
+            assert_eq!(values, &[1, 0, 3]);
+
+            let names = &*children[1];
+            assert_eq!(names.null_count, 1);
+            let buffers = slice::from_raw_parts(names.buffers, 3);
+            assert_eq!(*(buffers[0] as *const u8), 0b011);
+            let offsets = slice::from_raw_parts(buffers[1] as *const i32, 4);
+            assert_eq!(offsets, &[0, 4, 6, 6]);
+            let data = slice::from_raw_parts(buffers[2] as *const u8, 6);
+            assert_eq!(data, b"User25");
+
+            (schema.release.unwrap())(&mut schema);
+            (array.release.unwrap())(&mut array);
+        }
+        assert!(schema.release.is_none());
+        assert!(array.release.is_none());
+    }
+}
@@ -18,6 +18,7 @@ pub enum SqlQuery {
     DropTable(DropTable),
     Delete(Delete),
     Update(Update),
+    AlterTable(AlterTable),
 }
 
 #[derive(Debug)]
@@ -206,7 +207,7 @@ impl std::fmt::Display for UnresolvedExpression {
     }
 }
 
-#[derive(Debug, Clone, Copy, Serialize, Deserialize)]
+#[derive(Debug, Clone, Copy, PartialEq, Serialize, Deserialize)]
 pub enum BinaryOp {
     And,
     Or,
@@ -214,7 +215,7 @@ pub enum BinaryOp {
     Mathematical(MathematicalOp),
 }
 
-#[derive(Debug, Clone, Copy, Serialize, Deserialize)]
+#[derive(Debug, Clone, Copy, PartialEq, Serialize, Deserialize)]
 pub enum ComparisonOp {
     Eq,
     NotEq,
@@ -224,7 +225,7 @@ pub enum ComparisonOp {
     LtEq,
 }
 
-#[derive(Debug, Clone, Copy, Serialize, Deserialize)]
+#[derive(Debug, Clone, Copy, PartialEq, Serialize, Deserialize)]
 pub enum MathematicalOp {
     Add,
     Subtract,
@@ -412,6 +413,23 @@ impl DropTable {
     }
 }
 
+#[derive(Debug)]
+pub struct AlterTable {
+    pub name: String,
+    pub operation: AlterTableOperation,
+}
+
+impl AlterTable {
+    pub fn new(name: String, operation: AlterTableOperation) -> Self {
+        Self { name, operation }
+    }
+}
+
+#[derive(Debug)]
+pub enum AlterTableOperation {
+    AddColumn(Column),
+}
+
 #[derive(Debug)]
 pub struct Delete {
     pub table_name: String,
@@ -0,0 +1,292 @@
+//! Online backups of every tree in a database, and restoring them into a new database.
+//!
+//! A backup is a gzip stream, so the whole backup is compressed and covered by the gzip CRC-32. The stream starts with
+//! `MAGIC`, followed by records of a tag byte and its contents. `TAG_TREE` starts a tree and holds its name, and
+//! `TAG_ENTRY` holds an entry of the current tree. Entries are written in key order, and each key is stored as the
+//! length of the prefix it shares with the previous key followed by the rest of the key. `TAG_END` finishes the
+//! backup and holds the total number of entries, so that a truncated backup is detected.
+//!
+//! Frozen tables are written as ordinary trees, so they are restored as tables that can be modified.
+
+use std::{
+    convert::TryInto,
+    fs::File,
+    io::{self, BufReader, BufWriter, ErrorKind, Read, Write},
+    path::Path,
+    sync::Arc,
+    time::Instant,
+};
+
+use flate2::{read::GzDecoder, write::GzEncoder, Compression};
+use sled::{Batch, Db};
+
+use crate::{
+    error::{Error, Result},
+    frozen::FrozenTable,
+};
+
+const MAGIC: &[u8] = b"STARDUST_BACKUP_1";
+const TAG_END: u8 = 0;
+const TAG_TREE: u8 = 1;
+const TAG_ENTRY: u8 = 2;
+/// The number of entries restored with each sled batch.
+const RESTORE_BATCH_LEN: usize = 4096;
+
+/// Statistics describing a backup or restore.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct BackupStats {
+    /// The number of trees copied, including the catalog.
+    pub trees: u64,
+    /// The number of entries copied.
+    pub entries: u64,
+    /// The size of the copied keys and values.
+    pub bytes: u64,
+    /// The size of the backup file.
+    pub compressed_bytes: u64,
+    /// The time taken.
+    pub seconds: f64,
+}
+
+impl BackupStats {
+    /// Returns the throughput in megabytes of keys and values per second.
+    pub fn megabytes_per_second(&self) -> f64 {
+        if self.seconds > 0.0 {
+            self.bytes as f64 / 1_000_000.0 / self.seconds
+        } else {
+            0.0
+        }
+    }
+}
+
+/// Writes every tree of `db` and every table in `frozen_tables` to a new backup file at `path`.
+pub(crate) fn backup(
+    db: &Db,
+    frozen_tables: &[(String, Arc<FrozenTable>)],
+    path: &Path,
+) -> Result<BackupStats> {
+    let start = Instant::now();
+    let file = File::create(path)?;
+    let mut writer = GzEncoder::new(BufWriter::new(file), Compression::fast());
+    let mut stats = BackupStats::default();
+    writer.write_all(MAGIC)?;
+
+    let mut tree_names = db.tree_names();
+    tree_names.sort();
+    for name in tree_names {
+        if name == b"@frozen"[..] {
+            continue;
+        }
+        let tree = db.open_tree(&name)?;
+        let entries = tree.iter().map(|entry| Ok(entry?));
+        write_tree(&mut writer, &name, entries, &mut stats)?;
+    }
+    for (name, table) in frozen_tables {
+        write_tree(&mut writer, name.as_bytes(), table.rows(), &mut stats)?;
+    }
+    writer.write_all(&[TAG_END])?;
+    writer.write_all(&stats.entries.to_be_bytes())?;
+    let file = writer
+        .finish()?
+        .into_inner()
+        .map_err(|e| Error::Io(e.into_error()))?;
+    file.sync_all()?;
+    stats.compressed_bytes = file.metadata()?.len();
+    stats.seconds = start.elapsed().as_secs_f64();
+    Ok(stats)
+}
+
+fn write_tree<W, I, K, V>(
+    writer: &mut W,
+    name: &[u8],
+    entries: I,
+    stats: &mut BackupStats,
+) -> Result<()>
+where
+    W: Write,
+    I: Iterator<Item = Result<(K, V)>>,
+    K: AsRef<[u8]>,
+    V: AsRef<[u8]>,
+{
+    writer.write_all(&[TAG_TREE])?;
+    write_bytes(writer, name)?;
+    stats.trees += 1;
+
+    let mut previous_key = Vec::new();
+    for entry in entries {
+        let (key, value) = entry?;
+        let (key, value) = (key.as_ref(), value.as_ref());
+        let shared = previous_key
+            .iter()
+            .zip(key.iter())
+            .take_while(|(a, b)| a == b)
+            .count();
+        writer.write_all(&[TAG_ENTRY])?;
+        write_varint(writer, shared as u64)?;
+        write_bytes(writer, &key[shared..])?;
+        write_bytes(writer, value)?;
+        stats.entries += 1;
+        stats.bytes += (key.len() + value.len()) as u64;
+        previous_key.clear();
+        previous_key.extend_from_slice(key);
+    }
+    Ok(())
+}
+
+/// Loads every tree from the backup file at `path` into `db`, in key order.
+pub(crate) fn restore(db: &Db, path: &Path) -> Result<BackupStats> {
+    let start = Instant::now();
+    let file = File::open(path)?;
+    let compressed_bytes = file.metadata()?.len();
+    let mut reader = GzDecoder::new(BufReader::new(file));
+    let mut stats = BackupStats {
+        compressed_bytes,
+        ..BackupStats::default()
+    };
+    let mut magic = [0; MAGIC.len()];
+    reader.read_exact(&mut magic)?;
+    if magic != MAGIC {
+        return Err(corrupt("not a backup file"));
+    }
+
+    let mut tree = None;
+    let mut batch = Batch::default();
+    let mut batch_len = 0;
+    let mut key = Vec::new();
+    loop {
+        match read_u8(&mut reader)? {
+            TAG_TREE => {
+                if let Some(tree) = &tree {
+                    apply(tree, &mut batch, &mut batch_len)?;
+                }
+                tree = Some(db.open_tree(read_bytes(&mut reader)?)?);
+                stats.trees += 1;
+                key.clear();
+            }
+            TAG_ENTRY => {
+                let tree = tree
+                    .as_ref()
+                    .ok_or_else(|| corrupt("entry outside of a tree"))?;
+                let shared = read_varint(&mut reader)? as usize;
+                if shared > key.len() {
+                    return Err(corrupt("invalid key prefix"));
+                }
+                key.truncate(shared);
+                key.extend_from_slice(&read_bytes(&mut reader)?);
+                let value = read_bytes(&mut reader)?;
+                stats.entries += 1;
+                stats.bytes += (key.len() + value.len()) as u64;
+                batch.insert(key.as_slice(), value);
+                batch_len += 1;
+                if batch_len == RESTORE_BATCH_LEN {
+                    apply(tree, &mut batch, &mut batch_len)?;
+                }
+            }
+            TAG_END => {
+                if let Some(tree) = &tree {
+                    apply(tree, &mut batch, &mut batch_len)?;
+                }
+                let mut entries = [0; 8];
+                reader.read_exact(&mut entries)?;
+                if u64::from_be_bytes(entries) != stats.entries {
+                    return Err(corrupt("wrong number of entries"));
+                }
+                // Reading to the end makes the decoder verify the checksum.
+                io::copy(&mut reader, &mut io::sink())?;
+                break;
+            }
+            _ => return Err(corrupt("unknown record")),
+        }
+    }
+    db.flush()?;
+    stats.seconds = start.elapsed().as_secs_f64();
+    Ok(stats)
+}
+
+fn apply(tree: &sled::Tree, batch: &mut Batch, batch_len: &mut usize) -> Result<()> {
+    tree.apply_batch(std::mem::take(batch))?;
+    *batch_len = 0;
+    Ok(())
+}
+
+fn write_varint<W: Write>(writer: &mut W, mut value: u64) -> io::Result<()> {
+    let mut bytes = [0; 10];
+    let mut len = 0;
+    loop {
+        let byte = (value & 0x7f) as u8;
+        value >>= 7;
+        if value == 0 {
+            bytes[len] = byte;
+            len += 1;
+            break;
+        }
+        bytes[len] = byte | 0x80;
+        len += 1;
+    }
+    writer.write_all(&bytes[..len])
+}
+
+fn read_varint<R: Read>(reader: &mut R) -> Result<u64> {
+    let mut value = 0;
+    for shift in (0..64).step_by(7) {
+        let byte = read_u8(reader)?;
+        value |= ((byte & 0x7f) as u64) << shift;
+        if byte & 0x80 == 0 {
+            return Ok(value);
+        }
+    }
+    Err(corrupt("invalid length"))
+}
+
+fn write_bytes<W: Write>(writer: &mut W, bytes: &[u8]) -> io::Result<()> {
+    write_varint(writer, bytes.len() as u64)?;
+    writer.write_all(bytes)
+}
+
+fn read_bytes<R: Read>(reader: &mut R) -> Result<Vec<u8>> {
+    let len: usize = read_varint(reader)?
+        .try_into()
+        .map_err(|_| corrupt("invalid length"))?;
+    let mut bytes = Vec::new();
+    reader.take(len as u64).read_to_end(&mut bytes)?;
+    if bytes.len() != len {
+        return Err(Error::Io(ErrorKind::UnexpectedEof.into()));
+    }
+    Ok(bytes)
+}
+
+fn read_u8<R: Read>(reader: &mut R) -> Result<u8> {
+    let mut byte = [0];
+    reader.read_exact(&mut byte)?;
+    Ok(byte[0])
+}
+
+fn corrupt(message: &str) -> Error {
+    Error::Io(io::Error::new(
+        ErrorKind::InvalidData,
+        format!("Corrupt backup: {}", message),
+    ))
+}
+
+#[cfg(test)]
+mod tests {
+    use std::io::Cursor;
+
+    use super::{read_bytes, read_varint, write_bytes, write_varint};
+
+    #[test]
+    fn varint_round_trip() {
+        let mut buffer = Vec::new();
+        for value in &[0, 1, 127, 128, 300, u64::MAX] {
+            write_varint(&mut buffer, *value).unwrap();
+        }
+        write_bytes(&mut buffer, b"key").unwrap();
+        assert_eq!(&buffer[..4], &[0, 1, 127, 0x80]);
+        let mut reader = Cursor::new(buffer);
+        for value in &[0, 1, 127, 128, 300, u64::MAX] {
+            assert_eq!(read_varint(&mut reader).unwrap(), *value);
+        }
+        assert_eq!(read_bytes(&mut reader).unwrap(), b"key");
+        assert!(read_bytes(&mut reader).is_err());
+    }
+}
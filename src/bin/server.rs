@@ -0,0 +1,133 @@
+use stardust_db::{
+    expiry, replication, server::Server, temporary_database::TemporaryDatabase, vacuum, Database,
+};
+use std::{io, net::TcpListener, ops::Deref, time::Duration};
+
+const DEFAULT_WORKERS: usize = 4;
+const REPLICATION_INTERVAL: Duration = Duration::from_millis(100);
+const REAP_BATCH_LEN: usize = 1000;
+const REAP_INTERVAL: Duration = Duration::from_millis(100);
+/// Tables are vacuumed once they have had this many writes per row since they were last vacuumed.
+const VACUUM_THRESHOLD: f64 = 4.0;
+const VACUUM_INTERVAL: Duration = Duration::from_secs(60);
+
+enum Role<'a> {
+    Standalone,
+    Primary(&'a str),
+    Replica(&'a str),
+}
+
+fn main() {
+    let args: Vec<_> = std::env::args().collect();
+    let mut address = None;
+    let mut path = None;
+    let mut num_workers = DEFAULT_WORKERS;
+    let mut role = Role::Standalone;
+    let mut args = args.iter().skip(1);
+    while let Some(arg) = args.next() {
+        if arg == "--workers" {
+            match args.next().and_then(|n| n.parse().ok()) {
+                Some(n) => num_workers = n,
+                None => return usage(),
+            }
+        } else if arg == "--log" || arg == "--replica-of" {
+            match (args.next(), arg.as_str()) {
+                (Some(log), "--log") => role = Role::Primary(log),
+                (Some(log), _) => role = Role::Replica(log),
+                (None, _) => return usage(),
+            }
+        } else if address.is_none() {
+            address = Some(arg.as_str());
+        } else if path.is_none() {
+            path = Some(arg.as_str());
+        } else {
+            return usage();
+        }
+    }
+    let address = match address {
+        Some(address) => address,
+        None => return usage(),
+    };
+    if let Err(e) = run(address, path, role, num_workers) {
+        println!("Error running server: {}", e)
+    }
+}
+
+fn usage() {
+    println!(
+        "Usage: server <address | unix:path> [database path] [--workers n] [--log dir | --replica-of dir]"
+    )
+}
+
+enum Db {
+    Ordinary(Database),
+    Temporary(TemporaryDatabase),
+}
+
+impl Deref for Db {
+    type Target = Database;
+
+    fn deref(&self) -> &Self::Target {
+        match self {
+            Db::Ordinary(db) => db,
+            Db::Temporary(db) => db,
+        }
+    }
+}
+
+fn run(address: &str, path: Option<&str>, role: Role, num_workers: usize) -> io::Result<()> {
+    let db = match (path, &role) {
+        (Some(path), Role::Standalone) => Database::open(path).map(Db::Ordinary),
+        (Some(path), Role::Primary(log)) => Database::open_primary(path, log).map(Db::Ordinary),
+        (Some(path), Role::Replica(log)) => Database::open_replica(path, log).map(Db::Ordinary),
+        (None, Role::Standalone) => TemporaryDatabase::new().map(Db::Temporary),
+        (None, _) => {
+            usage();
+            return Ok(());
+        }
+    }
+    .map_err(|e| io::Error::new(io::ErrorKind::Other, e.to_string()))?;
+    let server = Server::new(db, num_workers);
+    if let Role::Replica(_) = role {
+        replication::follow(server.database(), REPLICATION_INTERVAL, |e| {
+            println!("Error applying the replication log: {}", e)
+        });
+    } else {
+        expiry::reap(server.database(), REAP_BATCH_LEN, REAP_INTERVAL, |e| {
+            println!("Error deleting expired rows: {}", e)
+        });
+        vacuum::maintain(server.database(), VACUUM_THRESHOLD, VACUUM_INTERVAL, |e| {
+            println!("Error vacuuming tables: {}", e)
+        });
+    }
+    println!(
+        "Listening on {} with {} workers",
+        address,
+        server.num_workers()
+    );
+    if let Some(socket_path) = address.strip_prefix("unix:") {
+        serve_unix(&server, socket_path)
+    } else {
+        server.serve_tcp(TcpListener::bind(address)?, connection_error)
+    }
+}
+
+fn connection_error(e: io::Error) {
+    println!("Connection error: {}", e)
+}
+
+#[cfg(unix)]
+fn serve_unix(server: &Server<Db>, socket_path: &str) -> io::Result<()> {
+    server.serve_unix(
+        std::os::unix::net::UnixListener::bind(socket_path)?,
+        connection_error,
+    )
+}
+
+#[cfg(not(unix))]
+fn serve_unix(_server: &Server<Db>, _socket_path: &str) -> io::Result<()> {
+    Err(io::Error::new(
+        io::ErrorKind::Other,
+        "Unix sockets are not supported on this platform",
+    ))
+}
@@ -0,0 +1,244 @@
+//! Bloom filters of the keys of unique constraints.
+//!
+//! Checking that an inserted row doesn't conflict with a unique constraint, or that the row referred to by a foreign
+//! key exists, scans the table, and usually finds nothing. A Bloom filter of the values of each unique column set
+//! answers most of these checks without the scan: when the filter doesn't contain the values, no row has them.
+//!
+//! The filters are kept in memory only. Each is built the first time it is needed after the database is opened, and
+//! rows written afterwards are added to it. Deleted rows cannot be removed from a Bloom filter, so a filter is rebuilt
+//! once many rows have been deleted or updated, or once it holds more keys than it was sized for, as either makes it
+//! answer "maybe" more often.
+
+use std::{
+    collections::{hash_map::DefaultHasher, HashMap},
+    hash::Hasher,
+    sync::{Arc, Mutex, RwLock},
+};
+
+use crate::error::Result;
+
+/// The fraction of absent keys that a newly built filter reports as maybe present.
+const FALSE_POSITIVE_RATE: f64 = 0.01;
+/// The smallest number of keys a filter is sized for.
+const MIN_CAPACITY: u64 = 1024;
+
+/// A set of byte strings that can report that a string is definitely absent, or maybe present.
+#[derive(Debug, Clone)]
+pub(crate) struct BloomFilter {
+    bits: Vec<u64>,
+    num_hashes: u32,
+}
+
+impl BloomFilter {
+    /// Returns an empty filter sized for `capacity` keys.
+    pub fn new(capacity: u64) -> Self {
+        let ln2 = std::f64::consts::LN_2;
+        let num_bits = (-(capacity.max(1) as f64) * FALSE_POSITIVE_RATE.ln() / (ln2 * ln2)).ceil();
+        let num_words = ((num_bits as u64 + 63) / 64).max(1);
+        let num_hashes = ((num_words * 64) as f64 / capacity.max(1) as f64 * ln2).round();
+        Self {
+            bits: vec![0; num_words as usize],
+            num_hashes: (num_hashes as u32).clamp(1, 16),
+        }
+    }
+
+    pub fn insert(&mut self, key: &[u8]) {
+        for bit in self.bit_indexes(key) {
+            self.bits[bit / 64] |= 1 << (bit % 64);
+        }
+    }
+
+    /// Returns false if `key` was never inserted.
+    pub fn may_contain(&self, key: &[u8]) -> bool {
+        self.bit_indexes(key)
+            .all(|bit| self.bits[bit / 64] & (1 << (bit % 64)) != 0)
+    }
+
+    /// Derives every bit index of `key` from two halves of one hash.
+    fn bit_indexes(&self, key: &[u8]) -> impl Iterator<Item = usize> {
+        let mut hasher = DefaultHasher::new();
+        hasher.write(key);
+        let hash = hasher.finish();
+        let (first, second) = (hash & 0xffff_ffff, (hash >> 32) | 1);
+        let num_bits = self.bits.len() as u64 * 64;
+        (0..self.num_hashes as u64)
+            .map(move |i| (first.wrapping_add(i.wrapping_mul(second)) % num_bits) as usize)
+    }
+}
+
+/// The filter of one unique column set of a table.
+#[derive(Debug)]
+pub(crate) struct KeyFilter {
+    filter: BloomFilter,
+    capacity: u64,
+    /// The number of keys inserted, including those of rows since deleted.
+    inserted: u64,
+    /// The number of rows deleted or updated since the filter was built.
+    removed: u64,
+}
+
+impl KeyFilter {
+    fn is_stale(&self) -> bool {
+        self.inserted > self.capacity || self.removed * 2 > self.inserted.max(MIN_CAPACITY)
+    }
+}
+
+pub(crate) type FilterSlot = Arc<Mutex<Option<KeyFilter>>>;
+
+/// The Bloom filters of the unique column sets of every table, built when first used.
+#[derive(Debug)]
+pub(crate) struct KeyFilters {
+    enabled: RwLock<bool>,
+    filters: RwLock<HashMap<(String, Vec<usize>), FilterSlot>>,
+}
+
+impl Default for KeyFilters {
+    fn default() -> Self {
+        Self {
+            enabled: RwLock::new(true),
+            filters: RwLock::default(),
+        }
+    }
+}
+
+impl KeyFilters {
+    /// Enables or disables the filters. Disabling them frees their memory.
+    pub fn set_enabled(&self, enabled: bool) {
+        *self.enabled.write().unwrap_or_else(|e| e.into_inner()) = enabled;
+        if !enabled {
+            self.filters
+                .write()
+                .unwrap_or_else(|e| e.into_inner())
+                .clear();
+        }
+    }
+
+    /// Returns whether a row of `table` may have the encoded values `key` in `columns`, or `None` if the filters are
+    /// disabled. The filter is built from `keys`, which returns the keys of every row of the table, if it hasn't been
+    /// built since the database was opened or is stale.
+    pub fn may_contain<F>(
+        &self,
+        table: &str,
+        columns: &[usize],
+        key: &[u8],
+        keys: F,
+    ) -> Result<Option<bool>>
+    where
+        F: FnOnce() -> Result<Vec<Vec<u8>>>,
+    {
+        if !*self.enabled.read().unwrap_or_else(|e| e.into_inner()) {
+            return Ok(None);
+        }
+        let slot = self.slot(table, columns);
+        // Rows written while the filter is built wait to be added until it is complete.
+        let mut filter = slot.lock().unwrap_or_else(|e| e.into_inner());
+        if filter.as_ref().map_or(true, KeyFilter::is_stale) {
+            let keys = keys()?;
+            let capacity = (keys.len() as u64 * 2).max(MIN_CAPACITY);
+            let mut bloom = BloomFilter::new(capacity);
+            for key in &keys {
+                bloom.insert(key);
+            }
+            *filter = Some(KeyFilter {
+                filter: bloom,
+                capacity,
+                inserted: keys.len() as u64,
+                removed: 0,
+            });
+        }
+        Ok(filter.as_ref().map(|filter| filter.filter.may_contain(key)))
+    }
+
+    /// Returns the slot for the filter of `columns` of `table`, creating it if it doesn't exist. The map of slots is
+    /// only locked exclusively to create a slot, so that probes of other tables don't wait for each other.
+    fn slot(&self, table: &str, columns: &[usize]) -> FilterSlot {
+        let key = (table.to_owned(), columns.to_vec());
+        if let Some(slot) = self
+            .filters
+            .read()
+            .unwrap_or_else(|e| e.into_inner())
+            .get(&key)
+        {
+            return slot.clone();
+        }
+        self.filters
+            .write()
+            .unwrap_or_else(|e| e.into_inner())
+            .entry(key)
+            .or_default()
+            .clone()
+    }
+
+    /// Returns the column sets of `table` with a filter, to which written rows must be added.
+    pub fn column_sets(&self, table: &str) -> Vec<(Vec<usize>, FilterSlot)> {
+        self.filters
+            .read()
+            .unwrap_or_else(|e| e.into_inner())
+            .iter()
+            .filter(|((filter_table, _), _)| filter_table == table)
+            .map(|((_, columns), slot)| (columns.clone(), slot.clone()))
+            .collect()
+    }
+
+    /// Adds the encoded values `key` of a written row to the filter in `slot`.
+    pub fn insert(slot: &FilterSlot, key: &[u8]) {
+        if let Some(filter) = slot.lock().unwrap_or_else(|e| e.into_inner()).as_mut() {
+            filter.filter.insert(key);
+            filter.inserted += 1;
+        }
+    }
+
+    /// Records that `count` rows of `table` were deleted or updated.
+    pub fn remove(&self, table: &str, count: u64) {
+        for (_, slot) in self.column_sets(table) {
+            if let Some(filter) = slot.lock().unwrap_or_else(|e| e.into_inner()).as_mut() {
+                filter.removed += count;
+            }
+        }
+    }
+
+    /// Drops the filters of `table`, when it is dropped or its rows are removed without being read.
+    pub fn remove_table(&self, table: &str) {
+        self.filters
+            .write()
+            .unwrap_or_else(|e| e.into_inner())
+            .retain(|(filter_table, _), _| filter_table != table);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{BloomFilter, KeyFilters};
+
+    #[test]
+    fn bloom_filter() {
+        let mut filter = BloomFilter::new(1000);
+        for i in 0..1000u32 {
+            filter.insert(&i.to_be_bytes());
+        }
+        assert!((0..1000u32).all(|i| filter.may_contain(&i.to_be_bytes())));
+        let false_positives = (1000..11000u32)
+            .filter(|i| filter.may_contain(&i.to_be_bytes()))
+            .count();
+        assert!(false_positives < 300, "{} false positives", false_positives);
+    }
+
+    #[test]
+    fn key_filters() {
+        let filters = KeyFilters::default();
+        let may_contain = |key: &[u8]| {
+            filters
+                .may_contain("t", &[0], key, || Ok(vec![b"a".to_vec(), b"b".to_vec()]))
+                .unwrap()
+        };
+        assert_eq!(may_contain(b"a"), Some(true));
+        let (columns, slot) = filters.column_sets("t").pop().unwrap();
+        assert_eq!(columns, vec![0]);
+        KeyFilters::insert(&slot, b"c");
+        assert_eq!(may_contain(b"c"), Some(true));
+        filters.remove("t", 2000);
+        assert_eq!(may_contain(b"c"), Some(false));
+        filters.set_enabled(false);
+        assert_eq!(may_contain(b"a"), None);
+    }
+}
@@ -0,0 +1,78 @@
+use std::str;
+
+use crate::data_types::{IntegerStorage, Value};
+
+/// The values of a column passed to `Database::bulk_insert`.
+#[derive(Debug, Clone, Copy)]
+pub enum BulkValues<'a> {
+    /// One integer for each row.
+    Integer(&'a [IntegerStorage]),
+    /// UTF-8 strings placed back to back. The string for row `i` occupies the bytes from `offsets[i]` to `offsets[i + 1]`.
+    String {
+        offsets: &'a [usize],
+        data: &'a [u8],
+    },
+}
+
+/// A column of values passed to `Database::bulk_insert`.
+#[derive(Debug, Clone, Copy)]
+pub struct BulkColumn<'a> {
+    /// The name of the table column to insert into, or `None` for the table column at the same position.
+    pub name: Option<&'a str>,
+    /// The values of the column.
+    pub values: BulkValues<'a>,
+    /// One byte for each row, set to 1 if the value is null, otherwise 0. If `None`, no values are null.
+    pub nulls: Option<&'a [u8]>,
+}
+
+impl<'a> BulkColumn<'a> {
+    /// Returns the value for the specified row, or `None` if the column data is out of bounds or invalid.
+    pub(crate) fn value(&self, row: usize) -> Option<Value> {
+        if let Some(nulls) = self.nulls {
+            if *nulls.get(row)? != 0 {
+                return Some(Value::Null);
+            }
+        }
+        match self.values {
+            BulkValues::Integer(values) => values.get(row).map(|i| (*i).into()),
+            BulkValues::String { offsets, data } => {
+                let start = *offsets.get(row)?;
+                let end = *offsets.get(row + 1)?;
+                let bytes = data.get(start..end)?;
+                str::from_utf8(bytes).ok().map(Value::from)
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{BulkColumn, BulkValues};
+    use crate::data_types::Value;
+
+    #[test]
+    fn column_values() {
+        let integers = BulkColumn {
+            name: None,
+            values: BulkValues::Integer(&[1, 2, 3]),
+            nulls: Some(&[0, 1, 0]),
+        };
+        assert_eq!(integers.value(0), Some(1.into()));
+        assert_eq!(integers.value(1), Some(Value::Null));
+        assert_eq!(integers.value(3), None);
+
+        let strings = BulkColumn {
+            name: Some("name"),
+            values: BulkValues::String {
+                offsets: &[0, 4, 4, 9, 7],
+                data: b"User\xffname",
+            },
+            nulls: None,
+        };
+        assert_eq!(strings.value(0), Some("User".into()));
+        assert_eq!(strings.value(1), Some("".into()));
+        assert_eq!(strings.value(2), None);
+        assert_eq!(strings.value(3), None);
+        assert_eq!(strings.value(4), None);
+    }
+}
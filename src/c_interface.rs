@@ -1,11 +1,15 @@
 use std::{
     ffi::CStr,
-    ops::{Deref, DerefMut},
+    ops::{Deref, DerefMut, Range},
     os::raw::{c_char, c_int},
-    ptr::null_mut,
+    ptr::{copy_nonoverlapping, null_mut},
+    slice,
 };
 
 use crate::{
+    arrow::{ArrowArray, ArrowSchema},
+    backup::BackupStats,
+    bulk_insert::{BulkColumn, BulkValues},
     data_types::{IntegerStorage, TypeContents, Value},
     relation::Relation,
     temporary_database::TemporaryDatabase,
@@ -40,6 +44,19 @@ pub const STARDUST_DB_VALUE_WRONG_TYPE: c_int = 11;
 pub const STARDUST_DB_VALUE_NULL: c_int = 12;
 /// Returned if there was an error creating the temporary database.
 pub const STARDUST_DB_TEMP_DB_ERROR: c_int = 13;
+/// Returned if the result could not be exported.
+pub const STARDUST_DB_EXPORT_ERROR: c_int = 14;
+/// Returned if a `StardustColumn` passed to `bulk_insert` has an unknown type or a missing buffer.
+pub const STARDUST_DB_INVALID_COLUMN: c_int = 15;
+/// Returned if the ResultList was not initialised.
+pub const STARDUST_DB_NULL_RESULT_LIST: c_int = 16;
+/// Returned if a backup could not be written or restored.
+pub const STARDUST_DB_BACKUP_ERROR: c_int = 17;
+
+/// The `column_type` of a `StardustColumn` holding integers.
+pub const STARDUST_DB_INTEGER_COLUMN: c_int = 0;
+/// The `column_type` of a `StardustColumn` holding strings.
+pub const STARDUST_DB_STRING_COLUMN: c_int = 1;
 
 /// Used to zero-initialise the RowSet before using as an argument in `execute_query`.
 pub const ROW_SET_INIT: RowSet = RowSet {
@@ -47,6 +64,11 @@ pub const ROW_SET_INIT: RowSet = RowSet {
     current_row: 0,
 };
 
+/// Used to zero-initialise the ResultList before using as an argument in `execute_batch`.
+pub const RESULT_LIST_INIT: ResultList = ResultList {
+    results: 0 as *mut QueryResults,
+};
+
 enum DatabaseRef {
     Ordinary(&'static mut Database),
     Temporary(&'static mut TemporaryDatabase),
@@ -86,6 +108,35 @@ pub struct RowSet {
     current_row: usize,
 }
 
+/// The results of a batch of queries, in execution order.
+pub struct QueryResults {
+    relations: Vec<Relation>,
+    next: usize,
+}
+
+/// Stores the results of every query executed by `execute_batch` for the C interface.
+#[repr(C)]
+pub struct ResultList {
+    results: *mut QueryResults,
+}
+
+/// A column of values passed to `bulk_insert`.
+#[repr(C)]
+pub struct StardustColumn {
+    /// The name of the table column to insert into as a null-terminated string, or null for the table column at the same position.
+    pub name: *const c_char,
+    /// `STARDUST_DB_INTEGER_COLUMN` or `STARDUST_DB_STRING_COLUMN`.
+    pub column_type: c_int,
+    /// One integer for each row, used by integer columns.
+    pub int_values: *const IntegerStorage,
+    /// `nrows + 1` offsets into `data`, used by string columns. The string for row `i` occupies the bytes from `offsets[i]` to `offsets[i + 1]`.
+    pub offsets: *const usize,
+    /// UTF-8 strings placed back to back without null terminators, used by string columns.
+    pub data: *const c_char,
+    /// One byte for each row, set to 1 if the value is null, otherwise 0. May be null if no values are null.
+    pub null_buffer: *const u8,
+}
+
 /// Opens the database at the specified path. Returns `STARDUST_DB_OK` on success.
 /// # Safety
 /// `path` must be a null-terminated string.
@@ -149,16 +200,16 @@ pub unsafe extern "C" fn close_row_set(row_set: *mut RowSet) {
     }
 }
 
-unsafe fn set_row_set(row_set: *mut RowSet, relation: Relation) -> core::result::Result<(), c_int> {
+/// Returns the `Relation` of the `RowSet`, allocating one if it has none, and moves back to the first row.
+unsafe fn reset_row_set(
+    row_set: *mut RowSet,
+) -> core::result::Result<&'static mut Relation, c_int> {
     let row_set = row_set.as_mut().ok_or(STARDUST_DB_NULL_ROW_SET)?;
     row_set.current_row = 0;
     if row_set.relation.is_null() {
-        row_set.relation = Box::into_raw(Box::new(relation));
-    } else {
-        let mut existing = Box::from_raw(row_set.relation);
-        let _ = std::mem::replace(existing.as_mut(), relation);
+        row_set.relation = Box::into_raw(Box::new(Relation::default()));
     }
-    Ok(())
+    Ok(&mut *row_set.relation)
 }
 
 unsafe fn get_database(db: *mut Db) -> core::result::Result<DatabaseRef, c_int> {
@@ -174,11 +225,16 @@ unsafe fn get_database(db: *mut Db) -> core::result::Result<DatabaseRef, c_int>
     Ok(database)
 }
 
+unsafe fn get_relation(row_set: *const RowSet) -> core::result::Result<&'static Relation, c_int> {
+    let row_set = row_set.as_ref().ok_or(STARDUST_DB_NULL_ROW_SET)?;
+    row_set.relation.as_ref().ok_or(STARDUST_DB_NULL_ROW_SET)
+}
+
 unsafe fn get_relation_and_verify_row(
     row_set: *const RowSet,
 ) -> core::result::Result<(&'static Relation, usize), c_int> {
-    let row_set = row_set.as_ref().ok_or(STARDUST_DB_NULL_ROW_SET)?;
-    let relation = row_set.relation.as_ref().ok_or(STARDUST_DB_NULL_ROW_SET)?;
+    let relation = get_relation(row_set)?;
+    let row_set = &*row_set;
     if row_set.current_row >= relation.num_rows() {
         return Err(STARDUST_DB_END);
     }
@@ -186,7 +242,9 @@ unsafe fn get_relation_and_verify_row(
 }
 
 /// Executes the query in `query` and places the result in `row_set`.
-/// Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+/// The buffers of `row_set` are reused, so executing repeatedly into the same `RowSet` avoids reallocating.
+/// Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`,
+/// and `row_set` is left empty.
 /// # Safety
 /// `db` must point to a Db initialised by `open_database` or `temp_db`.
 /// `query` must be a null-terminated string.
@@ -203,13 +261,13 @@ pub unsafe extern "C" fn execute_query(
     let database = result_to_error!(get_database(db));
     let query = CStr::from_ptr(query);
     let query = result_to_error!(query.to_str(), STARDUST_DB_INVALID_QUERY_UTF_8);
-    let result = database.execute_query(query);
+    let relation = result_to_error!(reset_row_set(row_set));
+    let result = database.execute_query_into(query, relation);
     match result {
-        Ok(mut relations) => match relations.pop() {
-            Some(result) => result_to_error!(set_row_set(row_set, result)),
-            None => return STARDUST_DB_NO_RESULT,
-        },
+        Ok(0) => return STARDUST_DB_NO_RESULT,
+        Ok(_) => {}
         Err(e) => {
+            relation.reset(Vec::new());
             let err_str = e.to_string();
             return result_to_error!(fill_buffer(
                 &err_str,
@@ -379,6 +437,33 @@ unsafe fn fill_buffer<T>(
     }
 }
 
+unsafe fn as_string_ref(
+    value: &'static Value,
+    string_ptr: *mut *const c_char,
+    string_len: *mut usize,
+) -> c_int {
+    match value {
+        Value::TypedValue(TypeContents::String(string)) => {
+            *string_ptr = string.as_ptr() as *const c_char;
+            *string_len = string.len();
+            STARDUST_DB_OK
+        }
+        Value::Null => STARDUST_DB_VALUE_NULL,
+        _ => STARDUST_DB_VALUE_WRONG_TYPE,
+    }
+}
+
+unsafe fn as_string_len(value: &Value, string_len: *mut usize) -> c_int {
+    match value {
+        Value::TypedValue(TypeContents::String(string)) => {
+            *string_len = string.len();
+            STARDUST_DB_OK
+        }
+        Value::Null => STARDUST_DB_VALUE_NULL,
+        _ => STARDUST_DB_VALUE_WRONG_TYPE,
+    }
+}
+
 unsafe fn as_int(value: &Value, int_buffer: *mut IntegerStorage) -> c_int {
     match value {
         Value::TypedValue(TypeContents::Integer(i)) => {
@@ -403,8 +488,7 @@ pub unsafe extern "C" fn get_string_index(
     buffer_len: usize,
 ) -> c_int {
     let value = result_to_error!(get_value_index(row_set, column));
-    get_string(value, string_buffer, buffer_len);
-    STARDUST_DB_OK
+    get_string(value, string_buffer, buffer_len)
 }
 
 /// If the value at the specified column is an integer, copy the value to the buffer, otherwise a type error is returned.
@@ -466,16 +550,69 @@ pub unsafe extern "C" fn get_int_index_cast(
     }
 }
 
+/// If the value at the specified column is a string, set `string_ptr` to point to the string and `string_len` to its length in bytes, otherwise a type error is returned.
+/// The string is not null-terminated. It remains valid until the next call to `execute_query` or `close_row_set` with this `RowSet`.
+/// # Safety
+/// `row_set` must point to a RowSet initialised by `execute_query`.
+/// `string_ptr` and `string_len` must point to valid pieces of memory.
+#[no_mangle]
+pub unsafe extern "C" fn get_string_ref_index(
+    row_set: *const RowSet,
+    column: usize,
+    string_ptr: *mut *const c_char,
+    string_len: *mut usize,
+) -> c_int {
+    let value = result_to_error!(get_value_index(row_set, column));
+    as_string_ref(value, string_ptr, string_len)
+}
+
+/// If the value at the specified column is a string, set `string_len` to its length in bytes, not including a null terminator, otherwise a type error is returned.
+/// # Safety
+/// `row_set` must point to a RowSet initialised by `execute_query`.
+/// `string_len` must point to a valid piece of memory.
+#[no_mangle]
+pub unsafe extern "C" fn get_string_len_index(
+    row_set: *const RowSet,
+    column: usize,
+    string_len: *mut usize,
+) -> c_int {
+    let value = result_to_error!(get_value_index(row_set, column));
+    as_string_len(value, string_len)
+}
+
 unsafe fn get_value_named(
     row_set: *const RowSet,
     column: *const c_char,
 ) -> core::result::Result<&'static Value, c_int> {
     let (relation, row) = get_relation_and_verify_row(row_set)?;
+    let column = resolve_column_index(relation, column)?;
+    relation.get_value(column, row).ok_or(STARDUST_DB_END)
+}
+
+unsafe fn resolve_column_index(
+    relation: &Relation,
+    column: *const c_char,
+) -> core::result::Result<usize, c_int> {
     let column = CStr::from_ptr(column);
     let column = column.to_str().map_err(|_| STARDUST_DB_NO_COLUMN)?;
-    relation
-        .get_value_named(column, row)
-        .ok_or(STARDUST_DB_NO_COLUMN)
+    relation.column_index(column).ok_or(STARDUST_DB_NO_COLUMN)
+}
+
+/// Sets the value in `index` to the index of the first column with the specified name, for use with the `*_index` functions.
+/// The index remains valid for later executions of the same query.
+/// # Safety
+/// `row_set` must point to a RowSet initialised by `execute_query`.
+/// `column` must be a null-terminated string.
+/// `index` must point to a valid piece of memory.
+#[no_mangle]
+pub unsafe extern "C" fn resolve_column(
+    row_set: *const RowSet,
+    column: *const c_char,
+    index: *mut usize,
+) -> c_int {
+    let relation = result_to_error!(get_relation(row_set));
+    *index = result_to_error!(resolve_column_index(relation, column));
+    STARDUST_DB_OK
 }
 
 /// Sets the value in `is_null` to 1 if the value at the specified column is null, otherwise 0.
@@ -540,8 +677,7 @@ pub unsafe extern "C" fn get_string_named(
     buffer_len: usize,
 ) -> c_int {
     let value = result_to_error!(get_value_named(row_set, column));
-    get_string(value, string_buffer, buffer_len);
-    STARDUST_DB_OK
+    get_string(value, string_buffer, buffer_len)
 }
 
 /// If the value at the specified column is an integer, copy the value to the buffer, otherwise a type error is returned.
@@ -604,3 +740,493 @@ pub unsafe extern "C" fn get_int_named_cast(
         STARDUST_DB_VALUE_NULL
     }
 }
+
+/// If the value at the specified column is a string, set `string_ptr` to point to the string and `string_len` to its length in bytes, otherwise a type error is returned.
+/// The string is not null-terminated. It remains valid until the next call to `execute_query` or `close_row_set` with this `RowSet`.
+/// # Safety
+/// `row_set` must point to a RowSet initialised by `execute_query`.
+/// `column` must be a null-terminated string.
+/// `string_ptr` and `string_len` must point to valid pieces of memory.
+#[no_mangle]
+pub unsafe extern "C" fn get_string_ref_named(
+    row_set: *const RowSet,
+    column: *const c_char,
+    string_ptr: *mut *const c_char,
+    string_len: *mut usize,
+) -> c_int {
+    let value = result_to_error!(get_value_named(row_set, column));
+    as_string_ref(value, string_ptr, string_len)
+}
+
+/// If the value at the specified column is a string, set `string_len` to its length in bytes, not including a null terminator, otherwise a type error is returned.
+/// # Safety
+/// `row_set` must point to a RowSet initialised by `execute_query`.
+/// `column` must be a null-terminated string.
+/// `string_len` must point to a valid piece of memory.
+#[no_mangle]
+pub unsafe extern "C" fn get_string_len_named(
+    row_set: *const RowSet,
+    column: *const c_char,
+    string_len: *mut usize,
+) -> c_int {
+    let value = result_to_error!(get_value_named(row_set, column));
+    as_string_len(value, string_len)
+}
+
+unsafe fn get_column_rows(
+    row_set: *const RowSet,
+    column: usize,
+    start_row: usize,
+    num_rows: usize,
+) -> core::result::Result<(&'static Relation, Range<usize>), c_int> {
+    let relation = get_relation(row_set)?;
+    if column >= relation.num_columns() {
+        return Err(STARDUST_DB_NO_COLUMN);
+    }
+    if start_row >= relation.num_rows() {
+        return Err(STARDUST_DB_END);
+    }
+    let end_row = start_row.saturating_add(num_rows).min(relation.num_rows());
+    Ok((relation, start_row..end_row))
+}
+
+unsafe fn set_null(null_buffer: *mut u8, index: usize, is_null: bool) -> c_int {
+    if null_buffer.is_null() {
+        if is_null {
+            return STARDUST_DB_VALUE_NULL;
+        }
+    } else {
+        *null_buffer.add(index) = is_null as u8;
+    }
+    STARDUST_DB_OK
+}
+
+/// Copies up to `num_rows` integers from the specified column, starting at `start_row`, into `int_buffer`.
+/// The number of values copied is placed in `num_fetched`, which is less than `num_rows` at the end of the `RowSet`.
+/// For each value, `null_buffer` is set to 1 if the value is null, otherwise 0. If `null_buffer` is null, `STARDUST_DB_VALUE_NULL` is returned on the first null value.
+/// A type error is returned on the first value that isn't an integer, and `STARDUST_DB_END` if `start_row` is past the end of the `RowSet`.
+/// # Safety
+/// `row_set` must point to a RowSet initialised by `execute_query`.
+/// `int_buffer` must point to a valid piece of memory, no shorter than `num_rows` integers.
+/// `null_buffer` must be null, or point to a valid piece of memory no shorter than `num_rows`.
+/// `num_fetched` must point to a valid piece of memory.
+#[no_mangle]
+pub unsafe extern "C" fn get_int_column(
+    row_set: *const RowSet,
+    column: usize,
+    start_row: usize,
+    num_rows: usize,
+    int_buffer: *mut IntegerStorage,
+    null_buffer: *mut u8,
+    num_fetched: *mut usize,
+) -> c_int {
+    *num_fetched = 0;
+    let (relation, rows) = result_to_error!(get_column_rows(row_set, column, start_row, num_rows));
+    for (index, row) in rows.enumerate() {
+        let value = option_to_error!(relation.get_value(column, row), STARDUST_DB_END);
+        let is_null = match value {
+            Value::TypedValue(TypeContents::Integer(i)) => {
+                *int_buffer.add(index) = *i;
+                false
+            }
+            Value::Null => {
+                *int_buffer.add(index) = 0;
+                true
+            }
+            _ => return STARDUST_DB_VALUE_WRONG_TYPE,
+        };
+        let result = set_null(null_buffer, index, is_null);
+        if result != STARDUST_DB_OK {
+            return result;
+        }
+        *num_fetched = index + 1;
+    }
+    STARDUST_DB_OK
+}
+
+/// Copies up to `num_rows` strings from the specified column, starting at `start_row`, into `data_buffer`.
+/// The strings are placed back to back without null terminators. The string for fetched row `i` occupies the bytes from `offsets[i]` to `offsets[i + 1]`, so `offsets` must have room for `num_rows + 1` values.
+/// The number of values copied is placed in `num_fetched`. Fewer than `num_rows` values are copied at the end of the `RowSet`, or if the next string does not fit in `data_buffer`.
+/// `STARDUST_DB_BUFFER_TOO_SMALL` is returned if the first string does not fit.
+/// For each value, `null_buffer` is set to 1 if the value is null, otherwise 0. If `null_buffer` is null, `STARDUST_DB_VALUE_NULL` is returned on the first null value.
+/// A type error is returned on the first value that isn't a string, and `STARDUST_DB_END` if `start_row` is past the end of the `RowSet`.
+/// # Safety
+/// `row_set` must point to a RowSet initialised by `execute_query`.
+/// `offsets` must point to a valid piece of memory, no shorter than `num_rows + 1` values.
+/// `data_buffer` must point to a valid piece of memory, no shorter than `data_len`.
+/// `null_buffer` must be null, or point to a valid piece of memory no shorter than `num_rows`.
+/// `num_fetched` must point to a valid piece of memory.
+#[no_mangle]
+#[allow(clippy::too_many_arguments)]
+pub unsafe extern "C" fn get_string_column(
+    row_set: *const RowSet,
+    column: usize,
+    start_row: usize,
+    num_rows: usize,
+    offsets: *mut usize,
+    data_buffer: *mut c_char,
+    data_len: usize,
+    null_buffer: *mut u8,
+    num_fetched: *mut usize,
+) -> c_int {
+    *num_fetched = 0;
+    let (relation, rows) = result_to_error!(get_column_rows(row_set, column, start_row, num_rows));
+    let mut data_position = 0;
+    *offsets = 0;
+    for (index, row) in rows.enumerate() {
+        let value = option_to_error!(relation.get_value(column, row), STARDUST_DB_END);
+        let is_null = match value {
+            Value::TypedValue(TypeContents::String(string)) => {
+                if string.len() > data_len - data_position {
+                    return if index == 0 {
+                        STARDUST_DB_BUFFER_TOO_SMALL
+                    } else {
+                        STARDUST_DB_OK
+                    };
+                }
+                copy_nonoverlapping(
+                    string.as_ptr() as *const c_char,
+                    data_buffer.add(data_position),
+                    string.len(),
+                );
+                data_position += string.len();
+                false
+            }
+            Value::Null => true,
+            _ => return STARDUST_DB_VALUE_WRONG_TYPE,
+        };
+        let result = set_null(null_buffer, index, is_null);
+        if result != STARDUST_DB_OK {
+            return result;
+        }
+        *offsets.add(index + 1) = data_position;
+        *num_fetched = index + 1;
+    }
+    STARDUST_DB_OK
+}
+
+/// Exports every row of the `RowSet` through the Arrow C data interface, as a struct array with one child per column.
+/// Integer columns are exported as int64, and columns containing strings as utf8.
+/// The `release` callbacks of `schema` and `array` must be called once the caller is finished with them.
+/// # Safety
+/// `row_set` must point to a RowSet initialised by `execute_query`.
+/// `schema` and `array` must point to valid pieces of memory.
+#[no_mangle]
+pub unsafe extern "C" fn export_arrow(
+    row_set: *const RowSet,
+    schema: *mut ArrowSchema,
+    array: *mut ArrowArray,
+) -> c_int {
+    let row_set = option_to_error!(row_set.as_ref(), STARDUST_DB_NULL_ROW_SET);
+    let relation = option_to_error!(row_set.relation.as_ref(), STARDUST_DB_NULL_ROW_SET);
+    let (exported_schema, exported_array) =
+        result_to_error!(relation.to_arrow(), STARDUST_DB_EXPORT_ERROR);
+    schema.write(exported_schema);
+    array.write(exported_array);
+    STARDUST_DB_OK
+}
+
+/// Reports the buffer usage of the `RowSet`.
+/// `value_capacity` is set to the number of values the `RowSet` can hold without reallocating,
+/// and `peak_rows` to the largest number of rows it has held.
+/// # Safety
+/// `row_set` must point to a RowSet initialised by `execute_query`.
+/// `value_capacity` and `peak_rows` must point to valid memory.
+#[no_mangle]
+pub unsafe extern "C" fn get_row_set_stats(
+    row_set: *const RowSet,
+    value_capacity: *mut usize,
+    peak_rows: *mut usize,
+) -> c_int {
+    let relation = result_to_error!(get_relation(row_set));
+    *value_capacity = relation.value_capacity();
+    *peak_rows = relation.peak_rows();
+    STARDUST_DB_OK
+}
+
+unsafe fn bulk_column(
+    column: &StardustColumn,
+    num_rows: usize,
+) -> core::result::Result<BulkColumn<'static>, c_int> {
+    let name = if column.name.is_null() {
+        None
+    } else {
+        Some(
+            CStr::from_ptr(column.name)
+                .to_str()
+                .map_err(|_| STARDUST_DB_INVALID_QUERY_UTF_8)?,
+        )
+    };
+    let values = match column.column_type {
+        STARDUST_DB_INTEGER_COLUMN if !column.int_values.is_null() => {
+            BulkValues::Integer(slice::from_raw_parts(column.int_values, num_rows))
+        }
+        STARDUST_DB_STRING_COLUMN if !column.offsets.is_null() => {
+            let num_offsets = num_rows.checked_add(1).ok_or(STARDUST_DB_INVALID_COLUMN)?;
+            let offsets = slice::from_raw_parts(column.offsets, num_offsets);
+            let data_len = offsets[num_rows];
+            let data = if data_len == 0 {
+                &[]
+            } else if column.data.is_null() {
+                return Err(STARDUST_DB_INVALID_COLUMN);
+            } else {
+                slice::from_raw_parts(column.data as *const u8, data_len)
+            };
+            BulkValues::String { offsets, data }
+        }
+        _ => return Err(STARDUST_DB_INVALID_COLUMN),
+    };
+    let nulls = if column.null_buffer.is_null() {
+        None
+    } else {
+        Some(slice::from_raw_parts(column.null_buffer, num_rows))
+    };
+    Ok(BulkColumn {
+        name,
+        values,
+        nulls,
+    })
+}
+
+/// Inserts `num_rows` rows into `table`, taking the values from the column arrays in `columns` rather than parsing SQL.
+/// Table columns missing from `columns` are set to their default values. Constraints are checked as for `INSERT`, and no rows are inserted if any row fails.
+/// Giving a table column more than once, by name or by position, is an execution error.
+/// Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+/// # Safety
+/// `db` must point to a Db initialised by `open_database` or `temp_db`.
+/// `table` must be a null-terminated string.
+/// `columns` must point to `num_columns` columns, each with buffers no shorter than described by `StardustColumn`.
+/// `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+#[no_mangle]
+pub unsafe extern "C" fn bulk_insert(
+    db: *mut Db,
+    table: *const c_char,
+    num_rows: usize,
+    columns: *const StardustColumn,
+    num_columns: usize,
+    err_buff: *mut c_char,
+    err_buff_len: usize,
+) -> c_int {
+    let database = result_to_error!(get_database(db));
+    let table = CStr::from_ptr(table);
+    let table = result_to_error!(table.to_str(), STARDUST_DB_INVALID_QUERY_UTF_8);
+    let columns = if num_columns == 0 {
+        &[]
+    } else {
+        slice::from_raw_parts(columns, num_columns)
+    };
+    let columns = result_to_error!(columns
+        .iter()
+        .map(|c| bulk_column(c, num_rows))
+        .collect::<core::result::Result<Vec<_>, _>>());
+    if let Err(e) = database.bulk_insert(table, num_rows, &columns) {
+        let err_str = e.to_string();
+        return result_to_error!(fill_buffer(
+            &err_str,
+            err_buff,
+            err_buff_len,
+            true,
+            STARDUST_DB_EXECUTION_ERROR
+        ));
+    }
+    STARDUST_DB_OK
+}
+
+/// Executes every query in `query` and places the results in `results`, to be retrieved in order with `next_result`.
+/// Changes are flushed to disk once, after the last query.
+/// Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`,
+/// and `results` is left empty.
+/// # Safety
+/// `db` must point to a Db initialised by `open_database` or `temp_db`.
+/// `query` must be a null-terminated string.
+/// `results` must point to a ResultList initialised by `RESULT_LIST_INIT`, or a previous invocation of `execute_batch`.
+/// `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+#[no_mangle]
+pub unsafe extern "C" fn execute_batch(
+    db: *mut Db,
+    query: *const c_char,
+    results: *mut ResultList,
+    err_buff: *mut c_char,
+    err_buff_len: usize,
+) -> c_int {
+    let database = result_to_error!(get_database(db));
+    let query = CStr::from_ptr(query);
+    let query = result_to_error!(query.to_str(), STARDUST_DB_INVALID_QUERY_UTF_8);
+    let results = option_to_error!(results.as_mut(), STARDUST_DB_NULL_RESULT_LIST);
+    if results.results.is_null() {
+        results.results = Box::into_raw(Box::new(QueryResults {
+            relations: Vec::new(),
+            next: 0,
+        }));
+    }
+    let results = &mut *results.results;
+    results.next = 0;
+    match database.execute_query(query) {
+        Ok(relations) => results.relations = relations,
+        Err(e) => {
+            results.relations.clear();
+            let err_str = e.to_string();
+            return result_to_error!(fill_buffer(
+                &err_str,
+                err_buff,
+                err_buff_len,
+                true,
+                STARDUST_DB_EXECUTION_ERROR
+            ));
+        }
+    }
+    STARDUST_DB_OK
+}
+
+/// Moves the next result of the `ResultList` into `row_set`, positioned at its first row.
+/// Returns `STARDUST_DB_END` once every result has been retrieved.
+/// # Safety
+/// `results` must point to a ResultList initialised by `execute_batch`.
+/// `row_set` must point to a RowSet initialised by `ROW_SET_INIT`, or a previous invocation of `execute_query` or `next_result`.
+#[no_mangle]
+pub unsafe extern "C" fn next_result(results: *mut ResultList, row_set: *mut RowSet) -> c_int {
+    let results = option_to_error!(results.as_mut(), STARDUST_DB_NULL_RESULT_LIST);
+    let results = option_to_error!(results.results.as_mut(), STARDUST_DB_NULL_RESULT_LIST);
+    let next = option_to_error!(results.relations.get_mut(results.next), STARDUST_DB_END);
+    let relation = result_to_error!(reset_row_set(row_set));
+    relation.replace(std::mem::take(next));
+    results.next += 1;
+    STARDUST_DB_OK
+}
+
+/// Gets the number of results in the `ResultList`, including those already retrieved.
+/// # Safety
+/// `results` must point to a ResultList initialised by `execute_batch`.
+/// `num_results` must point to a valid piece of memory.
+#[no_mangle]
+pub unsafe extern "C" fn num_results(results: *const ResultList, num_results: *mut usize) -> c_int {
+    let results = option_to_error!(results.as_ref(), STARDUST_DB_NULL_RESULT_LIST);
+    let results = option_to_error!(results.results.as_ref(), STARDUST_DB_NULL_RESULT_LIST);
+    *num_results = results.relations.len();
+    STARDUST_DB_OK
+}
+
+/// Frees the memory from the `ResultList`.
+/// # Safety
+/// `results` must point to a ResultList initialised by `execute_batch` or `RESULT_LIST_INIT`.
+#[no_mangle]
+pub unsafe extern "C" fn close_result_list(results: *mut ResultList) {
+    let results = option_to_error!(results.as_mut());
+    if !results.results.is_null() {
+        let _ = Box::<QueryResults>::from_raw(results.results);
+    }
+    results.results = null_mut();
+}
+
+/// Writes a consistent backup of the whole database to the file at `path`, while the database stays online.
+/// Queries continue to run during the backup, but statements that modify the database wait for it to finish.
+/// If `stats` is not null, statistics about the backup are placed in it.
+/// Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+/// # Safety
+/// `db` must point to a Db initialised by `open_database` or `temp_db`.
+/// `path` must be a null-terminated string.
+/// `stats` must be null or point to a valid piece of memory.
+/// `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+#[no_mangle]
+pub unsafe extern "C" fn backup_database(
+    db: *mut Db,
+    path: *const c_char,
+    stats: *mut BackupStats,
+    err_buff: *mut c_char,
+    err_buff_len: usize,
+) -> c_int {
+    let database = result_to_error!(get_database(db));
+    let path = CStr::from_ptr(path);
+    let path = result_to_error!(path.to_str(), STARDUST_DB_INVALID_PATH_UTF_8);
+    match database.backup_to(path) {
+        Ok(backup_stats) => {
+            if let Some(stats) = stats.as_mut() {
+                *stats = backup_stats;
+            }
+            STARDUST_DB_OK
+        }
+        Err(e) => {
+            let err_str = e.to_string();
+            result_to_error!(fill_buffer(
+                &err_str,
+                err_buff,
+                err_buff_len,
+                true,
+                STARDUST_DB_BACKUP_ERROR
+            ))
+        }
+    }
+}
+
+/// Restores the backup at `backup_path` into a new database at `path`, and opens it in `db`.
+/// `path` must not exist, or must be an empty directory.
+/// If `stats` is not null, statistics about the restore are placed in it.
+/// Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+/// # Safety
+/// `backup_path` and `path` must be null-terminated strings.
+/// `db` must point to a valid piece of memory.
+/// `stats` must be null or point to a valid piece of memory.
+/// `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+#[no_mangle]
+pub unsafe extern "C" fn restore_database(
+    backup_path: *const c_char,
+    path: *const c_char,
+    db: *mut Db,
+    stats: *mut BackupStats,
+    err_buff: *mut c_char,
+    err_buff_len: usize,
+) -> c_int {
+    let backup_path = CStr::from_ptr(backup_path);
+    let backup_path = result_to_error!(backup_path.to_str(), STARDUST_DB_INVALID_PATH_UTF_8);
+    let path = CStr::from_ptr(path);
+    let path = result_to_error!(path.to_str(), STARDUST_DB_INVALID_PATH_UTF_8);
+    match Database::restore_from(backup_path, path) {
+        Ok((database, restore_stats)) => {
+            if let Some(stats) = stats.as_mut() {
+                *stats = restore_stats;
+            }
+            *db = Db::Ordinary(Box::into_raw(Box::new(database)));
+            STARDUST_DB_OK
+        }
+        Err(e) => {
+            let err_str = e.to_string();
+            result_to_error!(fill_buffer(
+                &err_str,
+                err_buff,
+                err_buff_len,
+                true,
+                STARDUST_DB_BACKUP_ERROR
+            ))
+        }
+    }
+}
+
+/// Freezes `table` into an immutable, memory-mapped file, so that it is read without copying and doesn't slow down opening the database.
+/// Frozen tables cannot be modified, but can be dropped.
+/// Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+/// # Safety
+/// `db` must point to a Db initialised by `open_database` or `temp_db`.
+/// `table` must be a null-terminated string.
+/// `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+#[no_mangle]
+pub unsafe extern "C" fn freeze_table(
+    db: *mut Db,
+    table: *const c_char,
+    err_buff: *mut c_char,
+    err_buff_len: usize,
+) -> c_int {
+    let database = result_to_error!(get_database(db));
+    let table = CStr::from_ptr(table);
+    let table = result_to_error!(table.to_str(), STARDUST_DB_INVALID_QUERY_UTF_8);
+    if let Err(e) = database.freeze_table(table) {
+        let err_str = e.to_string();
+        return result_to_error!(fill_buffer(
+            &err_str,
+            err_buff,
+            err_buff_len,
+            true,
+            STARDUST_DB_EXECUTION_ERROR
+        ));
+    }
+    STARDUST_DB_OK
+}
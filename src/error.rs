@@ -18,6 +18,9 @@ pub enum Error {
     /// An error in from the `bincode` encoder/decoder.
     #[error("Serialization error: {0}")]
     Serialization(#[from] bincode::Error),
+    /// An error reading or writing a file.
+    #[error("IO error: {0}")]
+    Io(#[from] std::io::Error),
     /// An error caused by a bug in the database system.
     #[error("Internal error: {0}")]
     Internal(String),
@@ -104,4 +107,67 @@ pub enum ExecutionError {
     /// The foreign key referred columns are not unique.
     #[error("FOREIGN KEY constraint `{0}` does not refer to unique columns")]
     ForeignKeyNotUnique(String),
+    /// A column passed to a bulk insert contains out of bounds offsets or invalid UTF-8.
+    #[error("invalid data for column `{0}`")]
+    InvalidColumnData(String),
+    /// A bulk insert was given more than one column for the same table column.
+    #[error("column `{0}` is given more than once")]
+    DuplicateColumn(String),
+    /// The query would modify a read-only replica.
+    #[error("cannot modify a read-only replica")]
+    ReadOnlyReplica,
+    /// The table is frozen, so cannot be modified.
+    #[error("table `{0}` is frozen")]
+    FrozenTable(String),
+    /// The table is partitioned, so cannot be frozen or partitioned again.
+    #[error("table `{0}` is partitioned")]
+    PartitionedTable(String),
+    /// The table is not partitioned.
+    #[error("table `{0}` is not partitioned")]
+    NotPartitioned(String),
+    /// The partition doesn't exist.
+    #[error("partition `{0}` doesn't exist")]
+    NoPartition(String),
+    /// The partition already exists.
+    #[error("partition `{0}` already exists")]
+    PartitionExists(String),
+    /// The bounds of the partition overlap another partition, or are empty.
+    #[error("partition `{0}` overlaps another partition")]
+    PartitionOverlap(String),
+    /// The row's partition column value isn't in any partition of the table.
+    #[error("row is outside every partition of table `{0}`")]
+    RowOutsidePartitions(String),
+    /// A hash partitioned table must have between 1 and `MAX_HASH_PARTITIONS` partitions.
+    #[error("a table cannot have {0} hash partitions")]
+    InvalidPartitionCount(u32),
+    /// The table is not partitioned by range, so partitions cannot be added or dropped.
+    #[error("table `{0}` is not partitioned by range")]
+    NotRangePartitioned(String),
+    /// Only `DEFAULT` and `NOT NULL` can be given for a column added to an existing table.
+    #[error("column `{0}` can only be added with DEFAULT or NOT NULL")]
+    AddColumnConstraint(String),
+    /// Only `ADD COLUMN` is supported by `ALTER TABLE`.
+    #[error("unsupported ALTER TABLE operation: {0}")]
+    UnsupportedAlterTable(String),
+    /// A column added to an existing table with `NOT NULL` must have a default, which the existing rows take.
+    #[error("column `{0}` is NOT NULL but has no default")]
+    NotNullWithoutDefault(String),
+    /// A table can only be altered `u16::MAX` times.
+    #[error("table `{0}` has been altered too many times")]
+    TooManySchemaVersions(String),
+    /// The index doesn't exist.
+    #[error("index `{0}` doesn't exist")]
+    NoIndex(String),
+    /// The index already exists.
+    #[error("index `{0}` already exists")]
+    IndexExists(String),
+    /// An index must have at least one column.
+    #[error("index `{0}` has no columns")]
+    NoIndexColumns(String),
+    /// The rows of a table cannot be moved while one of its indexes is being built.
+    #[error("index `{0}` is still being built")]
+    IndexBuilding(String),
+    /// The keys of an index must be expressions, and its predicate a condition, of the columns of its table.
+    #[error("invalid index expression `{0}`")]
+    InvalidIndexExpression(String),
 }
@@ -0,0 +1,244 @@
+//! Row expiry.
+//!
+//! A table can have an expiry column, holding the time in seconds since the Unix epoch after which each row expires.
+//! The expiry column of each table is stored in the `@expiry` tree. Expired rows are deleted by `reap`, a small batch
+//! at a time on a background thread, so that expiring rows doesn't need `DELETE` statements that delete every expired
+//! row at once. Rows with a null expiry never expire. Queries still return expired rows until they are reaped.
+//!
+//! Scanning a table for expired rows also finds when its next row expires. The table isn't scanned again until then,
+//! unless it is written to first.
+
+use std::{
+    collections::HashMap,
+    ops::Deref,
+    sync::{Arc, Mutex},
+    thread::{self, JoinHandle},
+    time::{Duration, SystemTime, UNIX_EPOCH},
+};
+
+use crate::{
+    data_types::{IntegerStorage, Type},
+    error::{Error, ExecutionError, Result},
+    interpreter::Interpreter,
+    replication::Change,
+    resolved_expression::ResolvedColumn,
+    table_handler::{RowBatch, TableStorage},
+    Database, GetData,
+};
+
+const EXPIRY_TREE: &str = "@expiry";
+/// The number of seconds to wait before trying again to delete the expired rows of a table when deleting them failed,
+/// unless the table is written to first.
+const RETRY_SECONDS: IntegerStorage = 60;
+
+/// When the next row of each table with an expiry column expires, as found by the last scan of the table.
+#[derive(Debug, Default)]
+pub(crate) struct ExpirySchedule {
+    tables: Mutex<HashMap<String, NextExpiry>>,
+}
+
+#[derive(Debug, Clone, Copy)]
+struct NextExpiry {
+    /// The earliest expiry time of the rows that hadn't expired, or `None` if none of them expire.
+    at: Option<IntegerStorage>,
+    /// The number of writes to the table's trees when it was scanned.
+    writes: u64,
+}
+
+impl ExpirySchedule {
+    /// Forgets when the next row of `table` expires, so that it is scanned the next time rows are reaped.
+    pub fn remove_table(&self, table: &str) {
+        self.lock().remove(table);
+    }
+
+    fn lock(&self) -> std::sync::MutexGuard<HashMap<String, NextExpiry>> {
+        self.tables.lock().unwrap_or_else(|e| e.into_inner())
+    }
+}
+
+/// Sets the column holding the expiry time of the rows of `table`, or stops rows of the table expiring if `column`
+/// is `None`. The column must be an integer column.
+pub(crate) fn set_expiry_column(
+    interpreter: &Interpreter,
+    table: &str,
+    column: Option<&str>,
+) -> Result<()> {
+    let replication = interpreter.replication();
+    if replication.is_replica() {
+        return Err(ExecutionError::ReadOnlyReplica.into());
+    }
+    let _write = interpreter.lock_writes();
+    let handler = interpreter.open_table(table, None)?;
+    if let TableStorage::Frozen(_) = handler.storage() {
+        return Err(ExecutionError::FrozenTable(table.to_owned()).into());
+    }
+    let expiry = interpreter.db().open_tree(EXPIRY_TREE)?;
+    interpreter.expiry_schedule().remove_table(table);
+    match column {
+        Some(column) => {
+            let column_type = handler
+                .columns()
+                .get_data_type(column)
+                .ok_or_else(|| ExecutionError::NoColumn(column.to_owned()))?;
+            if column_type != Type::Integer {
+                return Err(ExecutionError::TypeError {
+                    column: column.to_owned(),
+                    expected_type: Type::Integer,
+                    actual_type: column_type,
+                }
+                .into());
+            }
+            expiry.insert(table.as_bytes(), column.as_bytes())?;
+            replication.record(&expiry, |tree| Change::Insert {
+                tree,
+                key: table.as_bytes().to_vec(),
+                value: column.as_bytes().to_vec(),
+            });
+        }
+        None => {
+            if expiry.remove(table.as_bytes())?.is_some() {
+                replication.record(&expiry, |tree| Change::Remove {
+                    tree,
+                    key: table.as_bytes().to_vec(),
+                });
+            }
+        }
+    }
+    interpreter.flush()
+}
+
+/// Removes the expiry column of `table`, when it is dropped.
+pub(crate) fn remove_table(interpreter: &Interpreter, table: &str) -> Result<()> {
+    interpreter.expiry_schedule().remove_table(table);
+    let expiry = interpreter.db().open_tree(EXPIRY_TREE)?;
+    if expiry.remove(table.as_bytes())?.is_some() {
+        interpreter
+            .replication()
+            .record(&expiry, |tree| Change::Remove {
+                tree,
+                key: table.as_bytes().to_vec(),
+            });
+    }
+    Ok(())
+}
+
+/// Deletes up to `max_rows` expired rows, returning the number deleted. The rows of each table are deleted with a
+/// single batch per tree. If the rows of a table can't be deleted, for example because a foreign key refers to them,
+/// the rows of the other tables are still deleted, and the first error is returned afterwards.
+pub(crate) fn reap_expired_rows(interpreter: &Interpreter, max_rows: usize) -> Result<usize> {
+    if interpreter.replication().is_replica() {
+        return Err(ExecutionError::ReadOnlyReplica.into());
+    }
+    let now = SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map_or(0, |time| time.as_secs()) as IntegerStorage;
+    let mut reaped = 0;
+    let mut first_error = None;
+    for entry in interpreter.db().open_tree(EXPIRY_TREE)?.iter() {
+        if reaped == max_rows {
+            break;
+        }
+        let (table, column) = entry?;
+        let (table, column) = match (std::str::from_utf8(&table), std::str::from_utf8(&column)) {
+            (Ok(table), Ok(column)) => (table, column),
+            _ => return Err(Error::Internal("Invalid expiry column".to_owned())),
+        };
+        match reap_table(interpreter, table, column, now, max_rows - reaped) {
+            Ok(num_rows) => reaped += num_rows,
+            Err(e) => {
+                first_error.get_or_insert(e);
+            }
+        }
+    }
+    if reaped > 0 {
+        interpreter.flush()?;
+    }
+    match first_error {
+        Some(e) => Err(e),
+        None => Ok(reaped),
+    }
+}
+
+fn reap_table(
+    interpreter: &Interpreter,
+    table: &str,
+    column: &str,
+    now: IntegerStorage,
+    max_rows: usize,
+) -> Result<usize> {
+    let _write = interpreter.lock_writes();
+    let handler = interpreter.open_table(table, None)?;
+    // A frozen table cannot be modified, so its rows are kept until it is dropped.
+    if let TableStorage::Frozen(_) = handler.storage() {
+        return Ok(0);
+    }
+    let trees = handler.trees()?;
+    let writes = || -> u64 {
+        trees
+            .iter()
+            .map(|tree| interpreter.write_counts().total(&tree.name()))
+            .sum()
+    };
+    let schedule = interpreter.expiry_schedule();
+    if let Some(next) = schedule.lock().get(table) {
+        if next.writes == writes() && next.at.map_or(true, |at| at > now) {
+            return Ok(0);
+        }
+    }
+
+    let column = ResolvedColumn::new(table.to_owned(), column.to_owned());
+    let mut rows = Vec::new();
+    let mut next_expiry: Option<IntegerStorage> = None;
+    for row in handler.iter_where(None) {
+        let row = row?;
+        match (&handler, &row).get_data(&column)?.cast_int() {
+            Some(expires) if expires <= now && rows.len() < max_rows => rows.push(row),
+            Some(expires) => next_expiry = Some(next_expiry.map_or(expires, |n| n.min(expires))),
+            None => {}
+        }
+    }
+    let num_rows = rows.len();
+    let mut batch = RowBatch::default();
+    let deleted = rows
+        .into_iter()
+        .try_for_each(|row| handler.delete_row_batch(row, interpreter, &mut batch))
+        .and_then(|_| handler.apply_batch(batch, interpreter));
+    if deleted.is_err() {
+        next_expiry = Some(now + RETRY_SECONDS);
+    }
+    schedule.lock().insert(
+        table.to_owned(),
+        NextExpiry {
+            at: next_expiry,
+            writes: writes(),
+        },
+    );
+    deleted.map(|_| num_rows)
+}
+
+/// Deletes expired rows on a background thread, until the database is dropped. At most `batch_len` rows are deleted
+/// every `interval`, which limits the rate of deletion so that other statements aren't slowed down. Errors deleting
+/// rows are passed to `on_error`, and the rows of the tables that failed are tried again later.
+pub fn reap<D, E>(
+    database: &Arc<D>,
+    batch_len: usize,
+    interval: Duration,
+    on_error: E,
+) -> JoinHandle<()>
+where
+    D: Deref<Target = Database> + Send + Sync + 'static,
+    E: Fn(Error) + Send + 'static,
+{
+    let database = Arc::downgrade(database);
+    thread::spawn(move || loop {
+        match database.upgrade() {
+            Some(database) => {
+                if let Err(e) = database.reap_expired_rows(batch_len) {
+                    on_error(e);
+                }
+            }
+            None => return,
+        };
+        thread::sleep(interval);
+    })
+}
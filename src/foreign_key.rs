@@ -1,24 +1,247 @@
-use std::{borrow::Borrow, convert::TryInto};
+use std::{
+    borrow::Borrow,
+    collections::{HashMap, HashSet, VecDeque},
+    convert::TryInto,
+    sync::RwLock,
+};
 
 use co_sort::{co_sort, Permutation};
+use sled::IVec;
 
 use crate::{
     ast::{ForeignKey, ForeignKeyAction},
     data_types::{IntegerStorage, Value},
-    error::{ExecutionError, Result},
+    error::{Error, ExecutionError, Result},
     interpreter::Interpreter,
+    replication::Change,
     storage::Columns,
     table_handler::{TableHandler, TableRow, TableRowUpdater},
 };
 
+/// The tree mapping each table to the keys of the rows of `@foreign_keys` referring from and to it.
+const TABLE_KEYS_TREE: &str = "@foreign_key_tables";
+
+/// Whether a foreign key refers from or to a table.
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum Direction {
+    Outgoing,
+    Incoming,
+}
+
+impl Direction {
+    fn tag(self) -> u8 {
+        match self {
+            Direction::Outgoing => b'o',
+            Direction::Incoming => b'i',
+        }
+    }
+}
+
+/// The keys of the rows of `@foreign_keys` referring from and to a table.
+#[derive(Debug, Default)]
+struct TableKeys {
+    outgoing: Vec<IVec>,
+    incoming: Vec<IVec>,
+}
+
+impl TableKeys {
+    fn get_mut(&mut self, direction: Direction) -> &mut Vec<IVec> {
+        match direction {
+            Direction::Outgoing => &mut self.outgoing,
+            Direction::Incoming => &mut self.incoming,
+        }
+    }
+}
+
+/// The foreign keys of each table, so that finding them doesn't scan `@foreign_keys`. The map is persisted in
+/// `TABLE_KEYS_TREE`, and loaded into memory when first used. Databases created before the tree existed have it
+/// built from `@foreign_keys` then.
+#[derive(Debug, Default)]
+pub(crate) struct ForeignKeyIndex {
+    tables: RwLock<Option<HashMap<String, TableKeys>>>,
+}
+
+impl ForeignKeyIndex {
+    /// Returns the keys of the rows of `@foreign_keys` referring from or to `table`.
+    fn keys<C: Borrow<Columns>, N: AsRef<str>>(
+        &self,
+        table: &str,
+        direction: Direction,
+        handler: &TableHandler<C, N>,
+        interpreter: &Interpreter,
+    ) -> Result<Vec<IVec>> {
+        if let Some(tables) = &*self.tables.read().unwrap_or_else(|e| e.into_inner()) {
+            return Ok(tables
+                .get(table)
+                .map_or_else(Vec::new, |keys| match direction {
+                    Direction::Outgoing => keys.outgoing.clone(),
+                    Direction::Incoming => keys.incoming.clone(),
+                }));
+        }
+        self.load(handler, interpreter)?;
+        self.keys(table, direction, handler, interpreter)
+    }
+
+    fn load<C: Borrow<Columns>, N: AsRef<str>>(
+        &self,
+        handler: &TableHandler<C, N>,
+        interpreter: &Interpreter,
+    ) -> Result<()> {
+        let mut tables = self.tables.write().unwrap_or_else(|e| e.into_inner());
+        if tables.is_some() {
+            return Ok(());
+        }
+        let tree = interpreter.db().open_tree(TABLE_KEYS_TREE)?;
+        if tree.is_empty() {
+            for row in handler.iter() {
+                let row = row?;
+                let table = handler.get_value("table", &row)?.assume_string()?;
+                let referred_table = handler.get_value("referred_table", &row)?.assume_string()?;
+                self.persist(&table, &referred_table, row.key(), true, interpreter)?;
+            }
+        }
+        let mut loaded = HashMap::<_, TableKeys>::new();
+        for entry in tree.iter().keys() {
+            let entry = entry?;
+            let (table, direction, key) = parse_entry(&entry)?;
+            loaded
+                .entry(table)
+                .or_default()
+                .get_mut(direction)
+                .push(IVec::from(key));
+        }
+        *tables = Some(loaded);
+        Ok(())
+    }
+
+    /// Records the row of `@foreign_keys` with the key `key`, referring from `table` to `referred_table`.
+    fn add(
+        &self,
+        table: &str,
+        referred_table: &str,
+        key: &[u8],
+        interpreter: &Interpreter,
+    ) -> Result<()> {
+        self.persist(table, referred_table, key, true, interpreter)?;
+        if let Some(tables) = &mut *self.tables.write().unwrap_or_else(|e| e.into_inner()) {
+            for (table, direction) in [
+                (table, Direction::Outgoing),
+                (referred_table, Direction::Incoming),
+            ] {
+                tables
+                    .entry(table.to_owned())
+                    .or_default()
+                    .get_mut(direction)
+                    .push(IVec::from(key));
+            }
+        }
+        Ok(())
+    }
+
+    fn remove(
+        &self,
+        table: &str,
+        referred_table: &str,
+        key: &[u8],
+        interpreter: &Interpreter,
+    ) -> Result<()> {
+        self.persist(table, referred_table, key, false, interpreter)?;
+        if let Some(tables) = &mut *self.tables.write().unwrap_or_else(|e| e.into_inner()) {
+            for (table, direction) in [
+                (table, Direction::Outgoing),
+                (referred_table, Direction::Incoming),
+            ] {
+                if let Some(keys) = tables.get_mut(table) {
+                    keys.get_mut(direction).retain(|k| k != key);
+                }
+            }
+        }
+        Ok(())
+    }
+
+    fn persist(
+        &self,
+        table: &str,
+        referred_table: &str,
+        key: &[u8],
+        insert: bool,
+        interpreter: &Interpreter,
+    ) -> Result<()> {
+        let tree = interpreter.db().open_tree(TABLE_KEYS_TREE)?;
+        for (table, direction) in [
+            (table, Direction::Outgoing),
+            (referred_table, Direction::Incoming),
+        ] {
+            let entry = entry(table, direction, key);
+            if insert {
+                tree.insert(entry.as_slice(), &[])?;
+            } else {
+                tree.remove(entry.as_slice())?;
+            }
+            interpreter.replication().record(&tree, |tree| {
+                if insert {
+                    Change::Insert {
+                        tree,
+                        key: entry,
+                        value: Vec::new(),
+                    }
+                } else {
+                    Change::Remove { tree, key: entry }
+                }
+            });
+        }
+        Ok(())
+    }
+}
+
+/// Encodes an entry of `TABLE_KEYS_TREE` as the table name, a zero byte, the direction and the row key.
+fn entry(table: &str, direction: Direction, key: &[u8]) -> Vec<u8> {
+    let mut entry = Vec::with_capacity(table.len() + 2 + key.len());
+    entry.extend_from_slice(table.as_bytes());
+    entry.push(0);
+    entry.push(direction.tag());
+    entry.extend_from_slice(key);
+    entry
+}
+
+fn parse_entry(entry: &[u8]) -> Result<(String, Direction, &[u8])> {
+    let invalid = || Error::Internal("Invalid foreign key table entry".to_owned());
+    let separator = entry.iter().position(|&b| b == 0).ok_or_else(invalid)?;
+    let table = String::from_utf8(entry[..separator].to_vec()).map_err(|_| invalid())?;
+    let direction = match entry.get(separator + 1) {
+        Some(b'o') => Direction::Outgoing,
+        Some(b'i') => Direction::Incoming,
+        _ => return Err(invalid()),
+    };
+    Ok((table, direction, &entry[separator + 2..]))
+}
+
 #[derive(Debug)]
 pub struct ForeignKeys<'a, C: Borrow<Columns>, N: AsRef<str>> {
     handler: &'a TableHandler<C, N>,
+    index: &'a ForeignKeyIndex,
 }
 
 impl<'a, C: Borrow<Columns>, N: AsRef<str>> ForeignKeys<'a, C, N> {
-    pub fn new(handler: &'a TableHandler<C, N>) -> Self {
-        Self { handler }
+    pub(crate) fn new(handler: &'a TableHandler<C, N>, index: &'a ForeignKeyIndex) -> Self {
+        Self { handler, index }
+    }
+
+    /// Returns the rows of `@foreign_keys` referring from or to `table`.
+    fn rows<'b>(
+        &'b self,
+        table: &str,
+        direction: Direction,
+        interpreter: &Interpreter,
+    ) -> impl Iterator<Item = Result<TableRow>> + 'b {
+        let (keys, error) = match self.index.keys(table, direction, self.handler, interpreter) {
+            Ok(keys) => (keys, None),
+            Err(e) => (Vec::new(), Some(Err(e))),
+        };
+        error.into_iter().chain(
+            keys.into_iter()
+                .filter_map(move |key| self.handler.get_row(&key).transpose()),
+        )
     }
 
     pub fn add_key(
@@ -44,27 +267,21 @@ impl<'a, C: Borrow<Columns>, N: AsRef<str>> ForeignKeys<'a, C, N> {
             name.into(),
             table_name.into(),
             columns.into(),
-            foreign_table.into(),
+            foreign_table.clone().into(),
             referred_columns.into(),
             on_delete.into(),
             on_update.into(),
         ];
-        self.handler.insert_values(values, interpreter)?;
-        Ok(())
+        let key = self.handler.insert_values(values, interpreter)?;
+        self.index
+            .add(table_name, &foreign_table, &key, interpreter)
     }
 
     pub fn process_drop_table(&self, table: &str, interpreter: &Interpreter) -> Result<()> {
-        for row in self.handler.iter() {
+        for row in self.rows(table, Direction::Incoming, interpreter) {
             let row = row?;
             let parent_table = self.handler.get_value("table", &row)?.assume_string()?;
-            if parent_table == table {
-                self.handler.delete_row(&row, interpreter)?;
-            } else if self
-                .handler
-                .get_value("referred_table", &row)?
-                .assume_string()?
-                == table
-            {
+            if parent_table != table {
                 let key_name = self.handler.get_value("name", &row)?.assume_string()?;
                 return Err(ExecutionError::ForeignKeyDependencyDelete {
                     parent_table,
@@ -73,119 +290,168 @@ impl<'a, C: Borrow<Columns>, N: AsRef<str>> ForeignKeys<'a, C, N> {
                 .into());
             }
         }
+        for row in self.rows(table, Direction::Outgoing, interpreter) {
+            let row = row?;
+            let referred_table = self
+                .handler
+                .get_value("referred_table", &row)?
+                .assume_string()?;
+            self.handler.delete_row(&row, interpreter)?;
+            self.index
+                .remove(table, &referred_table, row.key(), interpreter)?;
+        }
         Ok(())
     }
 
+    /// Returns the foreign keys referring from `table`, whose columns are `columns`.
     pub fn child_foreign_keys<'b>(
         &'b self,
         table: &'b str,
+        columns: &'b Columns,
         interpreter: &'b Interpreter,
     ) -> impl Iterator<Item = Result<ChildKeyChecker>> + 'b {
-        self.handler.iter().filter_map(move |row| {
-            (|| {
+        self.rows(table, Direction::Outgoing, interpreter)
+            .map(move |row| {
                 let row = row?;
-                let table_name = self.handler.get_value("table", &row)?;
-                if table_name.assume_string()? == table {
-                    let foreign_key_name = self.handler.get_value("name", &row)?.assume_string()?;
-                    let mut this_columns = self
-                        .handler
-                        .get_value("columns", &row)?
-                        .assume_string()?
-                        .split('|')
-                        .map(|c| self.handler.column_index(c))
-                        .collect::<Result<Vec<_>>>()?;
-                    let foreign_table = self
-                        .handler
-                        .get_value("referred_table", &row)?
-                        .assume_string()?;
-                    let foreign_handler = interpreter.open_table(foreign_table, None)?;
-                    let mut foreign_columns = self
-                        .handler
-                        .get_value("referred_columns", &row)?
-                        .assume_string()?
-                        .split('|')
-                        .map(|column_name| foreign_handler.column_index(column_name))
-                        .collect::<Result<Vec<_>>>()?;
-
-                    co_sort!(foreign_columns, this_columns);
-
-                    Ok(Some(ChildKeyChecker::new(
-                        foreign_key_name,
-                        this_columns,
-                        foreign_handler,
-                        foreign_columns,
-                    )))
-                } else {
-                    Ok(None)
-                }
-            })()
-            .transpose()
-        })
+                let foreign_key_name = self.handler.get_value("name", &row)?.assume_string()?;
+                let mut this_columns = self
+                    .handler
+                    .get_value("columns", &row)?
+                    .assume_string()?
+                    .split('|')
+                    .map(|c| {
+                        columns
+                            .get_index(c)
+                            .ok_or_else(|| ExecutionError::NoColumn(c.to_owned()).into())
+                    })
+                    .collect::<Result<Vec<_>>>()?;
+                let foreign_table = self
+                    .handler
+                    .get_value("referred_table", &row)?
+                    .assume_string()?;
+                let foreign_handler = interpreter.open_table(foreign_table, None)?;
+                let mut foreign_columns = self
+                    .handler
+                    .get_value("referred_columns", &row)?
+                    .assume_string()?
+                    .split('|')
+                    .map(|column_name| foreign_handler.column_index(column_name))
+                    .collect::<Result<Vec<_>>>()?;
+
+                co_sort!(foreign_columns, this_columns);
+
+                Ok(ChildKeyChecker::new(
+                    foreign_key_name,
+                    this_columns,
+                    foreign_handler,
+                    foreign_columns,
+                ))
+            })
     }
 
+    /// Returns the foreign keys referring to `table`.
     pub fn parent_foreign_keys<'b>(
         &'b self,
         table: &'b str,
         interpreter: &'b Interpreter,
     ) -> impl Iterator<Item = Result<ParentKeyChecker>> + 'b {
-        self.handler.iter().filter_map(move |row| {
-            (|| {
+        self.rows(table, Direction::Incoming, interpreter)
+            .map(move |row| {
                 let row = row?;
-                let child_table = self
+                let foreign_key_name = self.handler.get_value("name", &row)?.assume_string()?;
+                let parent_table = self.handler.get_value("table", &row)?.assume_string()?;
+                let parent_handler = interpreter.open_table(parent_table, None)?;
+                let mut parent_columns: Vec<usize> = self
                     .handler
-                    .get_value("referred_table", &row)?
-                    .assume_string()?;
-                if child_table == table {
-                    let foreign_key_name = self.handler.get_value("name", &row)?.assume_string()?;
-                    let parent_table = self.handler.get_value("table", &row)?.assume_string()?;
-                    let parent_handler = interpreter.open_table(parent_table, None)?;
-                    let mut parent_columns: Vec<usize> = self
-                        .handler
-                        .get_value("columns", &row)?
-                        .assume_string()?
-                        .split('|')
-                        .map(|c| parent_handler.column_index(c))
-                        .collect::<Result<_>>()?;
-                    let child_handler = interpreter.open_table(child_table, None)?;
-                    let mut child_columns: Vec<usize> = self
-                        .handler
-                        .get_value("referred_columns", &row)?
-                        .assume_string()?
-                        .split('|')
-                        .map(|column_name| child_handler.column_index(column_name))
-                        .collect::<Result<_>>()?;
-
-                    co_sort!(parent_columns, child_columns);
-                    let on_update = self
-                        .handler
-                        .get_value("on_update", &row)?
-                        .assume_integer()?
-                        .try_into()?;
-                    let on_delete = self
-                        .handler
-                        .get_value("on_delete", &row)?
-                        .assume_integer()?
-                        .try_into()?;
-                    Ok(Some(ParentKeyChecker::new(
-                        foreign_key_name,
-                        child_columns,
-                        parent_handler,
-                        parent_columns,
-                        on_update,
-                        on_delete,
-                    )))
-                } else {
-                    Ok(None)
-                }
-            })()
-            .transpose()
-        })
+                    .get_value("columns", &row)?
+                    .assume_string()?
+                    .split('|')
+                    .map(|c| parent_handler.column_index(c))
+                    .collect::<Result<_>>()?;
+                let child_handler = interpreter.open_table(table, None)?;
+                let mut child_columns: Vec<usize> = self
+                    .handler
+                    .get_value("referred_columns", &row)?
+                    .assume_string()?
+                    .split('|')
+                    .map(|column_name| child_handler.column_index(column_name))
+                    .collect::<Result<_>>()?;
+
+                co_sort!(parent_columns, child_columns);
+                let on_update = self
+                    .handler
+                    .get_value("on_update", &row)?
+                    .assume_integer()?
+                    .try_into()?;
+                let on_delete = self
+                    .handler
+                    .get_value("on_delete", &row)?
+                    .assume_integer()?
+                    .try_into()?;
+                Ok(ParentKeyChecker::new(
+                    foreign_key_name,
+                    child_columns,
+                    parent_handler,
+                    parent_columns,
+                    on_update,
+                    on_delete,
+                ))
+            })
     }
 }
 
 pub enum Action<'a> {
-    Delete,
-    Update(&'a [Value]),
+    /// The rows are deleted, along with the rows whose deletion cascades from them, collected in the `Deletions`.
+    Delete(&'a mut Deletions),
+    /// The rows are updated to the new values at the same positions.
+    Update(&'a [Vec<Value>]),
+}
+
+/// The rows deleted by a statement and by the foreign keys cascading from them. Cascades are carried out
+/// breadth-first from a queue, not by recursion, and each row is deleted once, so a long chain of cascades can't
+/// overflow the stack and a self-referencing table can't cascade back to a row already deleted.
+pub struct Deletions {
+    /// The keys of the rows deleted from each table so far.
+    visited: HashMap<String, HashSet<Vec<u8>>>,
+    /// Rows deleted by a cascade, whose referring rows are yet to be acted on.
+    queue: VecDeque<(TableHandler<Columns, String>, Vec<TableRow>)>,
+}
+
+impl Deletions {
+    /// Starts from `rows` of `table`, deleted by the statement.
+    pub fn new(table: &str, rows: &[TableRow]) -> Self {
+        let keys = rows.iter().map(|row| row.key().to_vec()).collect();
+        Self {
+            visited: std::iter::once((table.to_owned(), keys)).collect(),
+            queue: VecDeque::new(),
+        }
+    }
+
+    fn contains(&self, table: &str, key: &[u8]) -> bool {
+        self.visited
+            .get(table)
+            .map_or(false, |keys| keys.contains(key))
+    }
+
+    /// Queues the rows of `handler` that aren't already deleted.
+    fn push(&mut self, handler: TableHandler<Columns, String>, rows: Vec<TableRow>) {
+        let keys = self
+            .visited
+            .entry(handler.unaliased_table_name().to_owned())
+            .or_default();
+        let rows = rows
+            .into_iter()
+            .filter(|row| keys.insert(row.key().to_vec()))
+            .collect::<Vec<_>>();
+        if !rows.is_empty() {
+            self.queue.push_back((handler, rows));
+        }
+    }
+
+    /// Returns the next rows deleted by a cascade, in the order they were found.
+    pub fn pop(&mut self) -> Option<(TableHandler<Columns, String>, Vec<TableRow>)> {
+        self.queue.pop_front()
+    }
 }
 
 pub struct ChildKeyChecker {
@@ -210,7 +476,24 @@ impl ChildKeyChecker {
         }
     }
 
-    pub fn check_row_contains(self, this_row: &[Value]) -> Result<()> {
+    pub fn name(&self) -> &str {
+        &self.name
+    }
+
+    pub fn check_row_contains(&self, this_row: &[Value], interpreter: &Interpreter) -> Result<()> {
+        let values = self
+            .this_columns
+            .iter()
+            .map(|&column| &this_row[column])
+            .collect::<Vec<_>>();
+        if !self.foreign_handler.may_contain_key(
+            &self.foreign_columns,
+            &values,
+            true,
+            interpreter,
+        )? {
+            return Err(ExecutionError::ForeignKeyConstraintFailed(self.name.clone()).into());
+        }
         'row: for foreign_row in self.foreign_handler.iter() {
             let foreign_row = foreign_row?;
             for (&this_column, foreign_column) in
@@ -225,7 +508,96 @@ impl ChildKeyChecker {
             }
             return Ok(());
         }
-        Err(ExecutionError::ForeignKeyConstraintFailed(self.name).into())
+        Err(ExecutionError::ForeignKeyConstraintFailed(self.name.clone()).into())
+    }
+
+    /// Checks that every row of `rows`, inserted together into `this_table`, refers to a row of the foreign table or,
+    /// if the foreign key refers to `this_table`, to another row of `rows`. The keys that the foreign table's key
+    /// filter cannot rule out are looked up in a single scan of the foreign table, rather than a scan for each row.
+    pub fn check_rows_contain(
+        self,
+        rows: &[&[Value]],
+        this_table: &str,
+        interpreter: &Interpreter,
+    ) -> Result<()> {
+        let mut missing = HashSet::new();
+        let mut compared = Vec::new();
+        for row in rows {
+            let values = self
+                .this_columns
+                .iter()
+                .map(|&column| &row[column])
+                .collect::<Vec<_>>();
+            if self
+                .foreign_handler
+                .has_column_types(&self.foreign_columns, &values)?
+            {
+                missing.insert(values.into_iter().cloned().collect::<Vec<_>>());
+            } else {
+                // Nulls, and values of another type, are compared one by one.
+                compared.push(*row);
+            }
+        }
+        let self_referencing = self.foreign_handler.unaliased_table_name() == this_table;
+        if self_referencing {
+            for row in rows {
+                let key = self
+                    .foreign_columns
+                    .iter()
+                    .map(|&column| row[column].clone())
+                    .collect::<Vec<_>>();
+                missing.remove(&key);
+            }
+        }
+        for row in compared {
+            let refers_to_batch = self_referencing
+                && rows.iter().any(|other| {
+                    self.this_columns
+                        .iter()
+                        .zip(&self.foreign_columns)
+                        .all(|(&this, &foreign)| row[this].equals_or_null(&other[foreign]))
+                });
+            if !refers_to_batch {
+                self.check_row_contains(row, interpreter)?;
+            }
+        }
+        for values in &missing {
+            let values = values.iter().collect::<Vec<_>>();
+            if !self.foreign_handler.may_contain_key(
+                &self.foreign_columns,
+                &values,
+                true,
+                interpreter,
+            )? {
+                return Err(ExecutionError::ForeignKeyConstraintFailed(self.name).into());
+            }
+        }
+        for foreign_row in self.foreign_handler.iter() {
+            if missing.is_empty() {
+                break;
+            }
+            let foreign_row = foreign_row?;
+            let foreign_values = self
+                .foreign_columns
+                .iter()
+                .map(|&column| self.foreign_handler.get_value(column, &foreign_row))
+                .collect::<Result<Vec<_>>>()?;
+            // A null in the foreign row's key matches any value in that column, as in `check_row_contains`.
+            if foreign_values.iter().any(Value::is_null) {
+                missing.retain(|key| {
+                    !key.iter()
+                        .zip(&foreign_values)
+                        .all(|(value, foreign_value)| value.equals_or_null(foreign_value))
+                });
+            } else {
+                missing.remove(&foreign_values);
+            }
+        }
+        if missing.is_empty() {
+            Ok(())
+        } else {
+            Err(ExecutionError::ForeignKeyConstraintFailed(self.name).into())
+        }
     }
 }
 
@@ -258,77 +630,130 @@ impl ParentKeyChecker {
         }
     }
 
+    /// Carries out the foreign key's action on the rows of the referring table that refer to `old_rows` of
+    /// `handler`, which are being deleted or updated. The referring table is scanned once for all of `old_rows`. The
+    /// rows found are updated in a single batch, which carries out the actions of the foreign keys referring to them in
+    /// turn, or queued in the `Deletions` of a delete to be acted on and deleted after the rows being scanned for.
     pub fn check_parent_rows<H: Borrow<Columns>, N: AsRef<str>>(
         self,
-        old_row: &TableRow,
+        old_rows: &[TableRow],
         handler: &TableHandler<H, N>,
-        action: Action,
+        mut action: Action,
         interpreter: &Interpreter,
     ) -> Result<()> {
         let foreign_key_action = match &action {
-            Action::Delete => self.on_delete,
-            Action::Update(new_row) => {
-                let mut equal = true;
-                for &i in &self.child_columns {
-                    if handler.get_value(i, old_row)? != new_row[i] {
-                        equal = false;
-                        break;
-                    }
-                }
-                if equal {
-                    return Ok(());
-                }
-                self.on_update
-            }
+            Action::Delete(_) => self.on_delete,
+            Action::Update(_) => self.on_update,
         };
-        'row: for parent_row in self.parent_handler.iter() {
-            let parent_row = parent_row?;
-            for (child, parent) in self.child_columns.iter().zip(self.parent_columns.iter()) {
-                let foreign_value = self.parent_handler.get_value(*parent, &parent_row)?;
-                if !handler
-                    .get_value(*child, old_row)?
-                    .equals_or_null(&foreign_value)
+        // The position in `old_rows` of the first row with each key that changes. Keys with a null, or a value of
+        // another type, compare equal to values with different encodings, so are compared one by one.
+        let mut keys = HashMap::new();
+        let mut unhashed = Vec::new();
+        for (position, old_row) in old_rows.iter().enumerate() {
+            let key = self
+                .child_columns
+                .iter()
+                .map(|&child| handler.get_value(child, old_row))
+                .collect::<Result<Vec<_>>>()?;
+            if let Action::Update(new_rows) = &action {
+                let new_row = &new_rows[position];
+                if self
+                    .child_columns
+                    .iter()
+                    .zip(&key)
+                    .all(|(&child, old_value)| *old_value == new_row[child])
                 {
-                    continue 'row;
+                    continue;
                 }
             }
-            match foreign_key_action {
-                ForeignKeyAction::NoAction => {
-                    return Err(ExecutionError::ForeignKeyConstraintFailed(self.name).into())
+            let key_values = key.iter().collect::<Vec<_>>();
+            if !self
+                .parent_handler
+                .has_column_types(&self.parent_columns, &key_values)?
+            {
+                unhashed.push((position, key));
+            } else if self.parent_handler.may_contain_key(
+                &self.parent_columns,
+                &key_values,
+                true,
+                interpreter,
+            )? {
+                keys.entry(key).or_insert(position);
+            }
+        }
+        if keys.is_empty() && unhashed.is_empty() {
+            return Ok(());
+        }
+        let table = self.parent_handler.unaliased_table_name();
+        let mut parent_rows = Vec::new();
+        for parent_row in self.parent_handler.iter() {
+            let parent_row = parent_row?;
+            // Rows already deleted by the statement are not acted on again.
+            if let Action::Delete(deletions) = &action {
+                if deletions.contains(table, parent_row.key()) {
+                    continue;
                 }
-                ForeignKeyAction::SetNull | ForeignKeyAction::SetDefault => {
+            }
+            let values = self
+                .parent_columns
+                .iter()
+                .map(|&parent| self.parent_handler.get_value(parent, &parent_row))
+                .collect::<Result<Vec<_>>>()?;
+            // A row with a null in the foreign key's columns refers to nothing.
+            if values.iter().any(Value::is_null) {
+                continue;
+            }
+            let mut position = keys.get(&values).copied();
+            if let Some((unhashed_position, _)) = unhashed.iter().find(|(_, key)| {
+                key.iter()
+                    .zip(&values)
+                    .all(|(child, parent)| child.equals_or_null(parent))
+            }) {
+                position = Some(position.map_or(*unhashed_position, |p| p.min(*unhashed_position)));
+            }
+            if let Some(position) = position {
+                parent_rows.push((parent_row, position));
+            }
+        }
+        if parent_rows.is_empty() {
+            return Ok(());
+        }
+        if let (ForeignKeyAction::Cascade, Action::Delete(deletions)) =
+            (foreign_key_action, &mut action)
+        {
+            let parent_rows = parent_rows.into_iter().map(|(row, _)| row).collect();
+            deletions.push(self.parent_handler, parent_rows);
+            return Ok(());
+        }
+        match (foreign_key_action, action) {
+            (ForeignKeyAction::NoAction, _) => {
+                Err(ExecutionError::ForeignKeyConstraintFailed(self.name).into())
+            }
+            (foreign_key_action, action) => {
+                let cascaded_key = match foreign_key_action {
+                    ForeignKeyAction::Cascade => Some(self.name.clone()),
+                    _ => None,
+                };
+                let mut updates = Vec::with_capacity(parent_rows.len());
+                for (parent_row, position) in parent_rows {
                     let mut new_row = TableRowUpdater::new(&parent_row, &self.parent_handler);
-                    for parent in self.parent_columns.iter().copied() {
-                        match foreign_key_action {
-                            ForeignKeyAction::SetNull => new_row.add_update(parent, Value::Null)?,
-                            ForeignKeyAction::SetDefault => {
-                                let default = self.parent_handler.get_default(parent);
-                                new_row.add_update(parent, default)?;
+                    for (&parent, &child) in self.parent_columns.iter().zip(&self.child_columns) {
+                        let value = match (foreign_key_action, &action) {
+                            (ForeignKeyAction::SetNull, _) => Value::Null,
+                            (ForeignKeyAction::SetDefault, _) => {
+                                self.parent_handler.get_default(parent)
                             }
-                            _ => unreachable!(),
-                        }
+                            (_, Action::Update(new_rows)) => new_rows[position][child].clone(),
+                            (_, Action::Delete(_)) => unreachable!(),
+                        };
+                        new_row.add_update(parent, value)?;
                     }
                     let new_row = new_row.finalise()?;
-                    self.parent_handler
-                        .update_row(parent_row, interpreter, new_row)?;
+                    updates.push((parent_row, new_row));
                 }
-                ForeignKeyAction::Cascade => match action {
-                    Action::Delete => self.parent_handler.delete_row(&parent_row, interpreter)?,
-                    Action::Update(new_row) => {
-                        let mut updated_row =
-                            TableRowUpdater::new(&parent_row, &self.parent_handler);
-                        for (&parent, &child) in
-                            self.parent_columns.iter().zip(self.child_columns.iter())
-                        {
-                            updated_row.add_update(parent, new_row[child].clone())?;
-                        }
-                        let updated_row = updated_row.finalise()?;
-                        self.parent_handler
-                            .update_row(parent_row, interpreter, updated_row)?;
-                    }
-                },
+                self.parent_handler
+                    .update_rows(updates, cascaded_key, interpreter)
             }
         }
-        Ok(())
     }
 }
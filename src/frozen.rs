@@ -0,0 +1,285 @@
+//! Immutable tables frozen into sorted, memory-mapped files.
+//!
+//! A frozen table file starts with `MAGIC`, followed by the rows of the table in key order. Each row is the length of
+//! its key and value as big-endian `u32`s, then the key and value. Rows are grouped into blocks of about `BLOCK_LEN`
+//! bytes, and a sparse index after the rows holds the offset and first key of every block. The file ends with the
+//! offset of the index, the number of blocks and the number of rows as big-endian `u64`s, then `MAGIC` again.
+//!
+//! Opening a frozen table maps the file and reads only the index, so the cost doesn't depend on the number of rows.
+//! Rows are read directly from the mapping without copying.
+
+use std::{
+    cmp::Ordering,
+    convert::TryInto,
+    fs::{self, File},
+    io::{self, BufWriter, ErrorKind, Write},
+    mem::size_of,
+    ops::Range,
+    path::Path,
+    sync::Arc,
+};
+
+use memmap2::Mmap;
+
+use crate::{
+    error::{Error, Result},
+    table_handler::RowBytes,
+};
+
+const MAGIC: &[u8] = b"STARDUST_FROZEN1";
+/// The size of the rows in a block, after which a new block is started.
+const BLOCK_LEN: usize = 4096;
+const FOOTER_LEN: usize = 3 * size_of::<u64>() + MAGIC.len();
+const ROW_HEADER_LEN: usize = 2 * size_of::<u32>();
+
+/// A table frozen into a sorted, memory-mapped file.
+#[derive(Debug)]
+pub struct FrozenTable {
+    map: Arc<Mmap>,
+    /// The offset and first key of each block.
+    blocks: Vec<(usize, Range<usize>)>,
+    rows_end: usize,
+    num_rows: u64,
+}
+
+impl FrozenTable {
+    /// Writes `rows`, which must be in key order, to a new frozen table file at `path`. Returns the number of rows.
+    pub(crate) fn write<I>(path: &Path, rows: I) -> Result<u64>
+    where
+        I: IntoIterator<Item = Result<(RowBytes, RowBytes)>>,
+    {
+        let temporary_path = path.with_extension("tmp");
+        let mut writer = BufWriter::new(File::create(&temporary_path)?);
+        writer.write_all(MAGIC)?;
+        let mut offset = MAGIC.len();
+        let mut blocks = Vec::new();
+        let mut block_start = None;
+        let mut num_rows = 0u64;
+        for row in rows {
+            let (key, value) = row?;
+            if block_start.map_or(true, |start| offset - start >= BLOCK_LEN) {
+                block_start = Some(offset);
+                blocks.push((offset as u64, key.to_vec()));
+            }
+            writer.write_all(&length(key.len())?.to_be_bytes())?;
+            writer.write_all(&length(value.len())?.to_be_bytes())?;
+            writer.write_all(&key)?;
+            writer.write_all(&value)?;
+            offset += ROW_HEADER_LEN + key.len() + value.len();
+            num_rows += 1;
+        }
+
+        let index_offset = offset as u64;
+        for (block_offset, first_key) in &blocks {
+            writer.write_all(&block_offset.to_be_bytes())?;
+            writer.write_all(&length(first_key.len())?.to_be_bytes())?;
+            writer.write_all(first_key)?;
+        }
+        writer.write_all(&index_offset.to_be_bytes())?;
+        writer.write_all(&(blocks.len() as u64).to_be_bytes())?;
+        writer.write_all(&num_rows.to_be_bytes())?;
+        writer.write_all(MAGIC)?;
+        writer
+            .into_inner()
+            .map_err(|e| Error::Io(e.into_error()))?
+            .sync_all()?;
+        fs::rename(&temporary_path, path)?;
+        Ok(num_rows)
+    }
+
+    /// Maps the frozen table file at `path`, reading its block index.
+    pub fn open<P: AsRef<Path>>(path: P) -> Result<Self> {
+        let file = File::open(path)?;
+        // The file is never modified once written, so the mapping cannot change underneath us.
+        let map = unsafe { Mmap::map(&file)? };
+        if map.len() < MAGIC.len() + FOOTER_LEN
+            || &map[..MAGIC.len()] != MAGIC
+            || &map[map.len() - MAGIC.len()..] != MAGIC
+        {
+            return Err(corrupt());
+        }
+        let footer = map.len() - FOOTER_LEN;
+        let index_offset = read_u64(&map, footer)?;
+        let num_blocks = read_u64(&map, footer + size_of::<u64>())?;
+        let num_rows = read_u64(&map, footer + 2 * size_of::<u64>())?;
+        if index_offset < MAGIC.len() || index_offset > footer {
+            return Err(corrupt());
+        }
+
+        let mut blocks = Vec::with_capacity(num_blocks.min(footer / size_of::<u64>()));
+        let mut position = index_offset;
+        for _ in 0..num_blocks {
+            let block_offset = read_u64(&map, position)?;
+            let key_len = read_u32(&map, position + size_of::<u64>())?;
+            let key_start = position + size_of::<u64>() + size_of::<u32>();
+            position = key_start + key_len;
+            if block_offset >= index_offset || position > footer {
+                return Err(corrupt());
+            }
+            blocks.push((block_offset, key_start..position));
+        }
+        Ok(Self {
+            map: Arc::new(map),
+            blocks,
+            rows_end: index_offset,
+            num_rows: num_rows as u64,
+        })
+    }
+
+    /// Returns the number of rows in the table.
+    pub fn num_rows(&self) -> u64 {
+        self.num_rows
+    }
+
+    /// Finds the value of the row with `key`, using the block index to read only the block that could contain it.
+    pub fn get(&self, key: &[u8]) -> Result<Option<&[u8]>> {
+        let block = self
+            .blocks
+            .partition_point(|(_, first_key)| &self.map[first_key.clone()] <= key);
+        if block == 0 {
+            return Ok(None);
+        }
+        let start = self.blocks[block - 1].0;
+        let end = self
+            .blocks
+            .get(block)
+            .map_or(self.rows_end, |(offset, _)| *offset);
+        let mut position = start;
+        while position < end {
+            let (row_key, row_value) = read_row(&self.map, position, end)?;
+            match self.map[row_key.clone()].cmp(key) {
+                Ordering::Less => position = row_value.end,
+                Ordering::Equal => return Ok(Some(&self.map[row_value])),
+                Ordering::Greater => break,
+            }
+        }
+        Ok(None)
+    }
+
+    /// Returns an iterator over every row of the table in key order. The rows refer to the mapping, rather than
+    /// copying it.
+    pub(crate) fn rows(&self) -> FrozenRows {
+        FrozenRows {
+            map: self.map.clone(),
+            position: MAGIC.len(),
+            end: self.rows_end,
+        }
+    }
+}
+
+/// An iterator over the rows of a `FrozenTable`.
+pub(crate) struct FrozenRows {
+    map: Arc<Mmap>,
+    position: usize,
+    end: usize,
+}
+
+impl Iterator for FrozenRows {
+    type Item = Result<(RowBytes, RowBytes)>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.position >= self.end {
+            return None;
+        }
+        Some(match read_row(&self.map, self.position, self.end) {
+            Ok((key, value)) => {
+                self.position = value.end;
+                Ok((
+                    RowBytes::Mapped(self.map.clone(), key),
+                    RowBytes::Mapped(self.map.clone(), value),
+                ))
+            }
+            Err(e) => {
+                self.position = self.end;
+                Err(e)
+            }
+        })
+    }
+}
+
+fn read_row(map: &[u8], position: usize, end: usize) -> Result<(Range<usize>, Range<usize>)> {
+    let key_len = read_u32(map, position)?;
+    let value_len = read_u32(map, position + size_of::<u32>())?;
+    let key_start = position + ROW_HEADER_LEN;
+    let value_start = key_start + key_len;
+    let value_end = value_start + value_len;
+    if value_end > end {
+        return Err(corrupt());
+    }
+    Ok((key_start..value_start, value_start..value_end))
+}
+
+fn read_u64(map: &[u8], position: usize) -> Result<usize> {
+    let bytes = map
+        .get(position..position + size_of::<u64>())
+        .ok_or_else(corrupt)?;
+    u64::from_be_bytes(bytes.try_into().unwrap())
+        .try_into()
+        .map_err(|_| corrupt())
+}
+
+fn read_u32(map: &[u8], position: usize) -> Result<usize> {
+    let bytes = map
+        .get(position..position + size_of::<u32>())
+        .ok_or_else(corrupt)?;
+    Ok(u32::from_be_bytes(bytes.try_into().unwrap()) as usize)
+}
+
+fn length(len: usize) -> Result<u32> {
+    len.try_into().map_err(|_| {
+        Error::Io(io::Error::new(
+            ErrorKind::InvalidInput,
+            "Row too large to freeze",
+        ))
+    })
+}
+
+fn corrupt() -> Error {
+    Error::Io(io::Error::new(
+        ErrorKind::InvalidData,
+        "Corrupt frozen table file",
+    ))
+}
+
+#[cfg(test)]
+mod tests {
+    use std::{env::temp_dir, fs};
+
+    use sled::IVec;
+
+    use super::FrozenTable;
+    use crate::table_handler::RowBytes;
+
+    #[test]
+    fn write_and_read() {
+        let path = temp_dir().join(format!("stardust_frozen_{}.frozen", std::process::id()));
+        let rows = (0u64..2000).map(|i| {
+            Ok((
+                RowBytes::Tree(IVec::from(&i.to_be_bytes()[..])),
+                RowBytes::Tree(IVec::from(format!("row {}", i))),
+            ))
+        });
+        assert_eq!(FrozenTable::write(&path, rows).unwrap(), 2000);
+
+        let table = FrozenTable::open(&path).unwrap();
+        assert_eq!(table.num_rows(), 2000);
+        assert!(table.blocks.len() > 1);
+        assert_eq!(table.rows().count(), 2000);
+        let (key, value) = table.rows().nth(1500).unwrap().unwrap();
+        assert_eq!(&*key, &1500u64.to_be_bytes());
+        assert_eq!(&*value, b"row 1500");
+        assert_eq!(
+            table.get(&1999u64.to_be_bytes()).unwrap(),
+            Some(&b"row 1999"[..])
+        );
+        assert_eq!(table.get(&0u64.to_be_bytes()).unwrap(), Some(&b"row 0"[..]));
+        assert_eq!(table.get(&2000u64.to_be_bytes()).unwrap(), None);
+        assert_eq!(table.get(b"").unwrap(), None);
+        drop(table);
+
+        let contents = fs::read(&path).unwrap();
+        fs::write(&path, &contents[..contents.len() - 1]).unwrap();
+        assert!(FrozenTable::open(&path).is_err());
+        fs::remove_file(&path).unwrap();
+    }
+}
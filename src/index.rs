@@ -0,0 +1,607 @@
+//! Secondary indexes.
+//!
+//! An index maps the values of some expressions of the columns of a table, usually just columns, to the keys of the
+//! rows holding them, so that a query with an equality on every indexed expression reads only the matching rows. A
+//! partial index only holds the rows matching its predicate, so is only used by queries whose `WHERE` clause includes
+//! every condition of the predicate. Each index is stored in its own sled tree, whose keys are the encoded values
+//! followed by the row key, and is kept up to date by every statement writing to its table. The definitions of the
+//! indexes are stored in the `@indexes` tree.
+//!
+//! Building an index doesn't block writes to its table for the whole build. The index is first recorded as building,
+//! so that every statement from then on maintains it, then filled from the existing rows a chunk at a time, pausing
+//! writes only while each chunk is read. Once every row has been indexed the index is marked ready, in one write to
+//! `@indexes`, and only then is it used by queries. Frozen tables can be indexed, but are always scanned.
+
+use std::{
+    borrow::Borrow,
+    ops::{Bound, Deref},
+    sync::Arc,
+    thread::{self, JoinHandle},
+};
+
+use serde::{Deserialize, Serialize};
+use sled::{Batch, IVec, Tree};
+use sqlparser::{dialect::GenericDialect, parser::Parser};
+
+use crate::{
+    ast::{BinaryOp, ComparisonOp, Projection, SelectQuery, SqlQuery, UnresolvedExpression},
+    data_types::{Type, Value},
+    error::{Error, ExecutionError, Result},
+    interpreter::{resolve_expression, Interpreter},
+    query_process::process_query,
+    replication::Change,
+    resolved_expression::Expression,
+    storage::Columns,
+    table_handler::{TableHandler, TableStorage},
+    typed_expression::TypedExpression,
+    Database,
+};
+
+const INDEX_TREE: &str = "@indexes";
+/// The number of rows indexed while writes are paused.
+const INDEX_BUILD_CHUNK_LEN: usize = 1024;
+
+/// An index of a table, as stored in the `@indexes` tree.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct IndexDefinition {
+    pub name: String,
+    pub table: String,
+    /// The indexed expressions, as SQL.
+    pub keys: Vec<String>,
+    /// The condition of the rows in a partial index, as SQL.
+    pub predicate: Option<String>,
+    pub state: IndexState,
+    key_expressions: Vec<Expression>,
+    predicate_expression: Option<Expression>,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Serialize, Deserialize)]
+pub enum IndexState {
+    /// The index is being filled from the rows of the table, and isn't used by queries yet.
+    Building {
+        rows_indexed: u64,
+    },
+    Ready,
+}
+
+/// An index opened with its table.
+#[derive(Debug, Clone)]
+pub(crate) struct Index {
+    definition: IndexDefinition,
+    tree: Tree,
+    /// The keys and predicate compiled with the types of the table's columns, as they are evaluated for every row
+    /// written to the table.
+    typed_keys: Vec<TypedExpression>,
+    typed_predicate: Option<TypedExpression>,
+}
+
+impl Index {
+    pub fn name(&self) -> &str {
+        &self.definition.name
+    }
+
+    pub fn is_ready(&self) -> bool {
+        self.definition.state == IndexState::Ready
+    }
+
+    pub fn keys(&self) -> &[Expression] {
+        &self.definition.key_expressions
+    }
+
+    pub fn predicate(&self) -> Option<&Expression> {
+        self.definition.predicate_expression.as_ref()
+    }
+
+    pub fn typed_keys(&self) -> &[TypedExpression] {
+        &self.typed_keys
+    }
+
+    pub fn typed_predicate(&self) -> Option<&TypedExpression> {
+        self.typed_predicate.as_ref()
+    }
+
+    pub fn tree(&self) -> &Tree {
+        &self.tree
+    }
+
+    /// Returns the encoded values of the keys of the entries of the rows that can match `predicate`, a query's
+    /// `WHERE` clause on the table `table_name`, if the index can be used. `predicate` must include every condition of
+    /// the index's predicate, and require each key to equal a value of the key's type.
+    pub fn lookup(
+        &self,
+        predicate: &Expression,
+        table_name: &str,
+        columns: &Columns,
+    ) -> Option<Vec<u8>> {
+        let mut conditions = Vec::new();
+        conjuncts(predicate, &mut conditions);
+        if let Some(index_predicate) = self.predicate() {
+            let mut required = Vec::new();
+            conjuncts(index_predicate, &mut required);
+            if !required.iter().all(|required| {
+                conditions
+                    .iter()
+                    .any(|condition| same_expression(condition, required, table_name))
+            }) {
+                return None;
+            }
+        }
+        let values = self
+            .keys()
+            .iter()
+            .map(|key| {
+                let key_type = expression_type(key, columns)?;
+                conditions.iter().find_map(|condition| {
+                    let (left, right) = match condition {
+                        Expression::BinaryOp(
+                            left,
+                            BinaryOp::Comparison(ComparisonOp::Eq),
+                            right,
+                        ) => (left, right),
+                        _ => return None,
+                    };
+                    let (expression, value) = match (left.as_ref(), right.as_ref()) {
+                        (expression, Expression::Value(value))
+                        | (Expression::Value(value), expression) => (expression, value),
+                        _ => return None,
+                    };
+                    // Strings are compared to integers by converting them, so many strings can equal an integer.
+                    match value {
+                        Value::TypedValue(contents)
+                            if contents.get_type() == key_type
+                                && same_expression(expression, key, table_name) =>
+                        {
+                            Some(value)
+                        }
+                        _ => None,
+                    }
+                })
+            })
+            .collect::<Option<Vec<_>>>()?;
+        bincode::serialize(&values).ok()
+    }
+}
+
+/// Collects the conditions of the top-level `AND`s of `expression`.
+fn conjuncts<'a>(expression: &'a Expression, conditions: &mut Vec<&'a Expression>) {
+    match expression {
+        Expression::BinaryOp(left, BinaryOp::And, right) => {
+            conjuncts(left, conditions);
+            conjuncts(right, conditions);
+        }
+        _ => conditions.push(expression),
+    }
+}
+
+/// Returns whether `query`, an expression of a query on the table `table_name`, is the same as `index`, an
+/// expression of an index on the table.
+fn same_expression(query: &Expression, index: &Expression, table_name: &str) -> bool {
+    match (query, index) {
+        (Expression::Value(query), Expression::Value(index)) => query == index,
+        (Expression::Identifier(query), Expression::Identifier(index)) => {
+            query.table_name() == table_name && query.column_name() == index.column_name()
+        }
+        (
+            Expression::BinaryOp(query_left, query_op, query_right),
+            Expression::BinaryOp(index_left, index_op, index_right),
+        ) => {
+            query_op == index_op
+                && same_expression(query_left, index_left, table_name)
+                && same_expression(query_right, index_right, table_name)
+        }
+        _ => false,
+    }
+}
+
+/// Returns the type of every non-null value of `expression`, if it is known before evaluating it.
+fn expression_type(expression: &Expression, columns: &Columns) -> Option<Type> {
+    match expression {
+        Expression::Identifier(column) => columns.get_data_type(column.column_name()),
+        Expression::Value(Value::TypedValue(contents)) => Some(contents.get_type()),
+        Expression::BinaryOp(_, BinaryOp::Mathematical(_), _) => Some(Type::Integer),
+        _ => None,
+    }
+}
+
+/// Returns the name of the sled tree holding an index, which is also its key in the `@indexes` tree. The table name is
+/// prefixed with its length, so that no other table and index name give the same tree name, and so that the names of
+/// a table's indexes all start with `index_tree_name(table, "")`.
+pub fn index_tree_name(table: &str, index: &str) -> String {
+    format!("{}:{}#{}", table.len(), table, index)
+}
+
+/// Returns every index of every table, including those still being built.
+pub(crate) fn indexes(interpreter: &Interpreter) -> Result<Vec<IndexDefinition>> {
+    interpreter
+        .db()
+        .open_tree(INDEX_TREE)?
+        .iter()
+        .values()
+        .map(|definition| Ok(bincode::deserialize(definition?.as_ref())?))
+        .collect()
+}
+
+/// Opens the indexes of `table`, whose columns are `columns`.
+pub(crate) fn table_indexes(
+    interpreter: &Interpreter,
+    table: &str,
+    columns: &Columns,
+) -> Result<Vec<Index>> {
+    let mut indexes = Vec::new();
+    for definition in interpreter
+        .db()
+        .open_tree(INDEX_TREE)?
+        .scan_prefix(index_tree_name(table, ""))
+        .values()
+    {
+        let definition: IndexDefinition = bincode::deserialize(definition?.as_ref())?;
+        let tree = interpreter
+            .db()
+            .open_tree(index_tree_name(table, &definition.name))?;
+        let columns = (columns, table);
+        let typed_keys = definition
+            .key_expressions
+            .iter()
+            .map(|key| TypedExpression::compile(key, &columns))
+            .collect();
+        let typed_predicate = definition
+            .predicate_expression
+            .as_ref()
+            .map(|predicate| TypedExpression::compile(predicate, &columns));
+        indexes.push(Index {
+            definition,
+            tree,
+            typed_keys,
+            typed_predicate,
+        });
+    }
+    Ok(indexes)
+}
+
+/// Returns an error if an index of the table is being built, so that its rows cannot be moved.
+pub(crate) fn check_not_building<C, N>(handler: &TableHandler<C, N>) -> Result<()>
+where
+    C: Borrow<Columns>,
+    N: AsRef<str>,
+{
+    match handler.indexes().iter().find(|index| !index.is_ready()) {
+        Some(index) => Err(ExecutionError::IndexBuilding(index.name().to_owned()).into()),
+        None => Ok(()),
+    }
+}
+
+/// Creates an index called `name` on `keys` of `table`, SQL expressions of its columns, and fills it from the rows of
+/// the table matching `predicate`, or every row if it is `None`. Writes to the table are only paused while each chunk
+/// of rows is indexed.
+pub(crate) fn create_index(
+    interpreter: &Interpreter,
+    table: &str,
+    name: &str,
+    keys: &[&str],
+    predicate: Option<&str>,
+) -> Result<()> {
+    let mut build = start_build(interpreter, table, name, keys, predicate)?;
+    while build_chunk(interpreter, &mut build)? {}
+    Ok(())
+}
+
+/// Creates an index called `name` on `keys` of `table`, SQL expressions of its columns, and fills it from the rows of
+/// the table matching `predicate` on a background thread, returning once the index has been recorded. Queries use the
+/// index once the thread finishes. The thread stops early if the database or the index is dropped. The progress of the
+/// build is reported by `Database::indexes`.
+pub fn create_index_concurrently<D>(
+    database: &Arc<D>,
+    table: &str,
+    name: &str,
+    keys: &[&str],
+    predicate: Option<&str>,
+) -> Result<JoinHandle<Result<()>>>
+where
+    D: Deref<Target = Database> + Send + Sync + 'static,
+{
+    let mut build = start_build(&database.interpreter, table, name, keys, predicate)?;
+    let database = Arc::downgrade(database);
+    Ok(thread::spawn(move || loop {
+        match database.upgrade() {
+            Some(database) => match build_chunk(&database.interpreter, &mut build) {
+                Ok(true) => {}
+                Ok(false) => return Ok(()),
+                Err(error) if is_dropped(&error) => return Ok(()),
+                Err(error) => return Err(error),
+            },
+            None => return Ok(()),
+        }
+    }))
+}
+
+fn is_dropped(error: &Error) -> bool {
+    matches!(
+        error,
+        Error::Execution(ExecutionError::NoIndex(_) | ExecutionError::NoTable(_))
+    )
+}
+
+/// How far the build of an index has got.
+struct IndexBuild {
+    table: String,
+    name: String,
+    /// The position in `TableHandler::trees` of the tree being indexed.
+    tree: usize,
+    /// The key of the last row indexed in the tree.
+    last_key: Option<IVec>,
+    rows_indexed: u64,
+}
+
+fn start_build(
+    interpreter: &Interpreter,
+    table: &str,
+    name: &str,
+    keys: &[&str],
+    predicate: Option<&str>,
+) -> Result<IndexBuild> {
+    if interpreter.replication().is_replica() {
+        return Err(ExecutionError::ReadOnlyReplica.into());
+    }
+    if keys.is_empty() {
+        return Err(ExecutionError::NoIndexColumns(name.to_owned()).into());
+    }
+    let (keys, predicate) = parse_index(keys, predicate)?;
+    let _write = interpreter.lock_writes();
+    let handler = interpreter.open_table(table, None)?;
+    if handler.indexes().iter().any(|index| index.name() == name) {
+        return Err(ExecutionError::IndexExists(name.to_owned()).into());
+    }
+    let columns = (handler.columns(), table);
+    let definition = IndexDefinition {
+        name: name.to_owned(),
+        table: table.to_owned(),
+        keys: keys.iter().map(ToString::to_string).collect(),
+        predicate: predicate.as_ref().map(ToString::to_string),
+        state: IndexState::Building { rows_indexed: 0 },
+        key_expressions: keys
+            .into_iter()
+            .map(|key| resolve_expression(key, &columns))
+            .collect::<Result<_>>()?,
+        predicate_expression: predicate
+            .map(|predicate| resolve_expression(predicate, &columns))
+            .transpose()?,
+    };
+    save_definition(interpreter, &definition)?;
+    interpreter.flush()?;
+    Ok(IndexBuild {
+        table: table.to_owned(),
+        name: name.to_owned(),
+        tree: 0,
+        last_key: None,
+        rows_indexed: 0,
+    })
+}
+
+/// Parses the keys and predicate of an index, written as SQL expressions.
+fn parse_index(
+    keys: &[&str],
+    predicate: Option<&str>,
+) -> Result<(Vec<UnresolvedExpression>, Option<UnresolvedExpression>)> {
+    let mut sql = format!("SELECT {}", keys.join(", "));
+    if let Some(predicate) = predicate {
+        sql.push_str(" WHERE ");
+        sql.push_str(predicate);
+    }
+    let invalid = || ExecutionError::InvalidIndexExpression(sql.clone());
+    let mut statements = Parser::parse_sql(&GenericDialect {}, &sql)?;
+    let select = match (statements.pop(), statements.is_empty()) {
+        (Some(statement), true) => match process_query(statement)? {
+            SqlQuery::SelectQuery(SelectQuery::Select(select)) if select.from.is_none() => select,
+            _ => return Err(invalid().into()),
+        },
+        _ => return Err(invalid().into()),
+    };
+    let keys = select
+        .projections
+        .into_iter()
+        .map(|projection| match projection {
+            Projection::Unaliased(key) => Ok(key),
+            _ => Err(invalid().into()),
+        })
+        .collect::<Result<_>>()?;
+    Ok((keys, select.selection))
+}
+
+/// Indexes the next chunk of rows, marking the index as ready once every row has been indexed. Returns whether
+/// there are rows left to index.
+fn build_chunk(interpreter: &Interpreter, build: &mut IndexBuild) -> Result<bool> {
+    let _writes = interpreter.pause_writes();
+    let handler = interpreter.open_table(build.table.as_str(), None)?;
+    let index = handler
+        .indexes()
+        .iter()
+        .find(|index| index.name() == build.name)
+        .ok_or_else(|| ExecutionError::NoIndex(build.name.clone()))?;
+    let mut entries = Vec::new();
+    let mut done = false;
+    match handler.storage() {
+        // A frozen table cannot be written to, so is indexed all at once.
+        TableStorage::Frozen(_) => {
+            for row in handler.iter() {
+                let (key, value) = row?.into_parts();
+                entries.extend(handler.index_entry(index, &key, &value)?);
+            }
+            done = true;
+        }
+        TableStorage::Tree(_) | TableStorage::Partitioned { .. } => {
+            let trees = handler.trees()?;
+            match trees.get(build.tree) {
+                Some(tree) => {
+                    let start = match build.last_key.take() {
+                        Some(key) => Bound::Excluded(key),
+                        None => Bound::Unbounded,
+                    };
+                    for row in tree
+                        .range::<IVec, _>((start, Bound::Unbounded))
+                        .take(INDEX_BUILD_CHUNK_LEN)
+                    {
+                        let (key, value) = row?;
+                        entries.extend(handler.index_entry(index, &key, &value)?);
+                        build.last_key = Some(key);
+                    }
+                    if build.last_key.is_none() {
+                        build.tree += 1;
+                    }
+                }
+                None => done = true,
+            }
+        }
+    }
+
+    let mut batch = Batch::default();
+    for entry in &entries {
+        batch.insert(entry.as_slice(), &[]);
+    }
+    index.tree().apply_batch(batch)?;
+    interpreter
+        .write_counts()
+        .add(index.tree(), entries.len() as u64);
+    build.rows_indexed += entries.len() as u64;
+    let replication = interpreter.replication();
+    for entry in entries {
+        replication.record(index.tree(), |tree| Change::Insert {
+            tree,
+            key: entry,
+            value: Vec::new(),
+        });
+    }
+    let mut definition = index.definition.clone();
+    definition.state = if done {
+        IndexState::Ready
+    } else {
+        IndexState::Building {
+            rows_indexed: build.rows_indexed,
+        }
+    };
+    save_definition(interpreter, &definition)?;
+    interpreter.flush()?;
+    Ok(!done)
+}
+
+/// Drops the index called `name` on `table`.
+pub(crate) fn drop_index(interpreter: &Interpreter, table: &str, name: &str) -> Result<()> {
+    let replication = interpreter.replication();
+    if replication.is_replica() {
+        return Err(ExecutionError::ReadOnlyReplica.into());
+    }
+    let _write = interpreter.lock_writes();
+    let tree_name = index_tree_name(table, name);
+    let catalog = interpreter.db().open_tree(INDEX_TREE)?;
+    if catalog.remove(tree_name.as_bytes())?.is_none() {
+        return Err(ExecutionError::NoIndex(name.to_owned()).into());
+    }
+    replication.record(&catalog, |tree| Change::Remove {
+        tree,
+        key: tree_name.clone().into_bytes(),
+    });
+    interpreter.db().drop_tree(tree_name.as_bytes())?;
+    replication.record_drop_tree(tree_name.as_bytes());
+    interpreter.flush()
+}
+
+/// Drops the indexes of `table`, when it is dropped.
+pub(crate) fn remove_table(interpreter: &Interpreter, table: &str) -> Result<()> {
+    for definition in indexes(interpreter)? {
+        if definition.table != table {
+            continue;
+        }
+        let tree_name = index_tree_name(table, &definition.name);
+        let catalog = interpreter.db().open_tree(INDEX_TREE)?;
+        catalog.remove(tree_name.as_bytes())?;
+        interpreter
+            .replication()
+            .record(&catalog, |tree| Change::Remove {
+                tree,
+                key: tree_name.clone().into_bytes(),
+            });
+        interpreter.db().drop_tree(tree_name.as_bytes())?;
+        interpreter
+            .replication()
+            .record_drop_tree(tree_name.as_bytes());
+    }
+    Ok(())
+}
+
+fn save_definition(interpreter: &Interpreter, definition: &IndexDefinition) -> Result<()> {
+    let catalog = interpreter.db().open_tree(INDEX_TREE)?;
+    let key = index_tree_name(&definition.table, &definition.name).into_bytes();
+    let value = bincode::serialize(definition)?;
+    catalog.insert(key.as_slice(), value.as_slice())?;
+    interpreter
+        .replication()
+        .record(&catalog, |tree| Change::Insert { tree, key, value });
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{conjuncts, expression_type, index_tree_name, same_expression};
+    use crate::{
+        ast::{BinaryOp, ComparisonOp, MathematicalOp},
+        data_types::Type,
+        resolved_expression::{Expression, ResolvedColumn},
+        storage::Columns,
+    };
+
+    fn column(table: &str, name: &str) -> Expression {
+        Expression::Identifier(ResolvedColumn::new(table.to_owned(), name.to_owned()))
+    }
+
+    fn binary(left: Expression, op: BinaryOp, right: Expression) -> Expression {
+        Expression::BinaryOp(Box::new(left), op, Box::new(right))
+    }
+
+    #[test]
+    fn predicate_implication() {
+        let eq = BinaryOp::Comparison(ComparisonOp::Eq);
+        let open = |table| {
+            binary(
+                column(table, "status"),
+                eq,
+                Expression::Value("open".into()),
+            )
+        };
+        let query = binary(
+            binary(column("t", "priority"), eq, Expression::Value(1.into())),
+            BinaryOp::And,
+            open("t"),
+        );
+        let mut conditions = Vec::new();
+        conjuncts(&query, &mut conditions);
+        assert_eq!(conditions.len(), 2);
+        // Index expressions are resolved with the table's name, and queries with its alias.
+        assert!(same_expression(conditions[1], &open("tickets"), "t"));
+        assert!(!same_expression(conditions[1], &open("tickets"), "tickets"));
+        assert!(!same_expression(conditions[0], &open("tickets"), "t"));
+
+        let mut columns = Columns::new();
+        columns
+            .add_column("status".to_owned(), Type::String)
+            .unwrap();
+        columns
+            .add_column("priority".to_owned(), Type::Integer)
+            .unwrap();
+        let band = binary(
+            column("tickets", "status"),
+            BinaryOp::Mathematical(MathematicalOp::Divide),
+            Expression::Value(10.into()),
+        );
+        assert_eq!(
+            expression_type(&column("tickets", "status"), &columns),
+            Some(Type::String)
+        );
+        assert_eq!(expression_type(&band, &columns), Some(Type::Integer));
+        assert_eq!(expression_type(&open("tickets"), &columns), None);
+    }
+
+    #[test]
+    fn index_tree_names() {
+        assert_ne!(index_tree_name("t", "x#y"), index_tree_name("t#x", "y"));
+        assert!(!index_tree_name("t#x", "y").starts_with(&index_tree_name("t", "")));
+    }
+}
@@ -1,50 +1,482 @@
 use crate::{
     ast::{
-        BinaryOp, Column, CreateTable, Delete, DropTable, Insert, Projection, SelectContents,
-        SelectQuery, SqlQuery, TableName, UnresolvedExpression, Update, Values,
+        AlterTable, AlterTableOperation, BinaryOp, Column, CreateTable, Delete, DropTable, Insert,
+        Projection, SelectContents, SelectQuery, SqlQuery, TableName, UnresolvedExpression, Update,
+        Values,
     },
+    backup::{self, BackupStats},
+    bloom::KeyFilters,
+    bulk_insert::BulkColumn,
     data_types::{Type, Value},
     error::{Error, ExecutionError, Result},
-    foreign_key::ForeignKeys,
+    expiry::{self, ExpirySchedule},
+    foreign_key::{ForeignKeyIndex, ForeignKeys},
+    frozen::FrozenTable,
+    index,
     join_handler::JoinHandler,
+    partition::{
+        hash_partition_key, partition_tree_name, HashPartitioning, Partitioning, RangePartition,
+        RangePartitioning,
+    },
     relation::Relation,
+    replication::{Change, Replication},
     resolved_expression::Expression,
+    schema,
     storage::Columns,
     table_definition::TableDefinition,
-    table_handler::{RowBuilder, TableHandler, TableRowUpdater},
+    table_handler::{
+        RowBatch, RowBuilder, TableHandler, TableIter, TableRow, TableRowUpdater, TableStorage,
+    },
+    typed_expression::{cast_arithmetic, TypedExpression},
+    vacuum::WriteCounts,
     Empty, GetData, TableColumns,
 };
 use once_cell::sync::OnceCell;
 use sled::{Batch, Config, Db};
-use std::{borrow::Borrow, collections::HashMap, path::Path};
+use std::{
+    borrow::Borrow,
+    collections::HashMap,
+    fs,
+    mem::size_of,
+    path::{Path, PathBuf},
+    sync::{Arc, Condvar, Mutex, RwLock, RwLockReadGuard, RwLockWriteGuard},
+    thread::{self, ThreadId},
+};
 
 static FOREIGN_KEY_COLUMNS: OnceCell<Columns> = OnceCell::new();
 
 pub struct Interpreter {
     db: Db,
     foreign_keys: OnceCell<TableHandler<&'static Columns, &'static str>>,
+    replication: Replication,
+    /// Held shared by every statement that modifies the database, and exclusively while a backup is taken.
+    writes: RwLock<()>,
+    /// Held by one statement that modifies the database at a time.
+    serial_writes: WriteSerializer,
+    frozen_directory: PathBuf,
+    /// Frozen tables that have been opened, so that each file is only mapped once.
+    frozen_tables: Mutex<HashMap<String, Arc<FrozenTable>>>,
+    write_counts: WriteCounts,
+    key_filters: KeyFilters,
+    expiry_schedule: ExpirySchedule,
+    foreign_key_index: ForeignKeyIndex,
 }
 
 impl Interpreter {
-    pub fn new<P: AsRef<Path>>(path: P) -> Result<Interpreter> {
-        let db = Config::default().path(path).flush_every_ms(None).open()?;
+    pub fn new<P: AsRef<Path>>(path: P, replication: Replication) -> Result<Interpreter> {
+        let db = Config::default()
+            .path(path.as_ref())
+            .flush_every_ms(None)
+            .open()?;
         Ok(Interpreter {
             db,
             foreign_keys: OnceCell::new(),
+            replication,
+            writes: RwLock::new(()),
+            serial_writes: WriteSerializer::default(),
+            frozen_directory: path.as_ref().join("frozen"),
+            frozen_tables: Mutex::new(HashMap::new()),
+            write_counts: WriteCounts::default(),
+            key_filters: KeyFilters::default(),
+            expiry_schedule: ExpirySchedule::default(),
+            foreign_key_index: ForeignKeyIndex::default(),
         })
     }
 
+    pub(crate) fn replication(&self) -> &Replication {
+        &self.replication
+    }
+
+    pub(crate) fn write_counts(&self) -> &WriteCounts {
+        &self.write_counts
+    }
+
+    pub(crate) fn key_filters(&self) -> &KeyFilters {
+        &self.key_filters
+    }
+
+    pub(crate) fn expiry_schedule(&self) -> &ExpirySchedule {
+        &self.expiry_schedule
+    }
+
+    pub(crate) fn db(&self) -> &Db {
+        &self.db
+    }
+
+    /// Executes the query. Changes are not written to disk until `flush` is called.
     pub fn execute(&self, query: SqlQuery) -> Result<Relation> {
-        let result = match query {
+        if self.replication.is_replica() && !matches!(query, SqlQuery::SelectQuery(_)) {
+            return Err(ExecutionError::ReadOnlyReplica.into());
+        }
+        let _write = match query {
+            SqlQuery::SelectQuery(_) => None,
+            _ => Some(self.lock_writes()),
+        };
+        match query {
             SqlQuery::CreateTable(create_table) => self.execute_create_table(create_table),
             SqlQuery::Insert(insert) => self.execute_insert(insert),
             SqlQuery::SelectQuery(select) => self.execute_select(select),
             SqlQuery::DropTable(drop_table) => self.execute_drop_table(drop_table),
             SqlQuery::Delete(delete) => self.execute_delete(delete),
             SqlQuery::Update(update) => self.execute_update(update),
-        }?;
+            SqlQuery::AlterTable(alter_table) => self.execute_alter_table(alter_table),
+        }
+    }
+
+    /// Executes the query, placing the result in `result` and reusing its buffers where possible.
+    /// Changes are not written to disk until `flush` is called.
+    pub fn execute_into(&self, query: SqlQuery, result: &mut Relation) -> Result<()> {
+        match query {
+            SqlQuery::SelectQuery(select) => self.execute_select_into(select, result)?,
+            query => result.replace(self.execute(query)?),
+        }
+        Ok(())
+    }
+
+    /// Writes all executed changes to disk, appending them to the replication log first if there is one.
+    pub fn flush(&self) -> Result<()> {
+        self.replication.commit(|| self.serial_writes.lock())?;
         self.db.flush()?;
-        Ok(result)
+        Ok(())
+    }
+
+    /// Writes a backup of the whole database to `path`. Statements that modify the database wait until the backup
+    /// is complete, so that it is consistent, while queries continue to run.
+    pub fn backup(&self, path: &Path) -> Result<BackupStats> {
+        let _writes = self.pause_writes();
+        let frozen_tables = self
+            .db
+            .open_tree("@frozen")?
+            .iter()
+            .keys()
+            .map(|name| {
+                let name = String::from_utf8(name?.to_vec())
+                    .map_err(|_| Error::Internal("Frozen table name is not UTF-8".to_owned()))?;
+                let table = self.frozen_table(&name)?;
+                Ok((name, table))
+            })
+            .collect::<Result<Vec<_>>>()?;
+        backup::backup(&self.db, &frozen_tables, path)
+    }
+
+    /// Moves the rows of `table` out of sled into an immutable, memory-mapped file, sorted by key.
+    /// Frozen tables can be queried and dropped, but not modified.
+    pub fn freeze_table(&self, table: &str) -> Result<()> {
+        if self.replication.is_replica() {
+            return Err(ExecutionError::ReadOnlyReplica.into());
+        }
+        let _write = self.lock_writes();
+        let handler = self.open_table(table, None)?;
+        match handler.storage() {
+            TableStorage::Tree(_) => {}
+            TableStorage::Frozen(_) => return Ok(()),
+            TableStorage::Partitioned { .. } => {
+                return Err(ExecutionError::PartitionedTable(table.to_owned()).into())
+            }
+        }
+        fs::create_dir_all(&self.frozen_directory)?;
+        let file_name = frozen_file_name(table);
+        let rows = handler.iter().map(|row| row.map(TableRow::into_parts));
+        FrozenTable::write(&self.frozen_directory.join(&file_name), rows)?;
+        // Freezing only changes how the rows are stored, so it is not recorded for replicas.
+        self.db
+            .open_tree("@frozen")?
+            .insert(table.as_bytes(), file_name.as_bytes())?;
+        self.db.drop_tree(table.as_bytes())?;
+        self.db.flush()?;
+        Ok(())
+    }
+
+    /// Moves the rows of `table` into a sled tree for each partition, chosen by the range holding the value of
+    /// `column`.
+    pub fn partition_by_range(
+        &self,
+        table: &str,
+        column: &str,
+        partitions: Vec<RangePartition>,
+    ) -> Result<()> {
+        self.partition_table(table, column, |column_type| {
+            let partitioning = RangePartitioning::new(column.to_owned(), column_type, partitions)?;
+            Ok(Partitioning::Range(partitioning))
+        })
+    }
+
+    /// Moves the rows of `table` into `num_partitions` sled trees, chosen by the hash of the value of `column`.
+    pub fn partition_by_hash(&self, table: &str, column: &str, num_partitions: u32) -> Result<()> {
+        self.partition_table(table, column, |column_type| {
+            let partitioning =
+                HashPartitioning::new(column.to_owned(), column_type, num_partitions)?;
+            Ok(Partitioning::Hash(partitioning))
+        })
+    }
+
+    fn partition_table<F>(&self, table: &str, column: &str, partitioning: F) -> Result<()>
+    where
+        F: FnOnce(Type) -> Result<Partitioning>,
+    {
+        if self.replication.is_replica() {
+            return Err(ExecutionError::ReadOnlyReplica.into());
+        }
+        let _write = self.lock_writes();
+        let handler = self.open_table(table, None)?;
+        match handler.storage() {
+            TableStorage::Tree(_) => {}
+            TableStorage::Frozen(_) => {
+                return Err(ExecutionError::FrozenTable(table.to_owned()).into())
+            }
+            TableStorage::Partitioned { .. } => {
+                return Err(ExecutionError::PartitionedTable(table.to_owned()).into())
+            }
+        }
+        index::check_not_building(&handler)?;
+        let column_index = handler.column_index(column)?;
+        let column_type = handler
+            .columns()
+            .get_data_type(column)
+            .ok_or_else(|| ExecutionError::NoColumn(column.to_owned()))?;
+        let partitioning = partitioning(column_type)?;
+        let trees = partitioning
+            .partition_names()
+            .iter()
+            .map(|name| self.db.open_tree(partition_tree_name(table, name)))
+            .collect::<sled::Result<Vec<_>>>()?;
+
+        let mut batches = vec![Batch::default(); trees.len()];
+        let mut next_keys = vec![0; trees.len()];
+        let mut rows = Vec::new();
+        let indexes = handler.indexes();
+        let mut index_batches = vec![Batch::default(); indexes.len()];
+        let mut index_changes = Vec::new();
+        for row in handler.iter() {
+            let row = row?;
+            let index = partitioning
+                .find(&handler.get_value(column_index, &row)?)
+                .ok_or_else(|| ExecutionError::RowOutsidePartitions(table.to_owned()))?;
+            let (key, value) = row.into_parts();
+            let key = match partitioning {
+                Partitioning::Range(_) => key.to_vec(),
+                Partitioning::Hash(_) => {
+                    next_keys[index] += 1;
+                    // Keep the schema version that follows the row id.
+                    let mut new_key = hash_partition_key(index, next_keys[index] - 1)
+                        .to_be_bytes()
+                        .to_vec();
+                    new_key.extend_from_slice(&key[size_of::<u64>()..]);
+                    // The index entries of the row refer to its key, so are replaced.
+                    for (position, index) in indexes.iter().enumerate() {
+                        let old_entry = handler.index_entry(index, &key, &value)?;
+                        let new_entry = handler.index_entry(index, &new_key, &value)?;
+                        if let (Some(old_entry), Some(new_entry)) = (old_entry, new_entry) {
+                            index_batches[position].remove(old_entry.as_slice());
+                            index_batches[position].insert(new_entry.as_slice(), &[]);
+                            index_changes.push((position, old_entry, new_entry));
+                        }
+                    }
+                    new_key
+                }
+            };
+            batches[index].insert(key.as_slice(), &*value);
+            rows.push((index, key, value.to_vec()));
+        }
+        for (tree, batch) in trees.iter().zip(batches) {
+            tree.apply_batch(batch)?;
+        }
+        for (index, key, value) in rows {
+            self.replication
+                .record(&trees[index], |tree| Change::Insert { tree, key, value });
+        }
+        for (index, index_batch) in indexes.iter().zip(index_batches) {
+            index.tree().apply_batch(index_batch)?;
+        }
+        for (position, old_entry, new_entry) in index_changes {
+            let tree = indexes[position].tree();
+            self.replication.record(tree, |tree| Change::Remove {
+                tree,
+                key: old_entry,
+            });
+            self.replication.record(tree, |tree| Change::Insert {
+                tree,
+                key: new_entry,
+                value: Vec::new(),
+            });
+        }
+        self.save_partitioning(table, &partitioning)?;
+        self.db.drop_tree(table.as_bytes())?;
+        self.replication.record_drop_tree(table.as_bytes());
+        self.flush()
+    }
+
+    /// Adds a partition to a partitioned table. It must not overlap the existing partitions.
+    pub fn add_partition(&self, table: &str, partition: RangePartition) -> Result<()> {
+        if self.replication.is_replica() {
+            return Err(ExecutionError::ReadOnlyReplica.into());
+        }
+        let _write = self.lock_writes();
+        let handler = self.open_table(table, None)?;
+        index::check_not_building(&handler)?;
+        let mut partitioning = self.range_partitioning(&handler)?;
+        let column_type = handler
+            .columns()
+            .get_data_type(partitioning.column())
+            .ok_or_else(|| ExecutionError::NoColumn(partitioning.column().to_owned()))?;
+        let tree_name = partition_tree_name(table, &partition.name);
+        partitioning.add(partition, column_type)?;
+        self.db.open_tree(tree_name)?;
+        self.save_partitioning(table, &Partitioning::Range(partitioning))?;
+        self.flush()
+    }
+
+    /// Drops a partition of a partitioned table, along with every row in it. Unless rows of the table are referred
+    /// to by a foreign key or the table has indexes, this drops the partition's tree rather than deleting the rows one
+    /// by one.
+    pub fn drop_partition(&self, table: &str, partition: &str) -> Result<()> {
+        if self.replication.is_replica() {
+            return Err(ExecutionError::ReadOnlyReplica.into());
+        }
+        let _write = self.lock_writes();
+        let handler = self.open_table(table, None)?;
+        index::check_not_building(&handler)?;
+        let mut partitioning = self.range_partitioning(&handler)?;
+        partitioning.remove(partition)?;
+        let tree_name = partition_tree_name(table, partition);
+        // Rows referred to by a foreign key, or with index entries, are deleted one by one.
+        if !handler.indexes().is_empty()
+            || self
+                .foreign_keys()?
+                .parent_foreign_keys(table, self)
+                .next()
+                .is_some()
+        {
+            let rows = TableIter::new(self.db.open_tree(&tree_name)?).collect::<Result<_>>()?;
+            handler.delete_rows(rows, self)?;
+        }
+        self.save_partitioning(table, &Partitioning::Range(partitioning))?;
+        self.db.drop_tree(tree_name.as_bytes())?;
+        self.key_filters.remove_table(table);
+        self.replication.record_drop_tree(tree_name.as_bytes());
+        self.flush()
+    }
+
+    fn range_partitioning<N: AsRef<str>>(
+        &self,
+        handler: &TableHandler<Columns, N>,
+    ) -> Result<RangePartitioning> {
+        match handler.storage() {
+            TableStorage::Partitioned {
+                partitioning: Partitioning::Range(partitioning),
+                ..
+            } => Ok(partitioning.clone()),
+            TableStorage::Partitioned { .. } => Err(ExecutionError::NotRangePartitioned(
+                handler.unaliased_table_name().to_owned(),
+            )
+            .into()),
+            TableStorage::Frozen(_) => {
+                Err(ExecutionError::FrozenTable(handler.unaliased_table_name().to_owned()).into())
+            }
+            TableStorage::Tree(_) => Err(ExecutionError::NotPartitioned(
+                handler.unaliased_table_name().to_owned(),
+            )
+            .into()),
+        }
+    }
+
+    fn save_partitioning(&self, table: &str, partitioning: &Partitioning) -> Result<()> {
+        let partitions = self.db.open_tree("@partitions")?;
+        let value = bincode::serialize(partitioning)?;
+        partitions.insert(table.as_bytes(), value.as_slice())?;
+        self.replication.record(&partitions, |tree| Change::Insert {
+            tree,
+            key: table.as_bytes().to_vec(),
+            value,
+        });
+        Ok(())
+    }
+
+    /// Returns the frozen table called `name`, mapping its file if it hasn't been opened yet.
+    fn frozen_table(&self, name: &str) -> Result<Arc<FrozenTable>> {
+        let mut frozen_tables = self.frozen_tables.lock().unwrap_or_else(|e| e.into_inner());
+        if let Some(table) = frozen_tables.get(name) {
+            return Ok(table.clone());
+        }
+        let table = Arc::new(FrozenTable::open(
+            self.frozen_directory.join(frozen_file_name(name)),
+        )?);
+        frozen_tables.insert(name.to_owned(), table.clone());
+        Ok(table)
+    }
+
+    /// Blocks backups and other statements that modify the database until the returned guard is dropped. Queries
+    /// continue to run. A thread that holds the guard may take it again.
+    pub(crate) fn lock_writes(&self) -> WriteGuard {
+        // The shared lock is already held by a thread taking the guard again, and taking it twice could deadlock
+        // with a waiting backup.
+        let writes = match self.serial_writes.is_held() {
+            true => None,
+            false => Some(self.writes.read().unwrap_or_else(|e| e.into_inner())),
+        };
+        WriteGuard {
+            _serial: self.serial_writes.lock(),
+            _writes: writes,
+        }
+    }
+
+    /// Blocks every statement that modifies the database until the returned guard is dropped.
+    pub(crate) fn pause_writes(&self) -> PauseGuard {
+        let writes = self.writes.write().unwrap_or_else(|e| e.into_inner());
+        PauseGuard {
+            _serial: self.serial_writes.lock(),
+            _writes: writes,
+        }
+    }
+
+    /// Inserts `num_rows` rows built from the column arrays in `columns`.
+    /// Table columns missing from `columns` are set to their default values, and each may be given only once.
+    pub fn bulk_insert(&self, table: &str, num_rows: usize, columns: &[BulkColumn]) -> Result<()> {
+        if self.replication.is_replica() {
+            return Err(ExecutionError::ReadOnlyReplica.into());
+        }
+        let _write = self.lock_writes();
+        let table = self.open_table(table, None)?;
+        let indexes = columns
+            .iter()
+            .enumerate()
+            .map(|(position, column)| match column.name {
+                Some(name) => table.column_index(name),
+                None if position < table.num_columns() => Ok(position),
+                None => Err(ExecutionError::WrongNumColumns {
+                    expected: table.num_columns(),
+                    actual: columns.len(),
+                }
+                .into()),
+            })
+            .collect::<Result<Vec<_>>>()?;
+        let mut given = vec![false; table.num_columns()];
+        for &index in &indexes {
+            if std::mem::replace(&mut given[index], true) {
+                let name = table.columns().column_name(index)?;
+                return Err(ExecutionError::DuplicateColumn(name.to_owned()).into());
+            }
+        }
+        let defaults = (0..table.num_columns())
+            .map(|column| table.get_default(column))
+            .collect::<Vec<_>>();
+
+        let mut batch = RowBatch::default();
+        for row in 0..num_rows {
+            let mut values = defaults.clone();
+            for ((position, column), index) in columns.iter().enumerate().zip(&indexes) {
+                values[*index] = column.value(row).ok_or_else(|| {
+                    ExecutionError::InvalidColumnData(
+                        column
+                            .name
+                            .map_or_else(|| position.to_string(), str::to_owned),
+                    )
+                })?;
+            }
+            table.insert_values_batch(values, &mut batch)?;
+        }
+        table.apply_batch(batch, self)?;
+        self.flush()
     }
 
     pub fn open_table<N: AsRef<str>>(
@@ -58,8 +490,40 @@ impl Interpreter {
             .ok_or_else(|| Error::Execution(ExecutionError::NoTable(name.as_ref().to_owned())))?;
         let table_definition: TableDefinition<Columns> =
             bincode::deserialize(columns_bytes.as_ref())?;
-        let tree = self.db.open_tree(name.as_ref().as_bytes())?;
-        Ok(TableHandler::new(tree, table_definition, name, alias))
+        let storage = if self
+            .db
+            .open_tree("@frozen")?
+            .contains_key(name.as_ref().as_bytes())?
+        {
+            TableStorage::Frozen(self.frozen_table(name.as_ref())?)
+        } else if let Some(partitioning) = self
+            .db
+            .open_tree("@partitions")?
+            .get(name.as_ref().as_bytes())?
+        {
+            let partitioning: Partitioning = bincode::deserialize(partitioning.as_ref())?;
+            let column = table_definition.column_index(partitioning.column())?;
+            let trees = partitioning
+                .partition_names()
+                .iter()
+                .map(|partition| {
+                    self.db
+                        .open_tree(partition_tree_name(name.as_ref(), partition))
+                })
+                .collect::<sled::Result<_>>()?;
+            TableStorage::Partitioned {
+                partitioning,
+                column,
+                trees,
+            }
+        } else {
+            TableStorage::Tree(self.db.open_tree(name.as_ref().as_bytes())?)
+        };
+        let schema_versions = schema::schema_versions(self, name.as_ref())?;
+        let indexes = index::table_indexes(self, name.as_ref(), table_definition.columns())?;
+        Ok(TableHandler::new(storage, table_definition, name, alias)
+            .with_schema_versions(schema_versions)
+            .with_indexes(indexes))
     }
 
     pub fn open_internal_table<C: Borrow<Columns>>(
@@ -69,7 +533,12 @@ impl Interpreter {
     ) -> Result<TableHandler<C, &'static str>> {
         let tree = self.db.open_tree(&table_name)?;
         let table_definition = TableDefinition::new_empty(columns);
-        Ok(TableHandler::new(tree, table_definition, table_name, None))
+        Ok(TableHandler::new(
+            TableStorage::Tree(tree),
+            table_definition,
+            table_name,
+            None,
+        ))
     }
 
     pub fn foreign_keys(&self) -> Result<ForeignKeys<&'static Columns, &'static str>> {
@@ -88,7 +557,7 @@ impl Interpreter {
             .foreign_keys
             .get_or_try_init(|| self.open_internal_table("@foreign_keys", columns))?;
 
-        Ok(ForeignKeys::new(handler))
+        Ok(ForeignKeys::new(handler, &self.foreign_key_index))
     }
 
     fn execute_create_table(&self, create_table: CreateTable) -> Result<Relation> {
@@ -188,7 +657,12 @@ impl Interpreter {
         }
 
         let encoded: Vec<u8> = bincode::serialize(&table_definition)?;
-        directory.insert(table_name.clone().into_bytes(), encoded)?;
+        directory.insert(table_name.as_bytes(), encoded.as_slice())?;
+        self.replication.record(&directory, |tree| Change::Insert {
+            tree,
+            key: table_name.clone().into_bytes(),
+            value: encoded,
+        });
         directory.flush()?;
 
         let new_table = self.db.open_tree(table_name.into_bytes())?;
@@ -206,8 +680,7 @@ impl Interpreter {
         let TableName { name, alias } = table;
         let table = self.open_table(name, alias)?;
         let values = self.execute_select(values)?;
-        let mut batch = Batch::default();
-        let mut key = table.generate_next_index()?;
+        let mut batch = RowBatch::default();
         if let Some(specified_columns) = specified_columns {
             if values.num_columns() != specified_columns.len() {
                 return Err(ExecutionError::WrongNumColumns {
@@ -222,7 +695,7 @@ impl Interpreter {
                     new_row.insert(key.as_str(), value)?;
                 }
                 let new_row = new_row.finalise();
-                table.insert_values_batch(new_row, self, &mut batch, &mut key)?;
+                table.insert_values_batch(new_row, &mut batch)?;
             }
         } else {
             if values.num_columns() != table.num_columns() {
@@ -233,15 +706,21 @@ impl Interpreter {
                 .into());
             }
             for row in values.take_rows() {
-                table.insert_values_batch(row, self, &mut batch, &mut key)?
+                table.insert_values_batch(row, &mut batch)?
             }
         }
 
-        table.apply_batch(batch)?;
+        table.apply_batch(batch, self)?;
         Ok(Default::default())
     }
 
     fn execute_select(&self, select: SelectQuery) -> Result<Relation> {
+        let mut result = Relation::default();
+        self.execute_select_into(select, &mut result)?;
+        Ok(result)
+    }
+
+    fn execute_select_into(&self, select: SelectQuery, result: &mut Relation) -> Result<()> {
         match select {
             SelectQuery::Select(select) => {
                 let SelectContents {
@@ -283,14 +762,14 @@ impl Interpreter {
                     }
                 }
 
-                let mut result = self.generate_results(
+                self.generate_results(
+                    result,
                     result_column_names,
                     projection_expressions,
                     join_handler,
                     selection,
                 )?;
-                result.sort(order_by)?;
-                Ok(result)
+                result.sort(order_by)
             }
             SelectQuery::Values(values) => {
                 let Values { rows } = values;
@@ -301,16 +780,15 @@ impl Interpreter {
                     .iter()
                     .map(UnresolvedExpression::to_string)
                     .collect();
-                let mut result = Relation::new(columns);
+                result.reset(columns);
                 for row in rows {
                     let values = row
                         .into_iter()
                         .map(|e| evaluate_expression(&resolve_expression(e, &Empty)?, &Empty))
-                        .collect::<Result<_>>()?;
+                        .collect::<Result<Vec<_>>>()?;
                     result.add_row(values)?
                 }
-
-                Ok(result)
+                Ok(())
             }
         }
     }
@@ -325,10 +803,11 @@ impl Interpreter {
             .map(|p| resolve_expression(p, &table))
             .transpose()?
             .unwrap_or_else(|| Expression::Value(1.into()));
-        for row in table.iter().filter_where(&predicate, &table) {
-            let row = row?;
-            table.delete_row(&row, self)?;
-        }
+        let rows = table
+            .iter_where(Some(&predicate))
+            .filter_where(&predicate, &table)
+            .collect::<Result<Vec<_>>>()?;
+        table.delete_rows(rows, self)?;
         Ok(Relation::default())
     }
 
@@ -341,61 +820,216 @@ impl Interpreter {
         let table = self.open_table(table_name, None)?;
         let mut assignments = assignments
             .into_iter()
-            .map(|(c, e)| Ok((table.column_index(&c)?, resolve_expression(e, &table)?)))
+            .map(|(c, e)| {
+                let expression = resolve_expression(e, &table)?;
+                Ok((
+                    table.column_index(&c)?,
+                    TypedExpression::compile(&expression, &table),
+                ))
+            })
             .collect::<Result<Vec<_>>>()?;
         assignments.sort_unstable_by_key(|(i, _)| *i);
         let filter = filter
             .map(|p| resolve_expression(p, &table))
             .transpose()?
             .unwrap_or_else(|| Expression::Value(1.into()));
-        let mut batch = Batch::default();
-        for row in table.iter().filter_where(&filter, &table) {
+        let mut batch = RowBatch::default();
+        for row in table
+            .iter_where(Some(&filter))
+            .filter_where(&filter, &table)
+        {
             let row = row?;
             let mut new_row = TableRowUpdater::new(&row, &table);
             for (column, new_value_expression) in &assignments {
-                let new_value = evaluate_expression(&new_value_expression, &(&table, &row))?;
+                let new_value = new_value_expression.evaluate(&(&table, &row))?;
                 new_row.add_update(*column, new_value)?;
             }
             let new_row = new_row.finalise()?;
             table.update_row_batch(row, &self, new_row, &mut batch)?;
         }
-        table.apply_batch(batch)?;
+        table.apply_batch(batch, self)?;
         Ok(Relation::default())
     }
 
     fn generate_results(
         &self,
+        result_set: &mut Relation,
         result_column_names: Vec<String>,
         projections: Vec<Expression>,
         table: JoinHandler,
         filter: Option<Expression>,
-    ) -> Result<Relation> {
-        let mut result_set = Relation::new(result_column_names);
+    ) -> Result<()> {
+        result_set.reset(result_column_names);
+        let projections = projections
+            .iter()
+            .map(|projection| TypedExpression::compile(projection, &table))
+            .collect::<Vec<_>>();
+        if let Some(handler) = table.single_table().filter(|t| t.is_partitioned()) {
+            let typed_filter = filter
+                .as_ref()
+                .map(|filter| TypedExpression::compile(filter, handler));
+            let rows = handler.par_filter_map(filter.as_ref(), |row| {
+                let row = &(handler, row);
+                if let Some(filter) = &typed_filter {
+                    if !filter.evaluate(row)?.is_true() {
+                        return Ok(None);
+                    }
+                }
+                projections
+                    .iter()
+                    .map(|projection| projection.evaluate(row))
+                    .collect::<Result<Vec<_>>>()
+                    .map(Some)
+            })?;
+            for row in rows {
+                result_set.add_row(row)?;
+            }
+            return Ok(());
+        }
         let mut iter = table.iter(filter)?;
+        let mut row_values = Vec::with_capacity(projections.len());
         while let Some(row) = iter.get_next()? {
-            let row_values = projections
-                .iter()
-                .map(|e| evaluate_expression(e, &(&table, &row)))
-                .collect::<Result<Vec<_>>>()?;
-            result_set.add_row(row_values)?;
+            for projection in &projections {
+                row_values.push(projection.evaluate(&(&table, &row))?);
+            }
+            result_set.add_row(row_values.drain(..))?;
         }
-        Ok(result_set)
+        Ok(())
+    }
+
+    fn execute_alter_table(&self, alter_table: AlterTable) -> Result<Relation> {
+        match alter_table.operation {
+            AlterTableOperation::AddColumn(column) => {
+                schema::add_column(self, &alter_table.name, column)?
+            }
+        }
+        Ok(Default::default())
     }
 
     fn execute_drop_table(&self, drop_table: DropTable) -> Result<Relation> {
+        let foreign_keys = self.foreign_keys()?;
+        let directory = self.db.open_tree("@tables")?;
+        let partitions = self.db.open_tree("@partitions")?;
+        let frozen = self.db.open_tree("@frozen")?;
         for name in drop_table.names {
-            self.foreign_keys()?.process_drop_table(&name, self)?;
-            let directory = self.db.open_tree("@tables")?;
+            foreign_keys.process_drop_table(&name, self)?;
             if !drop_table.if_exists && !directory.contains_key(name.as_bytes())? {
                 return Err(ExecutionError::NoTable(name).into());
             }
             directory.remove(name.as_bytes())?;
+            self.replication.record(&directory, |tree| Change::Remove {
+                tree,
+                key: name.clone().into_bytes(),
+            });
             self.db.drop_tree(name.as_bytes())?;
+            self.replication.record_drop_tree(name.as_bytes());
+            expiry::remove_table(self, &name)?;
+            schema::remove_table(self, &name)?;
+            index::remove_table(self, &name)?;
+            self.key_filters.remove_table(&name);
+            if let Some(partitioning) = partitions.remove(name.as_bytes())? {
+                self.replication.record(&partitions, |tree| Change::Remove {
+                    tree,
+                    key: name.clone().into_bytes(),
+                });
+                let partitioning: Partitioning = bincode::deserialize(partitioning.as_ref())?;
+                for partition in partitioning.partition_names() {
+                    let tree_name = partition_tree_name(&name, &partition);
+                    self.db.drop_tree(tree_name.as_bytes())?;
+                    self.replication.record_drop_tree(tree_name.as_bytes());
+                }
+            }
+            if frozen.remove(name.as_bytes())?.is_some() {
+                self.frozen_tables
+                    .lock()
+                    .unwrap_or_else(|e| e.into_inner())
+                    .remove(&name);
+                fs::remove_file(self.frozen_directory.join(frozen_file_name(&name)))?;
+            }
         }
         Ok(Default::default())
     }
 }
 
+/// A lock held by one thread at a time, which the thread holding it may take again. Statements that modify the
+/// database hold it, so that each reads and writes the database as it was left by the previous one, and so that their
+/// changes are recorded for replication in the order they are made.
+#[derive(Default)]
+struct WriteSerializer {
+    /// The thread holding the lock, and how many times it has taken it.
+    owner: Mutex<Option<(ThreadId, usize)>>,
+    released: Condvar,
+}
+
+impl WriteSerializer {
+    fn is_held(&self) -> bool {
+        let owner = self.owner.lock().unwrap_or_else(|e| e.into_inner());
+        matches!(*owner, Some((thread, _)) if thread == thread::current().id())
+    }
+
+    fn lock(&self) -> SerialGuard {
+        let this_thread = thread::current().id();
+        let mut owner = self.owner.lock().unwrap_or_else(|e| e.into_inner());
+        loop {
+            match &mut *owner {
+                Some((thread, count)) if *thread == this_thread => {
+                    *count += 1;
+                    break;
+                }
+                Some(_) => owner = self.released.wait(owner).unwrap_or_else(|e| e.into_inner()),
+                None => {
+                    *owner = Some((this_thread, 1));
+                    break;
+                }
+            }
+        }
+        SerialGuard { serializer: self }
+    }
+}
+
+pub(crate) struct SerialGuard<'a> {
+    serializer: &'a WriteSerializer,
+}
+
+impl Drop for SerialGuard<'_> {
+    fn drop(&mut self) {
+        let mut owner = self
+            .serializer
+            .owner
+            .lock()
+            .unwrap_or_else(|e| e.into_inner());
+        if let Some((_, count)) = &mut *owner {
+            *count -= 1;
+            if *count == 0 {
+                *owner = None;
+                self.serializer.released.notify_one();
+            }
+        }
+    }
+}
+
+/// Held by a statement that modifies the database.
+pub(crate) struct WriteGuard<'a> {
+    _serial: SerialGuard<'a>,
+    _writes: Option<RwLockReadGuard<'a, ()>>,
+}
+
+/// Held while every statement that modifies the database is paused.
+pub(crate) struct PauseGuard<'a> {
+    _serial: SerialGuard<'a>,
+    _writes: RwLockWriteGuard<'a, ()>,
+}
+
+/// Returns the name of the file storing a frozen table, hex encoding the table name so that any name is valid.
+fn frozen_file_name(table: &str) -> String {
+    let mut file_name = table
+        .bytes()
+        .map(|byte| format!("{:02x}", byte))
+        .collect::<String>();
+    file_name.push_str(".frozen");
+    file_name
+}
+
 pub(crate) fn resolve_expression(
     expression: UnresolvedExpression,
     table: &impl TableColumns,
@@ -428,26 +1062,47 @@ where
                     let comparison_result = left.compare(&right);
                     Ok(comparison_result.get_value(c))
                 }
-                BinaryOp::Mathematical(m) => {
-                    if left.is_null() || right.is_null() {
-                        return Ok(Value::Null);
-                    }
-                    let left = left.cast(&Type::Integer).assume_integer()?;
-                    let right = right.cast(&Type::Integer).assume_integer()?;
-                    let result = match m {
-                        crate::ast::MathematicalOp::Add => (left + right).into(),
-                        crate::ast::MathematicalOp::Subtract => (left - right).into(),
-                        crate::ast::MathematicalOp::Multiply => (left * right).into(),
-                        crate::ast::MathematicalOp::Divide => {
-                            left.checked_div(right).map_or(Value::Null, Value::from)
-                        }
-                        crate::ast::MathematicalOp::Modulus => {
-                            left.checked_rem(right).map_or(Value::Null, Value::from)
-                        }
-                    };
-                    Ok(result)
-                }
+                BinaryOp::Mathematical(m) => cast_arithmetic(left, m, right),
             }
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use std::{
+        sync::{
+            atomic::{AtomicUsize, Ordering},
+            Arc,
+        },
+        thread,
+    };
+
+    use super::WriteSerializer;
+
+    #[test]
+    fn write_serializer() {
+        let serializer = Arc::new(WriteSerializer::default());
+        let counter = Arc::new(AtomicUsize::new(0));
+        let threads = (0..4)
+            .map(|_| {
+                let (serializer, counter) = (serializer.clone(), counter.clone());
+                thread::spawn(move || {
+                    for _ in 0..1000 {
+                        let _outer = serializer.lock();
+                        let _inner = serializer.lock();
+                        assert!(serializer.is_held());
+                        // Only the thread holding the lock reads and writes the counter.
+                        let value = counter.load(Ordering::Relaxed);
+                        counter.store(value + 1, Ordering::Relaxed);
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+        for thread in threads {
+            thread.join().unwrap();
+        }
+        assert_eq!(counter.load(Ordering::Relaxed), 4000);
+        assert!(!serializer.is_held());
+    }
+}
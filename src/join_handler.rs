@@ -4,12 +4,13 @@ use auto_enums::auto_enum;
 
 use crate::{
     ast::{BinaryOp, ColumnName, ComparisonOp, JoinConstraint, JoinOperator, TableJoins},
-    data_types::Value,
+    data_types::{Type, Value},
     error::{Error, ExecutionError, Result},
-    interpreter::{evaluate_expression, resolve_expression, Interpreter},
+    interpreter::{resolve_expression, Interpreter},
     resolved_expression::{Expression, ResolvedColumn},
     storage::Columns,
     table_handler::{TableHandler, TableIter, TableRow},
+    typed_expression::TypedExpression,
     GetData, TableColumns,
 };
 
@@ -44,6 +45,14 @@ impl JoinHandler {
         }
     }
 
+    /// Returns the table being read, if there is only one.
+    pub fn single_table(&self) -> Option<&TableHandler<Columns, String>> {
+        match self {
+            JoinHandler::Join(Join::Table(table)) => Some(table),
+            _ => None,
+        }
+    }
+
     pub fn iter(&self, filter: Option<Expression>) -> Result<JoinHandlerIter> {
         Ok(match self {
             JoinHandler::Join(join) => JoinHandlerIter::Iter(join.iter(filter)?),
@@ -59,6 +68,13 @@ impl TableColumns for JoinHandler {
             Self::Empty => Err(ExecutionError::NoColumn(name.to_string()).into()),
         }
     }
+
+    fn column_type(&self, column: &ResolvedColumn) -> Option<Type> {
+        match self {
+            Self::Join(join) => join.column_type(column),
+            Self::Empty => None,
+        }
+    }
 }
 
 pub enum JoinHandlerIter<'a> {
@@ -87,7 +103,8 @@ pub enum Join {
     Join {
         left: Box<Join>,
         right: Box<Join>,
-        constraint: Option<Expression>,
+        /// The join's constraint, compiled once as it is evaluated for every pair of rows.
+        constraint: Option<TypedExpression>,
         join_operator: JoinOperator,
         exclude_columns: HashSet<ResolvedColumn>,
     },
@@ -111,6 +128,19 @@ impl TableColumns for Join {
             }
         }
     }
+
+    fn column_type(&self, column: &ResolvedColumn) -> Option<Type> {
+        match self {
+            Join::Table(table) => table.column_type(column),
+            Join::Join { left, right, .. } => {
+                if left.has_table(column.table_name()) {
+                    left.column_type(column)
+                } else {
+                    right.column_type(column)
+                }
+            }
+        }
+    }
 }
 
 impl Join {
@@ -203,6 +233,9 @@ impl Join {
                     }
                     JoinConstraint::None => (None, HashSet::new()),
                 };
+                let constraint = constraint.map(|constraint| {
+                    TypedExpression::compile(&constraint, &(left.as_ref(), right.as_ref()))
+                });
                 Self::Join {
                     left,
                     right,
@@ -292,15 +325,19 @@ impl Join {
         }
     }
 
+    /// Iterates over the joined rows matching `filter`. The filter is still used to plan which partitions and index
+    /// entries are read, and is compiled once to be evaluated for each joined row.
     pub fn iter(&self, filter: Option<Expression>) -> Result<JoinIter<'_>> {
-        let inner = self.iter_inner()?;
+        let inner = self.iter_inner(filter.as_ref())?;
         let len = self.num_tables();
+        let filter = filter.map(|filter| TypedExpression::compile(&filter, self));
         Ok(JoinIter::new(inner, len, filter))
     }
 
-    fn iter_inner(&self) -> Result<JoinIterInner<'_>> {
+    /// Creates the iterators for each table. Partitions of the tables that cannot match `filter` are skipped.
+    fn iter_inner(&self, filter: Option<&Expression>) -> Result<JoinIterInner<'_>> {
         Ok(match self {
-            Join::Table(table) => JoinIterInner::Table(table.iter(), table),
+            Join::Table(table) => JoinIterInner::Table(table.iter_where(filter), table),
             Join::Join {
                 left,
                 right,
@@ -309,8 +346,8 @@ impl Join {
                 ..
             } => {
                 let left_len = left.num_tables();
-                let left = Box::new(left.iter_inner()?);
-                let right = Box::new(right.iter_inner()?);
+                let left = Box::new(left.iter_inner(filter)?);
+                let right = Box::new(right.iter_inner(filter)?);
                 let constraint = constraint
                     .as_ref()
                     .ok_or(ExecutionError::NoConstraintOnJoin);
@@ -353,16 +390,16 @@ enum JoinIterInner<'a> {
 
 enum JoinType<'a> {
     Inner {
-        constraint: Option<&'a Expression>,
+        constraint: Option<&'a TypedExpression>,
         initialise: bool,
     },
     Left {
-        constraint: &'a Expression,
+        constraint: &'a TypedExpression,
         advance_left: bool,
         right_has_yielded: bool,
     },
     Right {
-        constraint: &'a Expression,
+        constraint: &'a TypedExpression,
         advance_right: bool,
         left_has_yielded: bool,
     },
@@ -371,12 +408,12 @@ enum JoinType<'a> {
 pub struct JoinIter<'a> {
     inner: JoinIterInner<'a>,
     buffer: Vec<TableRow>,
-    filter: Option<Expression>,
+    filter: Option<TypedExpression>,
     finished: bool,
 }
 
 impl<'a> JoinIter<'a> {
-    fn new(inner: JoinIterInner<'a>, len: usize, filter: Option<Expression>) -> Self {
+    fn new(inner: JoinIterInner<'a>, len: usize, filter: Option<TypedExpression>) -> Self {
         Self {
             inner,
             buffer: vec![Default::default(); len],
@@ -400,7 +437,10 @@ impl<'a> JoinIter<'a> {
     pub fn get_next(&mut self) -> Result<Option<RowValue<'_>>> {
         while self.advance()? {
             if let Some(filter) = &self.filter {
-                if evaluate_expression(filter, &(&self.inner, self.buffer.as_slice()))?.is_true() {
+                if filter
+                    .evaluate(&(&self.inner, self.buffer.as_slice()))?
+                    .is_true()
+                {
                     return Ok(Some(RowValue::new(self.buffer.as_slice())));
                 }
             } else {
@@ -414,14 +454,14 @@ impl<'a> JoinIter<'a> {
 impl<'a> JoinIterInner<'a> {
     fn advance(&mut self, buffer: &mut [TableRow]) -> Result<bool> {
         match self {
-            JoinIterInner::Table(iter, handler) => {
+            JoinIterInner::Table(iter, _) => {
                 assert!(buffer.len() == 1);
                 Ok(if let Some(next) = iter.get_next()? {
                     buffer[0] = next;
                     true
                 } else {
                     buffer[0] = TableRow::default();
-                    *iter = handler.iter();
+                    iter.restart();
                     false
                 })
             }
@@ -451,11 +491,9 @@ impl<'a> JoinIterInner<'a> {
                         }
                         *initialise = false;
                         if let Some(constraint) = constraint {
-                            if evaluate_expression(
-                                constraint,
-                                &(left.as_ref(), right.as_ref(), &*buffer),
-                            )?
-                            .is_true()
+                            if constraint
+                                .evaluate(&(left.as_ref(), right.as_ref(), &*buffer))?
+                                .is_true()
                             {
                                 return Ok(true);
                             }
@@ -482,21 +520,17 @@ impl<'a> JoinIterInner<'a> {
                                     return Ok(false);
                                 }
                             }
-                            if evaluate_expression(
-                                constraint,
-                                &(left.as_ref(), right.as_ref(), &*buffer),
-                            )?
-                            .is_true()
+                            if constraint
+                                .evaluate(&(left.as_ref(), right.as_ref(), &*buffer))?
+                                .is_true()
                             {
                                 *right_has_yielded = true;
                                 return Ok(true);
                             }
                         } else if right.advance(right_buffer)? {
-                            if evaluate_expression(
-                                constraint,
-                                &(left.as_ref(), right.as_ref(), &*buffer),
-                            )?
-                            .is_true()
+                            if constraint
+                                .evaluate(&(left.as_ref(), right.as_ref(), &*buffer))?
+                                .is_true()
                             {
                                 *right_has_yielded = true;
                                 return Ok(true);
@@ -525,21 +559,17 @@ impl<'a> JoinIterInner<'a> {
                                     return Ok(false);
                                 }
                             }
-                            if evaluate_expression(
-                                constraint,
-                                &(left.as_ref(), right.as_ref(), &*buffer),
-                            )?
-                            .is_true()
+                            if constraint
+                                .evaluate(&(left.as_ref(), right.as_ref(), &*buffer))?
+                                .is_true()
                             {
                                 *left_has_yielded = true;
                                 return Ok(true);
                             }
                         } else if left.advance(left_buffer)? {
-                            if evaluate_expression(
-                                constraint,
-                                &(left.as_ref(), right.as_ref(), &*buffer),
-                            )?
-                            .is_true()
+                            if constraint
+                                .evaluate(&(left.as_ref(), right.as_ref(), &*buffer))?
+                                .is_true()
                             {
                                 *left_has_yielded = true;
                                 return Ok(true);
@@ -556,9 +586,9 @@ impl<'a> JoinIterInner<'a> {
 
     fn reset(&mut self, buffer: &mut [TableRow]) {
         match self {
-            JoinIterInner::Table(iter, handler) => {
+            JoinIterInner::Table(iter, _) => {
                 assert!(buffer.len() == 1);
-                *iter = handler.iter();
+                iter.restart();
                 buffer[0] = TableRow::default();
             }
             JoinIterInner::Join {
@@ -708,4 +738,13 @@ impl TableColumns for (&Join, &Join) {
             (Err(e), Err(_)) => Err(e),
         }
     }
+
+    fn column_type(&self, column: &ResolvedColumn) -> Option<Type> {
+        let (left, right) = self;
+        if left.has_table(column.table_name()) {
+            left.column_type(column)
+        } else {
+            right.column_type(column)
+        }
+    }
 }
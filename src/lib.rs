@@ -1,31 +1,50 @@
 use std::path::Path;
 
 use ast::ColumnName;
+use backup::BackupStats;
+use bulk_insert::BulkColumn;
 pub use c_interface::*;
-use data_types::Value;
+use data_types::{Type, Value};
 use error::{ExecutionError, Result};
+use index::IndexDefinition;
 use interpreter::Interpreter;
+use partition::RangePartition;
 use query_process::process_query;
 use relation::Relation;
+use replication::{ChangeLog, Replication, ReplicationStatus};
 use resolved_expression::ResolvedColumn;
 use sqlparser::{dialect::GenericDialect, parser::Parser};
+use vacuum::StorageMetrics;
 
 mod ast;
+pub mod backup;
+mod bloom;
+pub mod bulk_insert;
 mod data_types;
 pub mod error;
+pub mod expiry;
+pub mod frozen;
+pub mod index;
 mod interpreter;
 mod join_handler;
+pub mod partition;
 mod query_process;
 mod resolved_expression;
+mod schema;
+pub mod server;
 mod storage;
 mod table_definition;
 mod table_handler;
 pub mod temporary_database;
+mod typed_expression;
+pub mod vacuum;
 #[macro_use]
 mod utils;
+pub mod arrow;
 mod c_interface;
 mod foreign_key;
 pub mod relation;
+pub mod replication;
 #[cfg(test)]
 pub mod tests;
 
@@ -38,21 +57,244 @@ impl Database {
     /// Open a database connection to a new or existing database.
     pub fn open<P: AsRef<Path>>(path: P) -> Result<Self> {
         Ok(Self {
-            interpreter: Interpreter::new(path)?,
+            interpreter: Interpreter::new(path, Replication::None)?,
         })
     }
 
+    /// Open a database connection as a replication primary. Every change is appended to the log in `log_directory`
+    /// when it is flushed, to be applied by replicas opened with `open_replica`.
+    pub fn open_primary<P: AsRef<Path>, L: AsRef<Path>>(path: P, log_directory: L) -> Result<Self> {
+        let log = ChangeLog::open(log_directory)?;
+        Ok(Self {
+            interpreter: Interpreter::new(path, Replication::Primary(log))?,
+        })
+    }
+
+    /// Open a read-only replica of the primary logging to `log_directory`. Queries that modify the database fail.
+    /// Changes from the primary are applied by `poll_replication`, or in the background by `replication::follow`.
+    pub fn open_replica<P: AsRef<Path>, L: AsRef<Path>>(path: P, log_directory: L) -> Result<Self> {
+        let database = Self {
+            interpreter: Interpreter::new(
+                path,
+                Replication::Replica(log_directory.as_ref().to_owned()),
+            )?,
+        };
+        database.poll_replication()?;
+        Ok(database)
+    }
+
+    /// Apply the changes the primary has logged since the last poll. Returns the number of commits applied.
+    /// Does nothing if the database is not a replica.
+    pub fn poll_replication(&self) -> Result<usize> {
+        match self.interpreter.replication() {
+            Replication::Replica(directory) => {
+                let _write = self.interpreter.lock_writes();
+                replication::apply_log(self.interpreter.db(), directory)
+            }
+            _ => Ok(0),
+        }
+    }
+
+    /// Report how far the replica is behind the primary, or `None` if the database is not a replica.
+    pub fn replication_status(&self) -> Result<Option<ReplicationStatus>> {
+        match self.interpreter.replication() {
+            Replication::Replica(directory) => {
+                replication::status(self.interpreter.db(), directory).map(Some)
+            }
+            _ => Ok(None),
+        }
+    }
+
+    /// Write a consistent backup of the whole database to the file at `path`, while the database stays online.
+    /// Queries continue to run during the backup, but statements that modify the database wait for it to finish.
+    pub fn backup_to<P: AsRef<Path>>(&self, path: P) -> Result<BackupStats> {
+        self.interpreter.backup(path.as_ref())
+    }
+
+    /// Restore the backup at `backup_path` into a new database at `path`, and open it.
+    /// `path` must not exist, or must be an empty directory.
+    pub fn restore_from<B: AsRef<Path>, P: AsRef<Path>>(
+        backup_path: B,
+        path: P,
+    ) -> Result<(Self, BackupStats)> {
+        let path = path.as_ref();
+        if path.exists() && path.read_dir()?.next().is_some() {
+            return Err(std::io::Error::new(
+                std::io::ErrorKind::AlreadyExists,
+                format!("cannot restore into non-empty path `{}`", path.display()),
+            )
+            .into());
+        }
+        let database = Self::open(path)?;
+        let stats = backup::restore(database.interpreter.db(), backup_path.as_ref())?;
+        Ok((database, stats))
+    }
+
+    /// Freeze `table` into an immutable, memory-mapped file sorted by key, removing its rows from sled.
+    /// A frozen table is read without copying its rows, and opening it doesn't depend on its size, so freezing
+    /// large tables that never change makes the database faster to open. Frozen tables cannot be modified,
+    /// but can be dropped.
+    pub fn freeze_table(&self, table: &str) -> Result<()> {
+        self.interpreter.freeze_table(table)
+    }
+
+    /// Partition `table` by ranges of values of `column`, moving its rows into a sled tree for each partition.
+    /// Queries skip the partitions that their `WHERE` clause cannot match, and old rows can be removed cheaply with
+    /// `drop_partition`. Inserting a row that doesn't belong to any partition fails.
+    pub fn partition_by_range(
+        &self,
+        table: &str,
+        column: &str,
+        partitions: Vec<RangePartition>,
+    ) -> Result<()> {
+        self.interpreter
+            .partition_by_range(table, column, partitions)
+    }
+
+    /// Partition `table` into `num_partitions` partitions by the hash of `column`, moving its rows into a sled tree
+    /// for each partition. Each partition has its own sequence of row keys, so inserts of rows in different
+    /// partitions don't contend on one tree, and queries reading only this table scan the partitions in parallel.
+    pub fn partition_by_hash(&self, table: &str, column: &str, num_partitions: u32) -> Result<()> {
+        self.interpreter
+            .partition_by_hash(table, column, num_partitions)
+    }
+
+    /// Add a partition to a table partitioned by `partition_by_range`.
+    pub fn add_partition(&self, table: &str, partition: RangePartition) -> Result<()> {
+        self.interpreter.add_partition(table, partition)
+    }
+
+    /// Drop a partition of a table partitioned by `partition_by_range`, and every row in it.
+    pub fn drop_partition(&self, table: &str, partition: &str) -> Result<()> {
+        self.interpreter.drop_partition(table, partition)
+    }
+
+    /// Make the rows of `table` expire at the time held in `column`, in seconds since the Unix epoch, or stop them
+    /// expiring if `column` is `None`. Expired rows are deleted by `reap_expired_rows`, or in the background by
+    /// `expiry::reap`.
+    pub fn set_expiry_column(&self, table: &str, column: Option<&str>) -> Result<()> {
+        expiry::set_expiry_column(&self.interpreter, table, column)
+    }
+
+    /// Delete up to `max_rows` expired rows, in batches. Returns the number of rows deleted.
+    pub fn reap_expired_rows(&self, max_rows: usize) -> Result<usize> {
+        expiry::reap_expired_rows(&self.interpreter, max_rows)
+    }
+
+    /// Rewrite every row of `table`, or of every table if it is `None`, so that the space left by deleted and
+    /// overwritten rows can be freed. Statements that modify the database wait while each batch of rows is
+    /// rewritten, but queries continue to run.
+    pub fn vacuum(&self, table: Option<&str>) -> Result<()> {
+        vacuum::vacuum(&self.interpreter, table)
+    }
+
+    /// Enable or disable the in-memory Bloom filters that let inserts and updates skip scanning a table to check its
+    /// unique constraints and foreign keys. They are enabled by default; disabling them frees their memory.
+    pub fn set_key_filters(&self, enabled: bool) {
+        self.interpreter.key_filters().set_enabled(enabled);
+    }
+
+    /// Vacuum the tables with at least `threshold` writes per row since they were last vacuumed, returning the number
+    /// of tables vacuumed. Called in the background by `vacuum::maintain`.
+    pub fn vacuum_fragmented(&self, threshold: f64) -> Result<usize> {
+        vacuum::vacuum_fragmented(&self.interpreter, threshold)
+    }
+
+    /// Take a snapshot of the size of the database and the trees storing its tables.
+    pub fn storage_metrics(&self) -> Result<StorageMetrics> {
+        vacuum::storage_metrics(&self.interpreter)
+    }
+
+    /// Create an index called `name` on `keys` of `table`, which are columns or SQL expressions of its columns.
+    /// Queries with an equality on every key of the index read only the matching rows. Writes to the table are paused
+    /// only while each chunk of its rows is indexed; use `index::create_index_concurrently` to build the index in the
+    /// background.
+    pub fn create_index(&self, table: &str, name: &str, keys: &[&str]) -> Result<()> {
+        index::create_index(&self.interpreter, table, name, keys, None)
+    }
+
+    /// Create an index like `create_index` holding only the rows matching `predicate`, a SQL condition. It is used
+    /// by queries whose `WHERE` clause includes every condition `AND`ed together in `predicate`.
+    pub fn create_partial_index(
+        &self,
+        table: &str,
+        name: &str,
+        keys: &[&str],
+        predicate: &str,
+    ) -> Result<()> {
+        index::create_index(&self.interpreter, table, name, keys, Some(predicate))
+    }
+
+    /// Drop the index called `name` on `table`.
+    pub fn drop_index(&self, table: &str, name: &str) -> Result<()> {
+        index::drop_index(&self.interpreter, table, name)
+    }
+
+    /// List every index, with the progress of those still being built.
+    pub fn indexes(&self) -> Result<Vec<IndexDefinition>> {
+        index::indexes(&self.interpreter)
+    }
+
     /// Execute a query on the database. A relation is returned for each semicolon separated query executed.
+    /// Changes are flushed to disk once, after the last query.
     pub fn execute_query(&self, sql: &str) -> Result<Vec<Relation>> {
+        let results = self.execute_unflushed(sql);
+        self.interpreter.flush()?;
+        results
+    }
+
+    /// Execute several independent queries, flushing changes to disk once after the last, as a group commit.
+    /// The result of each query is returned in order. A failing query doesn't stop later queries from executing.
+    pub fn execute_queries<'a, I>(&self, queries: I) -> Result<Vec<Result<Vec<Relation>>>>
+    where
+        I: IntoIterator<Item = &'a str>,
+    {
+        let results = queries
+            .into_iter()
+            .map(|sql| self.execute_unflushed(sql))
+            .collect();
+        self.interpreter.flush()?;
+        Ok(results)
+    }
+
+    fn execute_unflushed(&self, sql: &str) -> Result<Vec<Relation>> {
         let dialect = GenericDialect {};
         let statements = Parser::parse_sql(&dialect, &sql)?;
         let mut results = Vec::with_capacity(statements.len());
         for statement in statements {
             let processed_query = process_query(statement)?;
-            results.push(self.interpreter.execute(processed_query)?)
+            results.push(self.interpreter.execute(processed_query)?);
         }
         Ok(results)
     }
+
+    /// Execute a query on the database, placing the result of the last semicolon separated query in `result`.
+    /// The buffers of `result` are reused, so repeatedly executing queries into the same `Relation` avoids reallocating.
+    /// Returns the number of queries executed.
+    pub fn execute_query_into(&self, sql: &str, result: &mut Relation) -> Result<usize> {
+        let dialect = GenericDialect {};
+        let statements = Parser::parse_sql(&dialect, &sql)?;
+        let num_statements = statements.len();
+        let executed = statements
+            .into_iter()
+            .enumerate()
+            .try_for_each(|(index, statement)| {
+                let processed_query = process_query(statement)?;
+                if index + 1 == num_statements {
+                    self.interpreter.execute_into(processed_query, result)
+                } else {
+                    self.interpreter.execute(processed_query).map(|_| ())
+                }
+            });
+        self.interpreter.flush()?;
+        executed.map(|_| num_statements)
+    }
+
+    /// Insert `num_rows` rows into `table`, taking the values from column arrays rather than parsing SQL.
+    /// Constraints are checked as for `INSERT`, and the rows are written as a single batch.
+    pub fn bulk_insert(&self, table: &str, num_rows: usize, columns: &[BulkColumn]) -> Result<()> {
+        self.interpreter.bulk_insert(table, num_rows, columns)
+    }
 }
 
 /// Used to retrieve a data value from a view of a row.
@@ -72,6 +314,11 @@ impl GetData for Empty {
 /// Represents a view of a list of columns. Used to resolve column names.
 pub(crate) trait TableColumns {
     fn resolve_name(&self, name: ColumnName) -> Result<ResolvedColumn>;
+
+    /// Returns the type of a resolved column, or `None` if it isn't known.
+    fn column_type(&self, _column: &ResolvedColumn) -> Option<Type> {
+        None
+    }
 }
 
 impl TableColumns for Empty {
@@ -0,0 +1,519 @@
+//! Range and hash partitioning of tables.
+//!
+//! The rows of a partitioned table are split between several sled trees by the value of a single column. With range
+//! partitioning, each partition holds the values from its lower bound, inclusive, to its upper bound, exclusive, and
+//! partitions never overlap. A whole range partition can be dropped without deleting its rows one by one. With hash
+//! partitioning, rows are spread between a fixed number of partitions by the hash of the value, so that writes and
+//! scans of a large table are split between trees.
+//!
+//! Queries only scan the partitions that their `WHERE` clause could match.
+
+use serde::{Deserialize, Serialize};
+
+use crate::{
+    ast::{BinaryOp, ComparisonOp},
+    data_types::{Comparison, IntegerStorage, Type, Value},
+    error::{ExecutionError, Result},
+    resolved_expression::{Expression, ResolvedColumn},
+};
+
+/// The largest number of partitions of a hash partitioned table.
+pub const MAX_HASH_PARTITIONS: u32 = 1 << (64 - HASH_PARTITION_KEY_BITS);
+/// The number of bits of a row key of a hash partitioned table that hold the row's position in its partition. The
+/// rest hold the index of the partition, so each partition has its own sequence of keys.
+const HASH_PARTITION_KEY_BITS: u32 = 48;
+
+/// Returns the key of the row at position `sequence` in the hash partition at `index`.
+pub(crate) fn hash_partition_key(index: usize, sequence: u64) -> u64 {
+    ((index as u64) << HASH_PARTITION_KEY_BITS) | sequence
+}
+
+/// How the rows of a table are split between partitions. Stored in the `@partitions` tree.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub enum Partitioning {
+    Range(RangePartitioning),
+    Hash(HashPartitioning),
+}
+
+impl Partitioning {
+    pub fn column(&self) -> &str {
+        match self {
+            Partitioning::Range(range) => range.column(),
+            Partitioning::Hash(hash) => hash.column(),
+        }
+    }
+
+    /// Returns the names of the partitions, in the order of their trees.
+    pub fn partition_names(&self) -> Vec<String> {
+        match self {
+            Partitioning::Range(range) => range.partitions.iter().map(|p| p.name.clone()).collect(),
+            Partitioning::Hash(hash) => (0..hash.num_partitions).map(|i| i.to_string()).collect(),
+        }
+    }
+
+    /// Returns the index of the partition holding `value`, if there is one.
+    pub fn find(&self, value: &Value) -> Option<usize> {
+        match self {
+            Partitioning::Range(range) => range.find(value),
+            Partitioning::Hash(hash) => Some(hash.find(value)),
+        }
+    }
+
+    /// Returns whether each partition could hold rows matching `predicate`. Only comparisons between the partition
+    /// column and a value, joined by `AND`, are used to rule partitions out.
+    pub fn prune(&self, predicate: &Expression, table_name: &str) -> Vec<bool> {
+        let mut comparisons = Vec::new();
+        column_comparisons(predicate, self.column(), table_name, &mut comparisons);
+        match self {
+            Partitioning::Range(range) => range.prune(&comparisons),
+            Partitioning::Hash(hash) => hash.prune(&comparisons),
+        }
+    }
+}
+
+/// A bound of a `RangePartition`.
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub enum PartitionBound {
+    Integer(IntegerStorage),
+    String(String),
+}
+
+impl PartitionBound {
+    fn get_type(&self) -> Type {
+        match self {
+            PartitionBound::Integer(_) => Type::Integer,
+            PartitionBound::String(_) => Type::String,
+        }
+    }
+}
+
+impl From<&PartitionBound> for Value {
+    fn from(bound: &PartitionBound) -> Self {
+        match bound {
+            PartitionBound::Integer(i) => (*i).into(),
+            PartitionBound::String(s) => s.as_str().into(),
+        }
+    }
+}
+
+/// A partition holding the rows with values from `lower`, inclusive, to `upper`, exclusive.
+/// A missing bound means the partition is unbounded in that direction.
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub struct RangePartition {
+    pub name: String,
+    pub lower: Option<PartitionBound>,
+    pub upper: Option<PartitionBound>,
+}
+
+impl RangePartition {
+    /// Creates a partition holding the values from `lower`, inclusive, to `upper`, exclusive.
+    pub fn new<N: Into<String>>(
+        name: N,
+        lower: Option<PartitionBound>,
+        upper: Option<PartitionBound>,
+    ) -> Self {
+        Self {
+            name: name.into(),
+            lower,
+            upper,
+        }
+    }
+
+    fn contains(&self, value: &Value) -> bool {
+        self.lower
+            .as_ref()
+            .map_or(true, |lower| !is_less(value, &lower.into()))
+            && self
+                .upper
+                .as_ref()
+                .map_or(true, |upper| is_less(value, &upper.into()))
+    }
+
+    /// Returns whether a value in the partition could satisfy `value op bound`.
+    fn could_match(&self, op: ComparisonOp, bound: &Value) -> bool {
+        let lower = self.lower.as_ref().map(Value::from);
+        let upper = self.upper.as_ref().map(Value::from);
+        match op {
+            ComparisonOp::Eq => {
+                lower.map_or(true, |lower| !is_less(bound, &lower))
+                    && upper.map_or(true, |upper| is_less(bound, &upper))
+            }
+            ComparisonOp::Lt => lower.map_or(true, |lower| is_less(&lower, bound)),
+            ComparisonOp::LtEq => lower.map_or(true, |lower| !is_less(bound, &lower)),
+            ComparisonOp::Gt | ComparisonOp::GtEq => {
+                upper.map_or(true, |upper| is_less(bound, &upper))
+            }
+            ComparisonOp::NotEq => true,
+        }
+    }
+}
+
+/// Splits rows between partitions holding ranges of values.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct RangePartitioning {
+    column: String,
+    /// Ordered by lower bound.
+    partitions: Vec<RangePartition>,
+}
+
+impl RangePartitioning {
+    /// Partitions by `column`, which has the type `column_type`, checking that the partitions don't overlap.
+    pub fn new(column: String, column_type: Type, partitions: Vec<RangePartition>) -> Result<Self> {
+        let mut partitioning = Self {
+            column,
+            partitions: Vec::with_capacity(partitions.len()),
+        };
+        for partition in partitions {
+            partitioning.add(partition, column_type)?;
+        }
+        Ok(partitioning)
+    }
+
+    pub fn column(&self) -> &str {
+        &self.column
+    }
+
+    pub fn partitions(&self) -> &[RangePartition] {
+        &self.partitions
+    }
+
+    /// Adds a partition, which must not overlap the existing partitions.
+    pub fn add(&mut self, partition: RangePartition, column_type: Type) -> Result<()> {
+        for bound in partition.lower.iter().chain(partition.upper.iter()) {
+            let bound_type = bound.get_type();
+            if bound_type != column_type {
+                return Err(ExecutionError::TypeError {
+                    column: self.column.clone(),
+                    expected_type: column_type,
+                    actual_type: bound_type,
+                }
+                .into());
+            }
+        }
+        if let (Some(lower), Some(upper)) = (&partition.lower, &partition.upper) {
+            if !is_less(&lower.into(), &upper.into()) {
+                return Err(ExecutionError::PartitionOverlap(partition.name).into());
+            }
+        }
+        if self.partitions.iter().any(|p| p.name == partition.name) {
+            return Err(ExecutionError::PartitionExists(partition.name).into());
+        }
+        // The first partition whose lower bound is above the new partition's.
+        let index = self
+            .partitions
+            .partition_point(|p| match (&p.lower, &partition.lower) {
+                (None, _) => true,
+                (Some(_), None) => false,
+                (Some(a), Some(b)) => !is_less(&b.into(), &a.into()),
+            });
+        let overlaps_previous = index
+            .checked_sub(1)
+            .map_or(false, |i| ends_after(&self.partitions[i], &partition));
+        let overlaps_next = self
+            .partitions
+            .get(index)
+            .map_or(false, |next| ends_after(&partition, next));
+        if overlaps_previous || overlaps_next {
+            return Err(ExecutionError::PartitionOverlap(partition.name).into());
+        }
+        self.partitions.insert(index, partition);
+        Ok(())
+    }
+
+    /// Removes the partition called `name`.
+    pub fn remove(&mut self, name: &str) -> Result<RangePartition> {
+        let index = self
+            .partitions
+            .iter()
+            .position(|p| p.name == name)
+            .ok_or_else(|| ExecutionError::NoPartition(name.to_owned()))?;
+        Ok(self.partitions.remove(index))
+    }
+
+    /// Returns the index of the partition holding `value`, if there is one.
+    pub fn find(&self, value: &Value) -> Option<usize> {
+        if value.is_null() {
+            return None;
+        }
+        let index = self.partitions.partition_point(|p| {
+            p.lower
+                .as_ref()
+                .map_or(true, |lower| !is_less(value, &lower.into()))
+        });
+        index
+            .checked_sub(1)
+            .filter(|i| self.partitions[*i].contains(value))
+    }
+
+    fn prune(&self, comparisons: &[(ComparisonOp, &Value)]) -> Vec<bool> {
+        let mut matching = vec![true; self.partitions.len()];
+        for (op, value) in comparisons {
+            // Values of another type are compared by converting them, which doesn't preserve the order of the bounds.
+            if self.partitions.iter().any(|p| !same_type(p, value)) {
+                continue;
+            }
+            for (partition, matching) in self.partitions.iter().zip(matching.iter_mut()) {
+                *matching &= partition.could_match(*op, value);
+            }
+        }
+        matching
+    }
+}
+
+/// Splits rows between a fixed number of partitions by the hash of their value.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct HashPartitioning {
+    column: String,
+    column_type: Type,
+    num_partitions: u32,
+}
+
+impl HashPartitioning {
+    /// Partitions by `column`, which has the type `column_type`, into `num_partitions` partitions.
+    pub fn new(column: String, column_type: Type, num_partitions: u32) -> Result<Self> {
+        if num_partitions == 0 || num_partitions > MAX_HASH_PARTITIONS {
+            return Err(ExecutionError::InvalidPartitionCount(num_partitions).into());
+        }
+        Ok(Self {
+            column,
+            column_type,
+            num_partitions,
+        })
+    }
+
+    pub fn column(&self) -> &str {
+        &self.column
+    }
+
+    pub fn num_partitions(&self) -> u32 {
+        self.num_partitions
+    }
+
+    /// Returns the index of the partition holding `value`. Nulls are all held in the first partition.
+    pub fn find(&self, value: &Value) -> usize {
+        match value {
+            Value::Null => 0,
+            Value::TypedValue(contents) => {
+                let contents = contents.clone().cast(&self.column_type);
+                (fnv1a(&contents.encode().0) % self.num_partitions as u64) as usize
+            }
+        }
+    }
+
+    fn prune(&self, comparisons: &[(ComparisonOp, &Value)]) -> Vec<bool> {
+        let equal = comparisons.iter().find(|(op, value)| {
+            // Strings are compared to integers by converting them, so many strings can equal an integer.
+            matches!(op, ComparisonOp::Eq)
+                && matches!(value, Value::TypedValue(contents) if contents.get_type() == self.column_type)
+        });
+        match equal {
+            Some((_, value)) => {
+                let index = self.find(value);
+                (0..self.num_partitions as usize)
+                    .map(|i| i == index)
+                    .collect()
+            }
+            None => vec![true; self.num_partitions as usize],
+        }
+    }
+}
+
+/// Collects the comparisons between `column` and a value in the top-level `AND`s of `predicate`, with the column on
+/// the left.
+fn column_comparisons<'a>(
+    predicate: &'a Expression,
+    column: &str,
+    table_name: &str,
+    comparisons: &mut Vec<(ComparisonOp, &'a Value)>,
+) {
+    let (left, op, right) = match predicate {
+        Expression::BinaryOp(left, op, right) => (left, op, right),
+        _ => return,
+    };
+    let is_column = |c: &ResolvedColumn| c.table_name() == table_name && c.column_name() == column;
+    match (op, left.as_ref(), right.as_ref()) {
+        (BinaryOp::And, _, _) => {
+            column_comparisons(left, column, table_name, comparisons);
+            column_comparisons(right, column, table_name, comparisons);
+        }
+        (BinaryOp::Comparison(op), Expression::Identifier(c), Expression::Value(value))
+            if is_column(c) =>
+        {
+            comparisons.push((*op, value))
+        }
+        (BinaryOp::Comparison(op), Expression::Value(value), Expression::Identifier(c))
+            if is_column(c) =>
+        {
+            comparisons.push((flip(*op), value))
+        }
+        _ => {}
+    }
+}
+
+/// The 64-bit FNV-1a hash, which is stable between runs and versions, unlike the standard library's hasher.
+fn fnv1a(bytes: &[u8]) -> u64 {
+    bytes.iter().fold(0xcbf2_9ce4_8422_2325, |hash, byte| {
+        (hash ^ *byte as u64).wrapping_mul(0x0100_0000_01b3)
+    })
+}
+
+/// Returns the name of the sled tree holding a partition. The table name is prefixed with its length, so that no other
+/// table and partition name give the same tree name.
+pub fn partition_tree_name(table: &str, partition: &str) -> String {
+    format!("{}:{}@{}", table.len(), table, partition)
+}
+
+fn is_less(a: &Value, b: &Value) -> bool {
+    a.compare(b) == Comparison::LessThan
+}
+
+/// Returns whether `first` extends past the start of `second`, given that `first` doesn't start after `second`.
+fn ends_after(first: &RangePartition, second: &RangePartition) -> bool {
+    match (&first.upper, &second.lower) {
+        (None, _) | (_, None) => true,
+        (Some(upper), Some(lower)) => is_less(&lower.into(), &upper.into()),
+    }
+}
+
+fn same_type(partition: &RangePartition, value: &Value) -> bool {
+    let value_type = match value {
+        Value::TypedValue(contents) => contents.get_type(),
+        Value::Null => return false,
+    };
+    partition
+        .lower
+        .iter()
+        .chain(partition.upper.iter())
+        .all(|bound| bound.get_type() == value_type)
+}
+
+fn flip(op: ComparisonOp) -> ComparisonOp {
+    match op {
+        ComparisonOp::Eq => ComparisonOp::Eq,
+        ComparisonOp::NotEq => ComparisonOp::NotEq,
+        ComparisonOp::Gt => ComparisonOp::Lt,
+        ComparisonOp::Lt => ComparisonOp::Gt,
+        ComparisonOp::GtEq => ComparisonOp::LtEq,
+        ComparisonOp::LtEq => ComparisonOp::GtEq,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        partition_tree_name, HashPartitioning, PartitionBound, Partitioning, RangePartition,
+        RangePartitioning,
+    };
+    use crate::{
+        ast::{BinaryOp, ComparisonOp},
+        data_types::Type,
+        resolved_expression::{Expression, ResolvedColumn},
+    };
+
+    fn partitioning() -> RangePartitioning {
+        let bound = |i| Some(PartitionBound::Integer(i));
+        RangePartitioning::new(
+            "time".to_owned(),
+            Type::Integer,
+            vec![
+                RangePartition::new("late", bound(20), None),
+                RangePartition::new("early", None, bound(10)),
+                RangePartition::new("middle", bound(10), bound(20)),
+            ],
+        )
+        .unwrap()
+    }
+
+    fn compare(op: ComparisonOp, value: i64) -> Expression {
+        Expression::BinaryOp(
+            Box::new(Expression::Identifier(ResolvedColumn::new(
+                "events".to_owned(),
+                "time".to_owned(),
+            ))),
+            BinaryOp::Comparison(op),
+            Box::new(Expression::Value(value.into())),
+        )
+    }
+
+    #[test]
+    fn find_partition() {
+        let partitioning = partitioning();
+        let names = partitioning
+            .partitions()
+            .iter()
+            .map(|p| p.name.as_str())
+            .collect::<Vec<_>>();
+        assert_eq!(names, vec!["early", "middle", "late"]);
+        assert_eq!(partitioning.find(&(-5).into()), Some(0));
+        assert_eq!(partitioning.find(&10.into()), Some(1));
+        assert_eq!(partitioning.find(&19.into()), Some(1));
+        assert_eq!(partitioning.find(&20.into()), Some(2));
+
+        let mut gaps = partitioning;
+        gaps.remove("middle").unwrap();
+        assert_eq!(gaps.find(&15.into()), None);
+        let overlap = RangePartition::new(
+            "overlap",
+            Some(PartitionBound::Integer(5)),
+            Some(PartitionBound::Integer(15)),
+        );
+        assert!(gaps.add(overlap, Type::Integer).is_err());
+    }
+
+    #[test]
+    fn prune_partitions() {
+        let partitioning = Partitioning::Range(partitioning());
+        assert_eq!(
+            partitioning.prune(&compare(ComparisonOp::Eq, 15), "events"),
+            vec![false, true, false]
+        );
+        assert_eq!(
+            partitioning.prune(&compare(ComparisonOp::GtEq, 20), "events"),
+            vec![false, false, true]
+        );
+        let range = Expression::BinaryOp(
+            Box::new(compare(ComparisonOp::Gt, 5)),
+            BinaryOp::And,
+            Box::new(compare(ComparisonOp::Lt, 10)),
+        );
+        assert_eq!(
+            partitioning.prune(&range, "events"),
+            vec![true, false, false]
+        );
+        assert_eq!(
+            partitioning.prune(&compare(ComparisonOp::Eq, 15), "other"),
+            vec![true, true, true]
+        );
+    }
+
+    #[test]
+    fn hash_partitions() {
+        let hash = HashPartitioning::new("time".to_owned(), Type::Integer, 4).unwrap();
+        let counts = (0..1000).fold([0; 4], |mut counts, i| {
+            counts[hash.find(&i.into())] += 1;
+            counts
+        });
+        assert!(counts.iter().all(|count| *count > 150), "{:?}", counts);
+        assert_eq!(hash.find(&"15".into()), hash.find(&15.into()));
+
+        let index = hash.find(&15.into());
+        let partitioning = Partitioning::Hash(hash);
+        let matching = partitioning.prune(&compare(ComparisonOp::Eq, 15), "events");
+        assert_eq!(matching.iter().filter(|m| **m).count(), 1);
+        assert!(matching[index]);
+        assert_eq!(
+            partitioning.prune(&compare(ComparisonOp::Lt, 15), "events"),
+            vec![true; 4]
+        );
+        assert!(HashPartitioning::new("time".to_owned(), Type::Integer, 0).is_err());
+    }
+
+    #[test]
+    fn partition_tree_names() {
+        assert_ne!(
+            partition_tree_name("t", "0@1"),
+            partition_tree_name("t@0", "1")
+        );
+        assert_ne!(partition_tree_name("events", "old"), "events@old");
+    }
+}
@@ -0,0 +1,59 @@
+use sqlparser::ast::{ColumnDef, ColumnOption, ObjectName};
+
+use crate::{
+    ast::{AlterTable, AlterTableOperation, Column},
+    error::{ExecutionError, Result},
+    query_process::{create_table::convert_data_type, parse_expression},
+};
+
+pub fn parse_alter_table(
+    name: ObjectName,
+    operation: sqlparser::ast::AlterTableOperation,
+) -> Result<AlterTable> {
+    let operation = match operation {
+        sqlparser::ast::AlterTableOperation::AddColumn { column_def } => {
+            AlterTableOperation::AddColumn(parse_added_column(column_def)?)
+        }
+        operation => {
+            return Err(ExecutionError::UnsupportedAlterTable(format!("{:?}", operation)).into())
+        }
+    };
+    Ok(AlterTable::new(name.to_string(), operation))
+}
+
+/// Parses a column added to an existing table. Only `DEFAULT` and `NOT NULL` can be given, as other constraints would
+/// need every existing row to be checked.
+fn parse_added_column(column: ColumnDef) -> Result<Column> {
+    let ColumnDef {
+        name,
+        data_type,
+        collation: _collation,
+        options,
+    } = column;
+    let column_name = name.to_string();
+    let mut default = None;
+    let mut not_null = false;
+    for column_option in options {
+        match column_option.option {
+            ColumnOption::Default(expr) => {
+                if default.is_some() {
+                    return Err(ExecutionError::MultipleDefault(column_name).into());
+                }
+                default = Some(parse_expression(expr))
+            }
+            ColumnOption::NotNull => {
+                if not_null {
+                    return Err(ExecutionError::MultipleNotNull(column_name).into());
+                }
+                not_null = true
+            }
+            _ => return Err(ExecutionError::AddColumnConstraint(column_name).into()),
+        }
+    }
+    Ok(Column::new(
+        column_name,
+        convert_data_type(data_type),
+        default,
+        not_null,
+    ))
+}
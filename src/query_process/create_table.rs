@@ -211,7 +211,7 @@ fn parse_foreign_key_action(action: ReferentialAction) -> ForeignKeyAction {
     }
 }
 
-fn convert_data_type(t: DataType) -> Type {
+pub(super) fn convert_data_type(t: DataType) -> Type {
     match t {
         DataType::String => Type::String,
         DataType::Int => Type::Integer,
@@ -1,3 +1,4 @@
+mod alter_table;
 mod create_table;
 mod delete;
 mod drop;
@@ -10,8 +11,8 @@ use crate::{
     ast::*,
     error::Result,
     query_process::{
-        create_table::parse_create_table, delete::parse_delete, drop::parse_drop,
-        insert::parse_insert, select::parse_select_query, update::parse_update,
+        alter_table::parse_alter_table, create_table::parse_create_table, delete::parse_delete,
+        drop::parse_drop, insert::parse_insert, select::parse_select_query, update::parse_update,
     },
 };
 use sqlparser::ast::Statement;
@@ -54,6 +55,9 @@ pub fn process_query(statement: Statement) -> Result<SqlQuery> {
             assignments,
             selection,
         } => SqlQuery::Update(parse_update(table_name, assignments, selection)),
+        Statement::AlterTable { name, operation } => {
+            SqlQuery::AlterTable(parse_alter_table(name, operation)?)
+        }
         _ => unimplemented!("{:?}", statement),
     })
 }
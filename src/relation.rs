@@ -1,5 +1,6 @@
 use std::{
     cmp::Ordering,
+    collections::HashMap,
     fmt::{Display, Formatter},
 };
 
@@ -15,28 +16,62 @@ use crate::{
 };
 
 /// Stores a list of rows returned by a query.
+/// Rows are stored back to back in a single buffer, with a stride of `num_columns`.
 #[derive(Debug, Clone, Default)]
 pub struct Relation {
     column_names: Vec<String>,
-    rows: Vec<Vec<Value>>,
+    column_indexes: HashMap<String, usize>,
+    values: Vec<Value>,
+    num_rows: usize,
+    peak_rows: usize,
 }
 
 impl Relation {
+    #[cfg(test)]
     pub(crate) fn new(column_names: Vec<String>) -> Self {
-        Self {
-            column_names,
-            rows: Vec::new(),
+        let mut relation = Self::default();
+        relation.reset(column_names);
+        relation
+    }
+
+    /// Removes all rows and replaces the columns, keeping the allocated buffers for reuse.
+    pub(crate) fn reset(&mut self, column_names: Vec<String>) {
+        self.peak_rows = self.peak_rows.max(self.num_rows);
+        self.values.clear();
+        self.num_rows = 0;
+        self.column_indexes.clear();
+        for (index, name) in column_names.iter().enumerate() {
+            self.column_indexes.entry(name.clone()).or_insert(index);
+        }
+        self.column_names = column_names;
+    }
+
+    /// Replaces the contents with `other`. Buffers are kept if `other` has no rows.
+    pub(crate) fn replace(&mut self, other: Relation) {
+        if other.num_rows == 0 {
+            self.reset(other.column_names);
+        } else {
+            let peak_rows = self.peak_rows();
+            *self = other;
+            self.peak_rows = self.peak_rows.max(peak_rows);
         }
     }
 
-    pub(crate) fn add_row(&mut self, row: Vec<Value>) -> Result<()> {
-        if self.column_names.len() == row.len() {
-            self.rows.push(row);
+    pub(crate) fn add_row<I>(&mut self, row: I) -> Result<()>
+    where
+        I: IntoIterator<Item = Value>,
+    {
+        let start = self.values.len();
+        self.values.extend(row);
+        let actual = self.values.len() - start;
+        if actual == self.column_names.len() {
+            self.num_rows += 1;
             Ok(())
         } else {
+            self.values.truncate(start);
             Err(ExecutionError::WrongNumColumns {
                 expected: self.column_names.len(),
-                actual: self.rows.len(),
+                actual,
             }
             .into())
         }
@@ -57,18 +92,19 @@ impl Relation {
                 } = o;
                 let expression = expression.to_string();
                 let index = self
-                    .column_names
-                    .iter()
-                    .position(|s| s.as_str() == expression)
+                    .column_index(&expression)
                     .ok_or(ExecutionError::NoColumn(expression))?;
                 Ok((index, direction, nulls_first))
             })
             .collect::<Result<Vec<_>>>()?;
 
-        self.rows.sort_unstable_by(|a, b| {
+        let stride = self.num_columns();
+        let values = &self.values;
+        let mut permutation = (0..self.num_rows).collect::<Vec<_>>();
+        permutation.sort_unstable_by(|&a, &b| {
             for (index, direction, nulls_first) in &order_by {
-                let a = &a[*index];
-                let b = &b[*index];
+                let a = &values[a * stride + *index];
+                let b = &values[b * stride + *index];
                 let mut order = match (a, b) {
                     (Value::Null, Value::Null) => Ordering::Equal,
                     (Value::Null, _) => {
@@ -101,6 +137,23 @@ impl Relation {
             }
             Ordering::Equal
         });
+
+        // Apply the permutation in place, one cycle at a time, so the buffer is kept for reuse.
+        for start in 0..permutation.len() {
+            let mut current = start;
+            loop {
+                let next = permutation[current];
+                permutation[current] = current;
+                if next == start || next == current {
+                    break;
+                }
+                for column in 0..stride {
+                    self.values
+                        .swap(current * stride + column, next * stride + column);
+                }
+                current = next;
+            }
+        }
         Ok(())
     }
 
@@ -111,17 +164,31 @@ impl Relation {
 
     /// Checks if the column name is contained in the `Relation`.
     pub fn contains_column(&self, column: &str) -> bool {
-        self.column_names.iter().any(|c| column == c)
+        self.column_indexes.contains_key(column)
+    }
+
+    /// Returns the index of the first column with the specified name.
+    pub fn column_index(&self, column: &str) -> Option<usize> {
+        self.column_indexes.get(column).copied()
+    }
+
+    fn row(&self, row: usize) -> &[Value] {
+        let stride = self.num_columns();
+        &self.values[row * stride..(row + 1) * stride]
     }
 
     /// Returns an `Iterator` of rows from the `Relation`.
     pub fn rows(&self) -> impl Iterator<Item = &[Value]> {
-        self.rows.iter().map(|r| r.as_slice())
+        (0..self.num_rows).map(move |row| self.row(row))
     }
 
     /// Returns a `Vec` of rows.
     pub fn take_rows(self) -> Vec<Vec<Value>> {
-        self.rows
+        let stride = self.num_columns();
+        let mut values = self.values.into_iter();
+        (0..self.num_rows)
+            .map(|_| values.by_ref().take(stride).collect())
+            .collect()
     }
 
     /// Returns the number of columns.
@@ -131,63 +198,71 @@ impl Relation {
 
     /// Returns the number of rows.
     pub fn num_rows(&self) -> usize {
-        self.rows.len()
+        self.num_rows
+    }
+
+    /// Returns the number of values that can be stored without reallocating.
+    pub fn value_capacity(&self) -> usize {
+        self.values.capacity()
+    }
+
+    /// Returns the largest number of rows held since the `Relation` was created.
+    pub fn peak_rows(&self) -> usize {
+        self.peak_rows.max(self.num_rows)
     }
 
     /// Checks if the `Relation` is an empty result.
     pub fn is_empty(&self) -> bool {
-        self.rows.is_empty() && self.column_names.is_empty()
+        self.num_rows == 0 && self.column_names.is_empty()
     }
 
     /// Gets a value from the specified row and column indexes.
     pub fn get_value(&self, column: usize, row: usize) -> Option<&Value> {
-        self.rows.get(row).and_then(|row| row.get(column))
+        if row < self.num_rows && column < self.num_columns() {
+            self.values.get(row * self.num_columns() + column)
+        } else {
+            None
+        }
     }
 
     /// Gets a value by column name from the specified row.
     pub fn get_value_named(&self, column: &str, row: usize) -> Option<&Value> {
-        let column_index = self
-            .column_names
-            .iter()
-            .position(|c| column == c.as_str())?;
-        Some(&self.rows[row][column_index])
+        self.get_value(self.column_index(column)?, row)
     }
 
     #[cfg(test)]
     pub(crate) fn assert_equals(&self, rows: HashSet<Vec<Value>>, column_names: Vec<&str>) {
-        assert_eq!(self.rows.len(), rows.len());
+        assert_eq!(self.num_rows, rows.len());
 
         assert_eq!(self.column_names, column_names);
-        dbg!(&self.rows);
+        dbg!(self.rows().collect::<Vec<_>>());
 
-        for row in &self.rows {
+        for row in self.rows() {
             assert!(rows.contains(row));
         }
     }
 
     #[cfg(test)]
     pub(crate) fn assert_equals_ordered(&self, rows: Vec<Vec<Value>>, column_names: Vec<&str>) {
-        assert_eq!(self.rows, rows);
+        assert_eq!(self.rows().collect::<Vec<_>>(), rows);
         assert_eq!(self.column_names, column_names)
     }
 
     /// Returns an `Iterator` of `Row`s
     pub fn iter(&self) -> impl Iterator<Item = Row<'_>> {
-        self.rows
-            .iter()
-            .map(move |row| Row::new(self.column_names.as_slice(), row.as_slice()))
+        self.rows().map(move |row| Row::new(self, row))
     }
 }
 
 /// A row from a `Relation`
 pub struct Row<'a> {
-    columns: &'a [String],
+    relation: &'a Relation,
     row: &'a [Value],
 }
 
 impl<'a> Row<'a> {
-    fn new(columns: &'a [String], row: &'a [Value]) -> Self {
-        Self { columns, row }
+    fn new(relation: &'a Relation, row: &'a [Value]) -> Self {
+        Self { relation, row }
     }
 
     /// Get a value by index.
@@ -197,9 +272,8 @@ impl<'a> Row<'a> {
 
     /// Get a value by name.
     pub fn get_value_named(&self, column_name: &str) -> Option<&Value> {
-        self.columns
-            .iter()
-            .position(|name| name.as_str() == column_name)
+        self.relation
+            .column_index(column_name)
             .map(|index| &self.row[index])
     }
 }
@@ -208,10 +282,102 @@ impl Display for Relation {
     fn fmt(&self, f: &mut Formatter<'_>) -> std::fmt::Result {
         if !self.column_names.is_empty() {
             writeln!(f, "{}", self.column_names.iter().join("|"))?;
-            for row in &self.rows {
+            for row in self.rows() {
                 writeln!(f, "{}", row.iter().join("|"))?;
             }
         }
         Ok(())
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use crate::{
+        ast::{ColumnName, OrderBy, OrderByDirection, UnresolvedExpression},
+        data_types::Value,
+    };
+
+    use super::Relation;
+
+    fn order_by(column: &str, direction: OrderByDirection) -> OrderBy {
+        let expression = UnresolvedExpression::Identifier(ColumnName::new(None, column.to_owned()));
+        OrderBy::new(expression, direction, false)
+    }
+
+    #[test]
+    fn add_row_wrong_length() {
+        let mut relation = Relation::new(vec!["id".to_owned(), "name".to_owned()]);
+        relation.add_row(vec![1.into(), "a".into()]).unwrap();
+        assert!(relation.add_row(vec![2.into()]).is_err());
+        assert!(relation
+            .add_row(vec![2.into(), "b".into(), "c".into()])
+            .is_err());
+        assert_eq!(relation.num_rows(), 1);
+        relation.assert_equals_ordered(vec![vec![1.into(), "a".into()]], vec!["id", "name"]);
+    }
+
+    #[test]
+    fn named_access_duplicate_columns() {
+        let mut relation =
+            Relation::new(vec!["name".to_owned(), "name".to_owned(), "age".to_owned()]);
+        relation
+            .add_row(vec!["a".into(), "b".into(), 25.into()])
+            .unwrap();
+        assert_eq!(relation.column_index("name"), Some(0));
+        assert_eq!(relation.column_index("age"), Some(2));
+        assert_eq!(relation.get_value_named("name", 0), Some(&"a".into()));
+        assert_eq!(relation.get_value_named("age", 0), Some(&25.into()));
+        assert_eq!(relation.get_value_named("age", 1), None);
+        assert_eq!(relation.get_value(3, 0), None);
+    }
+
+    #[test]
+    fn sort_permutes_rows() {
+        let mut relation = Relation::new(vec!["id".to_owned(), "name".to_owned()]);
+        relation.add_row(vec![2.into(), "b".into()]).unwrap();
+        relation.add_row(vec![Value::Null, "n".into()]).unwrap();
+        relation.add_row(vec![3.into(), "c".into()]).unwrap();
+        relation.add_row(vec![1.into(), "a".into()]).unwrap();
+        relation
+            .sort(vec![order_by("id", OrderByDirection::Descending)])
+            .unwrap();
+        relation.assert_equals_ordered(
+            vec![
+                vec![3.into(), "c".into()],
+                vec![2.into(), "b".into()],
+                vec![1.into(), "a".into()],
+                vec![Value::Null, "n".into()],
+            ],
+            vec!["id", "name"],
+        );
+        assert_eq!(
+            relation.take_rows(),
+            vec![
+                vec![3.into(), "c".into()],
+                vec![2.into(), "b".into()],
+                vec![1.into(), "a".into()],
+                vec![Value::Null, "n".into()],
+            ]
+        );
+    }
+
+    #[test]
+    fn reset_keeps_buffers() {
+        let mut relation = Relation::new(vec!["id".to_owned()]);
+        for id in 0..16 {
+            relation.add_row(vec![id.into()]).unwrap();
+        }
+        let capacity = relation.value_capacity();
+        relation.reset(vec!["name".to_owned(), "age".to_owned()]);
+        assert_eq!(relation.num_rows(), 0);
+        assert_eq!(relation.column_index("id"), None);
+        assert_eq!(relation.column_index("age"), Some(1));
+        assert_eq!(relation.value_capacity(), capacity);
+        assert_eq!(relation.peak_rows(), 16);
+
+        relation.replace(Relation::default());
+        assert!(relation.is_empty());
+        assert_eq!(relation.value_capacity(), capacity);
+        assert_eq!(relation.peak_rows(), 16);
+    }
+}
@@ -0,0 +1,433 @@
+//! Logical replication from a primary `Database` to read-only replicas.
+//!
+//! The primary records every change it makes to its sled trees, and appends the changes of each flush to the log as a
+//! single commit record. The log is a directory of segment files, each named after the log position of its first byte.
+//! A record is a `u32` payload length, a `u32` checksum of the payload, and the bincode encoded `Commit`.
+//! Replicas read the records from their last applied position and apply the changes to their own trees. Applying a
+//! change more than once has no further effect, so a replica that stops part way through a record can simply retry it.
+
+use std::{
+    convert::TryInto,
+    fs::{self, File, OpenOptions},
+    io::{BufReader, ErrorKind, Read, Seek, SeekFrom, Write},
+    mem,
+    ops::Deref,
+    path::{Path, PathBuf},
+    sync::{Arc, Mutex},
+    thread::{self, JoinHandle},
+    time::{Duration, SystemTime, UNIX_EPOCH},
+};
+
+use serde::{Deserialize, Serialize};
+use sled::{Db, Tree};
+
+use crate::{
+    error::{Error, Result},
+    Database,
+};
+
+/// A new segment is started once the current one grows past this length.
+const SEGMENT_LEN: u64 = 64 << 20;
+const RECORD_HEADER_LEN: u64 = 8;
+const REPLICATION_TREE: &str = "@replication";
+const POSITION_KEY: &str = "position";
+
+/// A single change made to a sled tree.
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub(crate) enum Change {
+    Insert {
+        tree: Vec<u8>,
+        key: Vec<u8>,
+        value: Vec<u8>,
+    },
+    Remove {
+        tree: Vec<u8>,
+        key: Vec<u8>,
+    },
+    DropTree {
+        tree: Vec<u8>,
+    },
+}
+
+impl Change {
+    fn apply(&self, db: &Db) -> Result<()> {
+        match self {
+            Change::Insert { tree, key, value } => {
+                db.open_tree(tree)?.insert(key, value.as_slice())?;
+            }
+            Change::Remove { tree, key } => {
+                db.open_tree(tree)?.remove(key)?;
+            }
+            Change::DropTree { tree } => {
+                db.drop_tree(tree)?;
+            }
+        }
+        Ok(())
+    }
+}
+
+/// The changes made by one flush of the primary.
+#[derive(Debug, Serialize, Deserialize)]
+struct Commit {
+    /// The time of the commit, in microseconds since the Unix epoch.
+    timestamp: u64,
+    changes: Vec<Change>,
+}
+
+/// The replication state of a replica.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct ReplicationStatus {
+    /// The log position up to which changes have been applied.
+    pub applied_position: u64,
+    /// The position of the end of the log.
+    pub log_end: u64,
+    /// How long ago the oldest unapplied commit was made, or zero if the replica is up to date.
+    pub lag: Duration,
+}
+
+impl ReplicationStatus {
+    /// Returns the number of log bytes waiting to be applied.
+    pub fn lag_bytes(&self) -> u64 {
+        self.log_end.saturating_sub(self.applied_position)
+    }
+}
+
+/// The role a `Database` plays in replication.
+pub(crate) enum Replication {
+    /// Changes are not logged.
+    None,
+    /// Changes are appended to a log.
+    Primary(ChangeLog),
+    /// Changes are read from a log, and queries may not modify the database.
+    Replica(PathBuf),
+}
+
+impl Replication {
+    pub fn is_replica(&self) -> bool {
+        matches!(self, Replication::Replica(_))
+    }
+
+    /// Records a change that has been made to `tree`.
+    pub fn record<F: FnOnce(Vec<u8>) -> Change>(&self, tree: &Tree, change: F) {
+        if let Replication::Primary(log) = self {
+            log.record(change(tree.name().to_vec()));
+        }
+    }
+
+    /// Records that `tree` has been dropped.
+    pub fn record_drop_tree(&self, tree: &[u8]) {
+        if let Replication::Primary(log) = self {
+            log.record(Change::DropTree {
+                tree: tree.to_vec(),
+            });
+        }
+    }
+
+    /// Appends the changes recorded since the last commit to the log. `lock_writes` is called to stop changes being
+    /// recorded while the changes are taken, so that a commit holds only the changes of whole statements.
+    pub fn commit<G>(&self, lock_writes: impl FnOnce() -> G) -> Result<()> {
+        if let Replication::Primary(log) = self {
+            log.commit(lock_writes)?;
+        }
+        Ok(())
+    }
+}
+
+/// Appends commits to the segments of a replication log.
+pub(crate) struct ChangeLog {
+    directory: PathBuf,
+    pending: Mutex<Vec<Change>>,
+    segment: Mutex<Segment>,
+}
+
+struct Segment {
+    file: File,
+    start: u64,
+    len: u64,
+}
+
+impl ChangeLog {
+    /// Opens the log in `directory`, creating it if it doesn't exist.
+    /// A partially written record at the end of the log is discarded.
+    pub fn open<P: AsRef<Path>>(directory: P) -> Result<Self> {
+        let directory = directory.as_ref().to_owned();
+        fs::create_dir_all(&directory)?;
+        let segment = match segment_starts(&directory)?.last() {
+            Some(&start) => {
+                let path = segment_path(&directory, start);
+                let mut reader = BufReader::new(File::open(&path)?);
+                let mut len = 0;
+                while let Some(record_len) = read_record(&mut reader)?.map(|(l, _)| l) {
+                    len += record_len;
+                }
+                let file = OpenOptions::new().write(true).open(&path)?;
+                file.set_len(len)?;
+                Segment { file, start, len }
+            }
+            None => Segment {
+                file: create_segment(&directory, 0)?,
+                start: 0,
+                len: 0,
+            },
+        };
+        Ok(Self {
+            directory,
+            pending: Mutex::new(Vec::new()),
+            segment: Mutex::new(segment),
+        })
+    }
+
+    fn record(&self, change: Change) {
+        lock(&self.pending).push(change);
+    }
+
+    fn commit<G>(&self, lock_writes: impl FnOnce() -> G) -> Result<()> {
+        // The segment is locked before the changes are taken, so that commits are appended in the order their changes
+        // were taken. Writes are only blocked until the changes have been taken, not while they are written to disk.
+        let writes = lock_writes();
+        let mut segment = lock(&self.segment);
+        let changes = mem::take(&mut *lock(&self.pending));
+        drop(writes);
+        if changes.is_empty() {
+            return Ok(());
+        }
+        let commit = Commit {
+            timestamp: now_micros(),
+            changes,
+        };
+        let payload = bincode::serialize(&commit)?;
+        let len: u32 = payload
+            .len()
+            .try_into()
+            .map_err(|_| Error::Internal("Commit is too large to log".to_owned()))?;
+
+        if segment.len >= SEGMENT_LEN {
+            let start = segment.start + segment.len;
+            *segment = Segment {
+                file: create_segment(&self.directory, start)?,
+                start,
+                len: 0,
+            };
+        }
+        let mut record = Vec::with_capacity(payload.len() + RECORD_HEADER_LEN as usize);
+        record.extend_from_slice(&len.to_be_bytes());
+        record.extend_from_slice(&checksum(&payload).to_be_bytes());
+        record.extend_from_slice(&payload);
+        let end = segment.len;
+        segment.file.seek(SeekFrom::Start(end))?;
+        segment.file.write_all(&record)?;
+        segment.file.sync_data()?;
+        segment.len += record.len() as u64;
+        Ok(())
+    }
+}
+
+/// Applies every complete commit in the log after the replica's applied position. Returns the number applied.
+pub(crate) fn apply_log(db: &Db, directory: &Path) -> Result<usize> {
+    let state = db.open_tree(REPLICATION_TREE)?;
+    let mut position = applied_position(&state)?;
+    let mut applied = 0;
+    while let Some((next, commit)) = read_commit(directory, position)? {
+        for change in &commit.changes {
+            change.apply(db)?;
+        }
+        position = next;
+        state.insert(POSITION_KEY, &position.to_be_bytes())?;
+        applied += 1;
+    }
+    if applied > 0 {
+        db.flush()?;
+    }
+    Ok(applied)
+}
+
+/// Reports how far the replica is behind the log.
+pub(crate) fn status(db: &Db, directory: &Path) -> Result<ReplicationStatus> {
+    let applied_position = applied_position(&db.open_tree(REPLICATION_TREE)?)?;
+    let log_end = match segment_starts(directory)?.last() {
+        Some(&start) => start + fs::metadata(segment_path(directory, start))?.len(),
+        None => 0,
+    };
+    let lag = match read_commit(directory, applied_position)? {
+        Some((_, commit)) => Duration::from_micros(now_micros().saturating_sub(commit.timestamp)),
+        None => Duration::default(),
+    };
+    Ok(ReplicationStatus {
+        applied_position,
+        log_end,
+        lag,
+    })
+}
+
+/// Applies the log to the replica every `interval` on a background thread, until the replica is dropped. Errors are
+/// passed to `on_error`, and the commits not yet applied are tried again after the next interval.
+pub fn follow<D, E>(database: &Arc<D>, interval: Duration, on_error: E) -> JoinHandle<()>
+where
+    D: Deref<Target = Database> + Send + Sync + 'static,
+    E: Fn(Error) + Send + 'static,
+{
+    let database = Arc::downgrade(database);
+    thread::spawn(move || loop {
+        match database.upgrade() {
+            Some(database) => {
+                if let Err(e) = database.poll_replication() {
+                    on_error(e);
+                }
+            }
+            None => return,
+        };
+        thread::sleep(interval);
+    })
+}
+
+fn applied_position(state: &Tree) -> Result<u64> {
+    match state.get(POSITION_KEY)? {
+        Some(bytes) => Ok(u64::from_be_bytes(bytes.as_ref().try_into().map_err(
+            |_| Error::Internal("Replication position is the wrong number of bytes".to_owned()),
+        )?)),
+        None => Ok(0),
+    }
+}
+
+/// Reads the commit at `position`, returning it with the position of the next record.
+/// Returns `None` if no complete commit has been written at `position` yet.
+fn read_commit(directory: &Path, position: u64) -> Result<Option<(u64, Commit)>> {
+    let start = match segment_starts(directory)?
+        .into_iter()
+        .take_while(|&start| start <= position)
+        .last()
+    {
+        Some(start) => start,
+        None => return Ok(None),
+    };
+    let mut file = match File::open(segment_path(directory, start)) {
+        Ok(file) => file,
+        Err(e) if e.kind() == ErrorKind::NotFound => return Ok(None),
+        Err(e) => return Err(e.into()),
+    };
+    file.seek(SeekFrom::Start(position - start))?;
+    match read_record(&mut file)? {
+        Some((len, payload)) => Ok(Some((position + len, bincode::deserialize(&payload)?))),
+        None => Ok(None),
+    }
+}
+
+/// Reads a record, returning its total length and payload.
+/// Returns `None` at the end of the segment, or if the record is incomplete or corrupt.
+fn read_record<R: Read>(reader: &mut R) -> Result<Option<(u64, Vec<u8>)>> {
+    let mut header = [0; RECORD_HEADER_LEN as usize];
+    if !read_full(reader, &mut header)? {
+        return Ok(None);
+    }
+    let len = u32::from_be_bytes(header[..4].try_into().unwrap());
+    let expected_checksum = u32::from_be_bytes(header[4..].try_into().unwrap());
+    let mut payload = vec![0; len as usize];
+    if !read_full(reader, &mut payload)? || checksum(&payload) != expected_checksum {
+        return Ok(None);
+    }
+    Ok(Some((RECORD_HEADER_LEN + len as u64, payload)))
+}
+
+/// Fills the buffer, returning false if the reader ends first.
+fn read_full<R: Read>(reader: &mut R, buffer: &mut [u8]) -> Result<bool> {
+    match reader.read_exact(buffer) {
+        Ok(()) => Ok(true),
+        Err(e) if e.kind() == ErrorKind::UnexpectedEof => Ok(false),
+        Err(e) => Err(e.into()),
+    }
+}
+
+fn segment_starts(directory: &Path) -> Result<Vec<u64>> {
+    let mut starts = Vec::new();
+    for entry in fs::read_dir(directory)? {
+        let name = entry?.file_name();
+        let start = name
+            .to_str()
+            .and_then(|n| n.strip_suffix(".log"))
+            .and_then(|n| n.parse().ok());
+        if let Some(start) = start {
+            starts.push(start);
+        }
+    }
+    starts.sort_unstable();
+    Ok(starts)
+}
+
+fn segment_path(directory: &Path, start: u64) -> PathBuf {
+    directory.join(format!("{:020}.log", start))
+}
+
+fn create_segment(directory: &Path, start: u64) -> Result<File> {
+    Ok(OpenOptions::new()
+        .write(true)
+        .create(true)
+        .open(segment_path(directory, start))?)
+}
+
+fn lock<T>(mutex: &Mutex<T>) -> std::sync::MutexGuard<T> {
+    mutex.lock().unwrap_or_else(|e| e.into_inner())
+}
+
+fn now_micros() -> u64 {
+    SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map_or(0, |d| d.as_micros() as u64)
+}
+
+/// A 32 bit FNV-1a checksum.
+pub(crate) fn checksum(bytes: &[u8]) -> u32 {
+    bytes.iter().fold(0x811c_9dc5, |hash, &byte| {
+        (hash ^ byte as u32).wrapping_mul(0x0100_0193)
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use std::{env::temp_dir, fs};
+
+    use super::{read_commit, segment_starts, Change, ChangeLog, Replication};
+
+    #[test]
+    fn log_round_trip() {
+        let directory = temp_dir().join(format!("stardust_log_{}", std::process::id()));
+        let _ = fs::remove_dir_all(&directory);
+        let insert = Change::Insert {
+            tree: b"test".to_vec(),
+            key: vec![0, 1],
+            value: vec![2, 3],
+        };
+        let drop_tree = Change::DropTree {
+            tree: b"test".to_vec(),
+        };
+
+        let replication = Replication::Primary(ChangeLog::open(&directory).unwrap());
+        replication.commit(|| ()).unwrap();
+        assert_eq!(read_commit(&directory, 0).unwrap().map(|(p, _)| p), None);
+        if let Replication::Primary(log) = &replication {
+            log.record(insert.clone());
+            log.record(drop_tree.clone());
+        }
+        replication.commit(|| ()).unwrap();
+        let (next, commit) = read_commit(&directory, 0).unwrap().unwrap();
+        assert_eq!(commit.changes, vec![insert.clone(), drop_tree]);
+        assert!(read_commit(&directory, next).unwrap().is_none());
+
+        // Reopening discards a partially written record.
+        append_partial_record(&directory, next);
+        let log = ChangeLog::open(&directory).unwrap();
+        log.record(insert.clone());
+        log.commit(|| ()).unwrap();
+        let (_, commit) = read_commit(&directory, next).unwrap().unwrap();
+        assert_eq!(commit.changes, vec![insert]);
+        assert_eq!(segment_starts(&directory).unwrap(), vec![0]);
+        fs::remove_dir_all(&directory).unwrap();
+    }
+
+    fn append_partial_record(directory: &std::path::Path, end: u64) {
+        let path = directory.join(format!("{:020}.log", 0));
+        let mut contents = fs::read(&path).unwrap();
+        assert_eq!(contents.len() as u64, end);
+        contents.extend_from_slice(&[0, 0, 0, 9, 1]);
+        fs::write(&path, contents).unwrap();
+    }
+}
@@ -0,0 +1,85 @@
+//! Adding columns to existing tables.
+//!
+//! Adding a column doesn't rewrite the rows of the table, so it takes the same time however large the table is. The
+//! columns the table had before each column was added are stored in the `@schema_versions` tree, and rows store the
+//! schema version they were written with after the row id in their key. Rows written with an old version are decoded
+//! with that version's columns, reading each column added since as its default, and take the current version the
+//! next time they are updated.
+
+use crate::{
+    ast::Column,
+    data_types::Value,
+    error::{ExecutionError, Result},
+    interpreter::{evaluate_expression, resolve_expression, Interpreter},
+    replication::Change,
+    storage::Columns,
+    Empty,
+};
+
+const SCHEMA_VERSIONS_TREE: &str = "@schema_versions";
+
+/// Returns the columns `table` had before each time it was altered, oldest first.
+pub(crate) fn schema_versions(interpreter: &Interpreter, table: &str) -> Result<Vec<Columns>> {
+    match interpreter
+        .db()
+        .open_tree(SCHEMA_VERSIONS_TREE)?
+        .get(table.as_bytes())?
+    {
+        Some(versions) => Ok(bincode::deserialize(versions.as_ref())?),
+        None => Ok(Vec::new()),
+    }
+}
+
+/// Adds `column` to `table` after its existing columns. Existing rows take the column's default, or null.
+pub(crate) fn add_column(interpreter: &Interpreter, table: &str, column: Column) -> Result<()> {
+    let Column {
+        name,
+        data_type,
+        default,
+        not_null,
+    } = column;
+    let default = default
+        .map(|d| evaluate_expression(&resolve_expression(d, &Empty)?, &Empty))
+        .transpose()?
+        .map(|d| d.cast(&data_type))
+        .filter(|d| *d != Value::Null);
+    if not_null && default.is_none() {
+        return Err(ExecutionError::NotNullWithoutDefault(name).into());
+    }
+    let mut table_definition = (*interpreter.open_table(table, None)?).clone();
+    let mut versions = schema_versions(interpreter, table)?;
+    if versions.len() >= u16::MAX as usize {
+        return Err(ExecutionError::TooManySchemaVersions(table.to_owned()).into());
+    }
+    versions.push(table_definition.columns().clone());
+    table_definition.add_column(name, data_type, default, not_null)?;
+
+    let replication = interpreter.replication();
+    for (tree, value) in [
+        ("@tables", bincode::serialize(&table_definition)?),
+        (SCHEMA_VERSIONS_TREE, bincode::serialize(&versions)?),
+    ] {
+        let tree = interpreter.db().open_tree(tree)?;
+        tree.insert(table.as_bytes(), value.as_slice())?;
+        replication.record(&tree, |tree| Change::Insert {
+            tree,
+            key: table.as_bytes().to_vec(),
+            value,
+        });
+    }
+    Ok(())
+}
+
+/// Removes the schema versions of `table`, when it is dropped.
+pub(crate) fn remove_table(interpreter: &Interpreter, table: &str) -> Result<()> {
+    let versions = interpreter.db().open_tree(SCHEMA_VERSIONS_TREE)?;
+    if versions.remove(table.as_bytes())?.is_some() {
+        interpreter
+            .replication()
+            .record(&versions, |tree| Change::Remove {
+                tree,
+                key: table.as_bytes().to_vec(),
+            });
+    }
+    Ok(())
+}
@@ -0,0 +1,326 @@
+//! A network server giving remote clients access to a `Database`.
+//!
+//! Each connection is read and written by its own lightweight thread, while queries are executed by a fixed pool of
+//! worker threads shared by every connection, so a slow connection never holds a worker while it waits on the
+//! network. All connections share one `Database`, and so one catalog and sled cache. Statements that modify the
+//! database run one at a time, while queries run concurrently.
+//! Pipelined requests that have already arrived are executed together and flushed to disk once, as a group commit,
+//! before any of their responses are sent.
+
+pub mod protocol;
+
+use std::{
+    io::{self, BufReader, BufWriter, Read, Write},
+    net::{TcpListener, TcpStream, ToSocketAddrs},
+    ops::Deref,
+    panic::{self, AssertUnwindSafe},
+    sync::{
+        mpsc::{channel, Receiver, Sender},
+        Arc, Mutex,
+    },
+    thread::{self, JoinHandle},
+    time::Duration,
+};
+
+#[cfg(unix)]
+use std::os::unix::net::{UnixListener, UnixStream};
+
+use crate::Database;
+
+use self::protocol::{
+    read_request, read_response, write_request, write_response, Request, Response,
+};
+
+type Job = Box<dyn FnOnce() + Send>;
+
+/// The most pipelined requests executed as a single group.
+pub const MAX_GROUP_LEN: usize = 256;
+
+/// How long to wait before accepting again after an error that isn't specific to one connection.
+const ACCEPT_RETRY_DELAY: Duration = Duration::from_millis(100);
+
+/// A stream that a connection can be served over.
+pub trait Stream: Read + Write + Send + Sized + 'static {
+    /// Creates a second handle to the stream, so that it can be read and written independently.
+    fn try_clone(&self) -> io::Result<Self>;
+}
+
+impl Stream for TcpStream {
+    fn try_clone(&self) -> io::Result<Self> {
+        TcpStream::try_clone(self)
+    }
+}
+
+#[cfg(unix)]
+impl Stream for UnixStream {
+    fn try_clone(&self) -> io::Result<Self> {
+        UnixStream::try_clone(self)
+    }
+}
+
+/// Serves a `Database` to network clients using the protocol in `protocol`.
+pub struct Server<D> {
+    database: Arc<D>,
+    jobs: Sender<Job>,
+    workers: Vec<JoinHandle<()>>,
+}
+
+impl<D: Deref<Target = Database> + Send + Sync + 'static> Server<D> {
+    /// Creates a server for `database`, executing queries on `num_workers` worker threads.
+    pub fn new(database: D, num_workers: usize) -> Self {
+        let (jobs, receiver) = channel::<Job>();
+        let receiver = Arc::new(Mutex::new(receiver));
+        let workers = (0..num_workers.max(1))
+            .map(|_| {
+                let receiver = receiver.clone();
+                thread::spawn(move || run_worker(&receiver))
+            })
+            .collect();
+        Self {
+            database: Arc::new(database),
+            jobs,
+            workers,
+        }
+    }
+
+    /// Returns the database being served.
+    pub fn database(&self) -> &Arc<D> {
+        &self.database
+    }
+
+    /// Returns the number of worker threads executing queries.
+    pub fn num_workers(&self) -> usize {
+        self.workers.len()
+    }
+
+    /// Accepts connections from the TCP listener until the listener itself fails. An error accepting or setting up one
+    /// connection, or on the connection afterwards, closes only that connection, and is passed to `on_error`.
+    pub fn serve_tcp<E>(&self, listener: TcpListener, on_error: E) -> io::Result<()>
+    where
+        E: Fn(io::Error) + Clone + Send + 'static,
+    {
+        self.accept_connections(
+            listener.incoming(),
+            |stream| stream.set_nodelay(true),
+            on_error,
+        )
+    }
+
+    /// Accepts connections from the Unix socket listener until the listener itself fails. An error accepting or setting
+    /// up one connection, or on the connection afterwards, closes only that connection, and is passed to `on_error`.
+    #[cfg(unix)]
+    pub fn serve_unix<E>(&self, listener: UnixListener, on_error: E) -> io::Result<()>
+    where
+        E: Fn(io::Error) + Clone + Send + 'static,
+    {
+        self.accept_connections(listener.incoming(), |_| Ok(()), on_error)
+    }
+
+    /// Serves each stream of `incoming` after passing it to `configure`. Errors other than those of the listener are
+    /// passed to `on_error`, and the next connection accepted.
+    fn accept_connections<S, I, C, E>(
+        &self,
+        incoming: I,
+        configure: C,
+        on_error: E,
+    ) -> io::Result<()>
+    where
+        S: Stream,
+        I: Iterator<Item = io::Result<S>>,
+        C: Fn(&S) -> io::Result<()>,
+        E: Fn(io::Error) + Clone + Send + 'static,
+    {
+        for stream in incoming {
+            let stream = match stream {
+                Ok(stream) => stream,
+                Err(e) if is_listener_error(&e) => return Err(e),
+                Err(e) => {
+                    let retry_now = is_connection_error(&e);
+                    on_error(e);
+                    // Other errors, such as running out of file descriptors, last until connections close.
+                    if !retry_now {
+                        thread::sleep(ACCEPT_RETRY_DELAY);
+                    }
+                    continue;
+                }
+            };
+            let finish = on_error.clone();
+            let started = configure(&stream).and_then(|()| {
+                self.spawn_connection(stream, move |result| result.unwrap_or_else(finish))
+            });
+            if let Err(e) = started {
+                on_error(e);
+            }
+        }
+        Ok(())
+    }
+
+    /// Serves requests from the stream on a new connection thread, until the client disconnects. The returned
+    /// handle gives the error that closed the connection, if any.
+    pub fn serve_connection<S: Stream>(&self, stream: S) -> io::Result<JoinHandle<io::Result<()>>> {
+        self.spawn_connection(stream, |result| result)
+    }
+
+    /// Serves requests from the stream on a new connection thread, passing the result of the connection to `finish`.
+    fn spawn_connection<S, F, R>(&self, stream: S, finish: F) -> io::Result<JoinHandle<R>>
+    where
+        S: Stream,
+        F: FnOnce(io::Result<()>) -> R + Send + 'static,
+        R: Send + 'static,
+    {
+        let reader = BufReader::new(stream.try_clone()?);
+        let writer = BufWriter::new(stream);
+        let database = self.database.clone();
+        let jobs = self.jobs.clone();
+        thread::Builder::new().spawn(move || finish(run_connection(reader, writer, database, jobs)))
+    }
+}
+
+/// Returns whether an error accepting a connection means that the listener can't accept any more, as when the socket
+/// isn't listening.
+fn is_listener_error(error: &io::Error) -> bool {
+    error.kind() == io::ErrorKind::InvalidInput
+}
+
+/// Returns whether an error accepting a connection concerns only that connection, such as the client resetting it.
+fn is_connection_error(error: &io::Error) -> bool {
+    matches!(
+        error.kind(),
+        io::ErrorKind::ConnectionAborted
+            | io::ErrorKind::ConnectionReset
+            | io::ErrorKind::Interrupted
+            | io::ErrorKind::WouldBlock
+    )
+}
+
+fn run_worker(receiver: &Mutex<Receiver<Job>>) {
+    loop {
+        let job = match receiver.lock() {
+            Ok(receiver) => receiver.recv(),
+            Err(_) => return,
+        };
+        match job {
+            // Jobs catch their own panics to respond with an error. This keeps the worker running if one doesn't.
+            Ok(job) => {
+                let _ = panic::catch_unwind(AssertUnwindSafe(job));
+            }
+            Err(_) => return,
+        }
+    }
+}
+
+fn run_connection<S: Stream, D: Deref<Target = Database> + Send + Sync + 'static>(
+    mut reader: BufReader<S>,
+    mut writer: BufWriter<S>,
+    database: Arc<D>,
+    jobs: Sender<Job>,
+) -> io::Result<()> {
+    let (results, responses) = channel();
+    while let Some(request) = read_request(&mut reader)? {
+        let mut group = vec![request];
+        while group.len() < MAX_GROUP_LEN && !reader.buffer().is_empty() {
+            match read_request(&mut reader)? {
+                Some(request) => group.push(request),
+                None => break,
+            }
+        }
+
+        let database = database.clone();
+        let results = results.clone();
+        jobs.send(Box::new(move || {
+            let group_len = group.len();
+            let group_responses =
+                panic::catch_unwind(AssertUnwindSafe(|| execute_group(&database, group)))
+                    .unwrap_or_else(|_| {
+                        (0..group_len)
+                            .map(|_| Response::Error("Query execution panicked".to_owned()))
+                            .collect()
+                    });
+            let _ = results.send(group_responses);
+        }))
+        .map_err(|_| io::Error::new(io::ErrorKind::Other, "worker pool stopped"))?;
+        let group_responses = responses
+            .recv()
+            .map_err(|_| io::Error::new(io::ErrorKind::Other, "worker pool stopped"))?;
+        for response in &group_responses {
+            write_response(&mut writer, response)?;
+        }
+        writer.flush()?;
+    }
+    Ok(())
+}
+
+fn execute_group(database: &Database, group: Vec<Request>) -> Vec<Response> {
+    let queries = group.iter().map(|request| match request {
+        Request::Query(sql) => sql.as_str(),
+    });
+    match database.execute_queries(queries) {
+        Ok(results) => results
+            .into_iter()
+            .map(|result| match result {
+                Ok(relations) => Response::Results(relations),
+                Err(e) => Response::Error(e.to_string()),
+            })
+            .collect(),
+        Err(e) => group
+            .iter()
+            .map(|_| Response::Error(e.to_string()))
+            .collect(),
+    }
+}
+
+/// A client connection to a `Server`.
+pub struct Client<S: Stream> {
+    reader: BufReader<S>,
+    writer: BufWriter<S>,
+}
+
+impl Client<TcpStream> {
+    /// Connects to a server listening on a TCP address.
+    pub fn connect_tcp<A: ToSocketAddrs>(address: A) -> io::Result<Self> {
+        let stream = TcpStream::connect(address)?;
+        stream.set_nodelay(true)?;
+        Self::new(stream)
+    }
+}
+
+#[cfg(unix)]
+impl Client<UnixStream> {
+    /// Connects to a server listening on a Unix socket.
+    pub fn connect_unix<P: AsRef<std::path::Path>>(path: P) -> io::Result<Self> {
+        Self::new(UnixStream::connect(path)?)
+    }
+}
+
+impl<S: Stream> Client<S> {
+    /// Creates a client from a connected stream.
+    pub fn new(stream: S) -> io::Result<Self> {
+        Ok(Self {
+            reader: BufReader::new(stream.try_clone()?),
+            writer: BufWriter::new(stream),
+        })
+    }
+
+    /// Executes the query on the server, waiting for the response.
+    pub fn query(&mut self, sql: &str) -> io::Result<Response> {
+        self.send(sql)?;
+        self.flush()?;
+        self.receive()
+    }
+
+    /// Queues a query without waiting for its response, so that several queries can be pipelined.
+    /// Queued queries are sent by `flush`, or once the write buffer fills.
+    pub fn send(&mut self, sql: &str) -> io::Result<()> {
+        write_request(&mut self.writer, &Request::Query(sql.to_owned()))
+    }
+
+    /// Sends all queued queries.
+    pub fn flush(&mut self) -> io::Result<()> {
+        self.writer.flush()
+    }
+
+    /// Waits for the response to the oldest query without a response.
+    pub fn receive(&mut self) -> io::Result<Response> {
+        read_response(&mut self.reader)
+    }
+}
@@ -0,0 +1,290 @@
+//! The binary protocol spoken by the server.
+//!
+//! Every message is a frame of a big-endian `u32` payload length, followed by the payload.
+//! A request payload is a kind byte followed by its contents. `REQUEST_QUERY` carries UTF-8 SQL.
+//! A response payload is a status byte. `RESPONSE_OK` is followed by a `u32` count of relations, each encoded as
+//! a `u32` column count, the column names, a `u64` row count and the values row by row.
+//! `RESPONSE_ERROR` is followed by a UTF-8 error message.
+//! Strings are encoded as a `u32` length followed by the bytes, and values as a tag byte followed by the contents.
+//! Requests may be pipelined. Responses are always sent in the order the requests were received.
+
+use std::{
+    convert::TryFrom,
+    io::{self, ErrorKind, Read, Write},
+};
+
+use crate::{
+    data_types::{IntegerStorage, TypeContents, Value},
+    relation::Relation,
+};
+
+/// The largest frame accepted, to stop a corrupt length from allocating unbounded memory.
+pub const MAX_FRAME_LEN: usize = 1 << 30;
+
+/// A request that executes the SQL that follows.
+pub const REQUEST_QUERY: u8 = 1;
+
+/// A response containing the relations produced by the request.
+pub const RESPONSE_OK: u8 = 0;
+/// A response containing the error message produced by the request.
+pub const RESPONSE_ERROR: u8 = 1;
+
+const VALUE_NULL: u8 = 0;
+const VALUE_INTEGER: u8 = 1;
+const VALUE_STRING: u8 = 2;
+
+/// A request sent from a client to the server.
+#[derive(Debug, Clone, PartialEq)]
+pub enum Request {
+    /// Execute the semicolon separated queries, returning a relation for each.
+    Query(String),
+}
+
+/// A response sent from the server to a client.
+#[derive(Debug, Clone)]
+pub enum Response {
+    /// The request succeeded, producing the relations.
+    Results(Vec<Relation>),
+    /// The request failed with the error message.
+    Error(String),
+}
+
+/// Writes the request as a single frame.
+pub fn write_request<W: Write>(writer: &mut W, request: &Request) -> io::Result<()> {
+    let mut payload = Vec::new();
+    match request {
+        Request::Query(sql) => {
+            payload.push(REQUEST_QUERY);
+            payload.extend_from_slice(sql.as_bytes());
+        }
+    }
+    write_frame(writer, &payload)
+}
+
+/// Reads a request frame. Returns `None` if the stream ended cleanly before the frame started.
+pub fn read_request<R: Read>(reader: &mut R) -> io::Result<Option<Request>> {
+    let payload = match read_frame(reader)? {
+        Some(payload) => payload,
+        None => return Ok(None),
+    };
+    match payload.split_first() {
+        Some((&REQUEST_QUERY, sql)) => Ok(Some(Request::Query(to_string(sql.to_vec())?))),
+        _ => Err(invalid_data("unknown request kind")),
+    }
+}
+
+/// Writes the response as a single frame.
+pub fn write_response<W: Write>(writer: &mut W, response: &Response) -> io::Result<()> {
+    let mut payload = Vec::new();
+    match response {
+        Response::Results(relations) => {
+            payload.push(RESPONSE_OK);
+            put_len(&mut payload, relations.len())?;
+            for relation in relations {
+                put_relation(&mut payload, relation)?;
+            }
+        }
+        Response::Error(message) => {
+            payload.push(RESPONSE_ERROR);
+            payload.extend_from_slice(message.as_bytes());
+        }
+    }
+    write_frame(writer, &payload)
+}
+
+/// Reads a response frame.
+pub fn read_response<R: Read>(reader: &mut R) -> io::Result<Response> {
+    let payload = read_frame(reader)?
+        .ok_or_else(|| io::Error::new(ErrorKind::UnexpectedEof, "connection closed"))?;
+    let mut payload = payload.as_slice();
+    match take(&mut payload, 1)?[0] {
+        RESPONSE_OK => {
+            let num_relations = take_len(&mut payload)?;
+            let relations = (0..num_relations)
+                .map(|_| take_relation(&mut payload))
+                .collect::<io::Result<_>>()?;
+            Ok(Response::Results(relations))
+        }
+        RESPONSE_ERROR => Ok(Response::Error(to_string(payload.to_vec())?)),
+        _ => Err(invalid_data("unknown response status")),
+    }
+}
+
+fn write_frame<W: Write>(writer: &mut W, payload: &[u8]) -> io::Result<()> {
+    if payload.len() > MAX_FRAME_LEN {
+        return Err(invalid_data("frame too large"));
+    }
+    writer.write_all(&(payload.len() as u32).to_be_bytes())?;
+    writer.write_all(payload)
+}
+
+fn read_frame<R: Read>(reader: &mut R) -> io::Result<Option<Vec<u8>>> {
+    let mut len = [0; 4];
+    let mut read = 0;
+    while read < len.len() {
+        match reader.read(&mut len[read..]) {
+            Ok(0) if read == 0 => return Ok(None),
+            Ok(0) => return Err(ErrorKind::UnexpectedEof.into()),
+            Ok(n) => read += n,
+            Err(e) if e.kind() == ErrorKind::Interrupted => {}
+            Err(e) => return Err(e),
+        }
+    }
+    let len = u32::from_be_bytes(len) as usize;
+    if len > MAX_FRAME_LEN {
+        return Err(invalid_data("frame too large"));
+    }
+    let mut payload = vec![0; len];
+    reader.read_exact(&mut payload)?;
+    Ok(Some(payload))
+}
+
+fn put_len(payload: &mut Vec<u8>, len: usize) -> io::Result<()> {
+    let len = u32::try_from(len).map_err(|_| invalid_data("length too large"))?;
+    payload.extend_from_slice(&len.to_be_bytes());
+    Ok(())
+}
+
+fn put_str(payload: &mut Vec<u8>, string: &str) -> io::Result<()> {
+    put_len(payload, string.len())?;
+    payload.extend_from_slice(string.as_bytes());
+    Ok(())
+}
+
+fn put_relation(payload: &mut Vec<u8>, relation: &Relation) -> io::Result<()> {
+    put_len(payload, relation.num_columns())?;
+    for name in relation.column_names() {
+        put_str(payload, name)?;
+    }
+    payload.extend_from_slice(&(relation.num_rows() as u64).to_be_bytes());
+    for row in relation.rows() {
+        for value in row {
+            match value {
+                Value::Null => payload.push(VALUE_NULL),
+                Value::TypedValue(TypeContents::Integer(i)) => {
+                    payload.push(VALUE_INTEGER);
+                    payload.extend_from_slice(&i.to_be_bytes());
+                }
+                Value::TypedValue(TypeContents::String(s)) => {
+                    payload.push(VALUE_STRING);
+                    put_str(payload, s)?;
+                }
+            }
+        }
+    }
+    Ok(())
+}
+
+fn take<'a>(payload: &mut &'a [u8], len: usize) -> io::Result<&'a [u8]> {
+    if payload.len() < len {
+        return Err(invalid_data("truncated payload"));
+    }
+    let (taken, rest) = payload.split_at(len);
+    *payload = rest;
+    Ok(taken)
+}
+
+fn take_len(payload: &mut &[u8]) -> io::Result<usize> {
+    let bytes = take(payload, 4)?;
+    Ok(u32::from_be_bytes([bytes[0], bytes[1], bytes[2], bytes[3]]) as usize)
+}
+
+fn take_string(payload: &mut &[u8]) -> io::Result<String> {
+    let len = take_len(payload)?;
+    to_string(take(payload, len)?.to_vec())
+}
+
+fn take_relation(payload: &mut &[u8]) -> io::Result<Relation> {
+    let num_columns = take_len(payload)?;
+    let column_names = (0..num_columns)
+        .map(|_| take_string(payload))
+        .collect::<io::Result<Vec<_>>>()?;
+    let mut num_rows = [0; 8];
+    num_rows.copy_from_slice(take(payload, 8)?);
+    let num_rows = u64::from_be_bytes(num_rows);
+
+    let mut relation = Relation::default();
+    relation.reset(column_names);
+    let mut row = Vec::with_capacity(num_columns);
+    for _ in 0..num_rows {
+        for _ in 0..num_columns {
+            let value = match take(payload, 1)?[0] {
+                VALUE_NULL => Value::Null,
+                VALUE_INTEGER => {
+                    let mut integer = [0; 8];
+                    integer.copy_from_slice(take(payload, 8)?);
+                    IntegerStorage::from_be_bytes(integer).into()
+                }
+                VALUE_STRING => take_string(payload)?.into(),
+                _ => return Err(invalid_data("unknown value tag")),
+            };
+            row.push(value);
+        }
+        relation
+            .add_row(row.drain(..))
+            .map_err(|e| invalid_data(&e.to_string()))?;
+    }
+    Ok(relation)
+}
+
+fn to_string(bytes: Vec<u8>) -> io::Result<String> {
+    String::from_utf8(bytes).map_err(|_| invalid_data("invalid UTF-8"))
+}
+
+fn invalid_data(message: &str) -> io::Error {
+    io::Error::new(ErrorKind::InvalidData, message)
+}
+
+#[cfg(test)]
+mod tests {
+    use std::io::Cursor;
+
+    use super::{read_request, read_response, write_request, write_response, Request, Response};
+    use crate::{data_types::Value, relation::Relation};
+
+    #[test]
+    fn request_round_trip() {
+        let mut buffer = Vec::new();
+        write_request(&mut buffer, &Request::Query("SELECT 1".to_owned())).unwrap();
+        write_request(&mut buffer, &Request::Query("SELECT 2".to_owned())).unwrap();
+        let mut reader = Cursor::new(buffer);
+        assert_eq!(
+            read_request(&mut reader).unwrap(),
+            Some(Request::Query("SELECT 1".to_owned()))
+        );
+        assert_eq!(
+            read_request(&mut reader).unwrap(),
+            Some(Request::Query("SELECT 2".to_owned()))
+        );
+        assert_eq!(read_request(&mut reader).unwrap(), None);
+    }
+
+    #[test]
+    fn response_round_trip() {
+        let mut relation = Relation::new(vec!["id".to_owned(), "name".to_owned()]);
+        relation.add_row(vec![1.into(), "User".into()]).unwrap();
+        relation.add_row(vec![Value::Null, "".into()]).unwrap();
+
+        let mut buffer = Vec::new();
+        write_response(
+            &mut buffer,
+            &Response::Results(vec![relation, Relation::default()]),
+        )
+        .unwrap();
+        write_response(&mut buffer, &Response::Error("failed".to_owned())).unwrap();
+        let mut reader = Cursor::new(buffer);
+        match read_response(&mut reader).unwrap() {
+            Response::Results(relations) => {
+                assert_eq!(relations.len(), 2);
+                relations[0].assert_equals_ordered(
+                    vec![vec![1.into(), "User".into()], vec![Value::Null, "".into()]],
+                    vec!["id", "name"],
+                );
+                assert!(relations[1].is_empty());
+            }
+            Response::Error(e) => panic!("unexpected error {}", e),
+        }
+        assert!(matches!(read_response(&mut reader).unwrap(), Response::Error(e) if e == "failed"));
+        assert!(read_response(&mut reader).is_err());
+    }
+}
@@ -186,6 +186,8 @@ impl Columns {
 
 pub trait ColumnKey {
     fn get_entry(self, map: &IndexMap<String, ColumnEntry>) -> Result<&ColumnEntry>;
+
+    fn get_index(self, columns: &Columns) -> Result<usize>;
 }
 
 impl ColumnKey for usize {
@@ -194,6 +196,10 @@ impl ColumnKey for usize {
             .map(|(_k, v)| v)
             .ok_or_else(|| Error::Internal(format!("Could not get entry for index {}", self)))
     }
+
+    fn get_index(self, _columns: &Columns) -> Result<usize> {
+        Ok(self)
+    }
 }
 
 impl ColumnKey for &str {
@@ -201,6 +207,12 @@ impl ColumnKey for &str {
         map.get(self)
             .ok_or_else(|| ExecutionError::NoColumn(self.to_owned()).into())
     }
+
+    fn get_index(self, columns: &Columns) -> Result<usize> {
+        columns
+            .get_index(self)
+            .ok_or_else(|| ExecutionError::NoColumn(self.to_owned()).into())
+    }
 }
 
 fn append_unsized(dictionary_position: usize, bytes: &[u8], row: &mut Vec<u8>) {
@@ -248,6 +260,14 @@ impl TableColumns for (&Columns, &str) {
             Err(ExecutionError::NoColumn(format!("{}.{}", this_name.to_string(), column)).into())
         }
     }
+
+    fn column_type(&self, column: &ResolvedColumn) -> Option<Type> {
+        let (columns, this_name) = self;
+        if column.table_name() != *this_name {
+            return None;
+        }
+        columns.get_data_type(column.column_name())
+    }
 }
 
 #[cfg(test)]
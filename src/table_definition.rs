@@ -4,7 +4,7 @@ use serde::{Deserialize, Serialize};
 
 use crate::{
     ast::ColumnName,
-    data_types::Value,
+    data_types::{Type, Value},
     error::{ExecutionError, Result},
     resolved_expression::{Expression, ResolvedColumn},
     storage::Columns,
@@ -85,6 +85,26 @@ impl<C: Borrow<Columns>> TableDefinition<C> {
     }
 }
 
+impl TableDefinition<Columns> {
+    /// Adds a column after the existing columns, returning its index.
+    pub fn add_column(
+        &mut self,
+        name: String,
+        data_type: Type,
+        default: Option<Value>,
+        not_null: bool,
+    ) -> Result<usize> {
+        let index = self.columns.add_column(name, data_type)?;
+        if let Some(default) = default {
+            self.defaults.insert(index, default);
+        }
+        if not_null {
+            self.not_nulls.push(index);
+        }
+        Ok(index)
+    }
+}
+
 impl<C: Borrow<Columns>> Deref for TableDefinition<C> {
     type Target = Columns;
 
@@ -1,16 +1,35 @@
-use std::{borrow::Borrow, collections::HashSet, convert::TryInto, mem::size_of, ops::Deref};
+use std::{
+    borrow::Borrow,
+    collections::HashSet,
+    convert::TryInto,
+    mem::size_of,
+    num::NonZeroUsize,
+    ops::{Deref, Range},
+    sync::{
+        atomic::{AtomicUsize, Ordering},
+        Arc,
+    },
+    thread,
+};
 
 use auto_enums::auto_enum;
 use itertools::Itertools;
+use memmap2::Mmap;
 use sled::{Batch, IVec, Tree};
 
 use crate::{
     ast::ColumnName,
-    data_types::Value,
-    foreign_key::Action,
-    interpreter::{evaluate_expression, Interpreter},
+    bloom::KeyFilters,
+    data_types::{Type, Value},
+    foreign_key::{Action, Deletions},
+    frozen::{FrozenRows, FrozenTable},
+    index::Index,
+    interpreter::Interpreter,
+    partition::{hash_partition_key, Partitioning},
+    replication::Change,
     storage::{ColumnKey, Columns},
     table_definition::TableDefinition,
+    typed_expression::TypedExpression,
 };
 use crate::{
     error::{Error, ExecutionError, Result},
@@ -18,123 +37,698 @@ use crate::{
     GetData, TableColumns,
 };
 
+/// The key filter entry of rows with a null in the filter's columns. Encoded values are never empty.
+const NULL_FILTER_KEY: &[u8] = &[];
+
+/// Rows to be written to a table together by `TableHandler::apply_batch`.
+#[derive(Debug, Default)]
+pub struct RowBatch {
+    rows: Vec<(Vec<u8>, Vec<u8>)>,
+    /// The keys and old values of rows to remove, including updated rows that moved to another partition.
+    removed: Vec<(Vec<u8>, Vec<u8>)>,
+    /// The keys and old values of updated rows that stay in place, whose index entries are replaced.
+    replaced: Vec<(Vec<u8>, Vec<u8>)>,
+    /// The next key of each sequence of keys, read when the sequence is first used.
+    next_keys: Vec<Option<u64>>,
+    /// The values of inserted rows, whose unique constraints and foreign keys are checked when the batch is applied.
+    inserted: Vec<Vec<Value>>,
+    /// Updated rows and their new values, checked and acted on by foreign keys when the batch is applied.
+    updated: Vec<(TableRow, Vec<Value>)>,
+    /// Deleted rows, acted on by the foreign keys referring to them when the batch is applied.
+    deleted: Vec<TableRow>,
+    /// The foreign key whose cascading update the batch carries out. It isn't checked, as the updated rows refer to the
+    /// new values of rows that are written after the batch.
+    cascaded_key: Option<String>,
+}
+
+/// Where the rows of a table are stored.
+#[derive(Debug, Clone)]
+pub enum TableStorage {
+    /// A sled tree, which can be modified.
+    Tree(Tree),
+    /// An immutable, memory-mapped file written by `Interpreter::freeze_table`.
+    Frozen(Arc<FrozenTable>),
+    /// A sled tree for each partition, in the order of `partitioning`.
+    Partitioned {
+        partitioning: Partitioning,
+        column: usize,
+        trees: Vec<Tree>,
+    },
+}
+
 #[derive(Debug)]
 pub struct TableHandler<C: Borrow<Columns>, N: AsRef<str>> {
-    tree: Tree,
+    storage: TableStorage,
     table_definition: TableDefinition<C>,
+    /// The columns of the table before each time a column was added, oldest first. Rows written before the table was
+    /// altered keep the layout of their schema version, which is stored in their key.
+    schema_versions: Vec<Columns>,
+    /// The indexes of the table, including those still being built, which are maintained but not used by queries.
+    indexes: Vec<Index>,
+    /// The table's CHECK constraints, compiled once as they are evaluated for every row written.
+    checks: Vec<TypedExpression>,
     table_name: N,
     alias: Option<N>,
 }
 
 impl<C: Borrow<Columns>, N: AsRef<str>> TableHandler<C, N> {
     pub fn new(
-        tree: Tree,
+        storage: TableStorage,
         table_definition: TableDefinition<C>,
         table_name: N,
         alias: Option<N>,
     ) -> Self {
+        let columns = (table_definition.columns(), table_name.as_ref());
+        let checks = table_definition
+            .checks()
+            .map(|(check, _)| TypedExpression::compile(check, &columns))
+            .collect();
         Self {
-            tree,
+            storage,
             table_definition,
+            schema_versions: Vec::new(),
+            indexes: Vec::new(),
+            checks,
             table_name,
             alias,
         }
     }
 
+    pub fn with_schema_versions(mut self, schema_versions: Vec<Columns>) -> Self {
+        self.schema_versions = schema_versions;
+        self
+    }
+
+    pub fn with_indexes(mut self, indexes: Vec<Index>) -> Self {
+        self.indexes = indexes;
+        self
+    }
+
+    pub(crate) fn indexes(&self) -> &[Index] {
+        &self.indexes
+    }
+
+    /// Returns the key of the entry in `index` for the row with the key `key` and the encoded values `right`, or
+    /// `None` if the row doesn't match the index's predicate.
+    pub(crate) fn index_entry(
+        &self,
+        index: &Index,
+        key: &[u8],
+        right: &[u8],
+    ) -> Result<Option<Vec<u8>>> {
+        let row = EncodedRow {
+            handler: self,
+            version: schema_version(key),
+            right,
+        };
+        if let Some(predicate) = index.typed_predicate() {
+            if !predicate.evaluate(&row)?.is_true() {
+                return Ok(None);
+            }
+        }
+        let values = index
+            .typed_keys()
+            .iter()
+            .map(|key| key.evaluate(&row))
+            .collect::<Result<Vec<_>>>()?;
+        // The encoding of the values is never a prefix of the encoding of other values, so the entries for some
+        // values can be found by scanning for their encoding.
+        let mut entry = bincode::serialize(&values)?;
+        entry.extend_from_slice(key);
+        Ok(Some(entry))
+    }
+
+    /// Adds the index entries of the row with the key `key` and the encoded values `right`, or removes them if
+    /// `insert` is false.
+    fn write_index_entries(
+        &self,
+        key: &[u8],
+        right: &[u8],
+        insert: bool,
+        interpreter: &Interpreter,
+    ) -> Result<()> {
+        for index in &self.indexes {
+            let entry = match self.index_entry(index, key, right)? {
+                Some(entry) => entry,
+                None => continue,
+            };
+            let tree = index.tree();
+            if insert {
+                tree.insert(entry.as_slice(), &[])?;
+            } else {
+                tree.remove(entry.as_slice())?;
+            }
+            interpreter.write_counts().add(tree, 1);
+            interpreter.replication().record(tree, |tree| {
+                if insert {
+                    Change::Insert {
+                        tree,
+                        key: entry,
+                        value: Vec::new(),
+                    }
+                } else {
+                    Change::Remove { tree, key: entry }
+                }
+            });
+        }
+        Ok(())
+    }
+
     pub fn get_value<K: ColumnKey>(&self, column_name: K, row: &TableRow) -> Result<Value> {
-        self.table_definition.get_data(column_name, &row.right)
+        self.decode(column_name, schema_version(&row.left), &row.right)
+    }
+
+    /// Decodes a column of the encoded values `right`, written with the schema version `version`. Columns added after
+    /// the row was last written have their default value.
+    fn decode<K: ColumnKey>(&self, column_name: K, version: usize, right: &[u8]) -> Result<Value> {
+        if version == self.schema_versions.len() {
+            return self.table_definition.get_data(column_name, right);
+        }
+        let columns = self.schema_versions.get(version).ok_or_else(|| {
+            Error::Internal(format!("Row has unknown schema version {}", version))
+        })?;
+        let index = column_name.get_index(self.table_definition.columns())?;
+        if index < columns.num_columns() {
+            columns.get_data(index, right)
+        } else {
+            Ok(self.table_definition.get_default(index))
+        }
+    }
+
+    /// Returns the schema version of rows written now.
+    fn current_version(&self) -> usize {
+        self.schema_versions.len()
+    }
+
+    /// Returns the key of the row `id`, written with the current schema version.
+    fn row_key(&self, id: u64) -> Vec<u8> {
+        let mut key = id.to_be_bytes().to_vec();
+        if self.current_version() > 0 {
+            key.extend_from_slice(&(self.current_version() as u16).to_be_bytes());
+        }
+        key
+    }
+
+    /// Returns the row with the key `key`, if the table has one.
+    pub fn get_row(&self, key: &[u8]) -> Result<Option<TableRow>> {
+        for tree in self.trees()? {
+            if let Some(value) = tree.get(key)? {
+                return Ok(Some(TableRow::new(
+                    RowBytes::Tree(IVec::from(key)),
+                    RowBytes::Tree(value),
+                )));
+            }
+        }
+        Ok(None)
     }
 
     pub fn iter(&self) -> TableIter {
-        TableIter::new(self.tree.clone())
+        match &self.storage {
+            TableStorage::Tree(tree) => TableIter::new(tree.clone()),
+            TableStorage::Frozen(table) => TableIter::frozen(table),
+            TableStorage::Partitioned { trees, .. } => TableIter::partitions(trees.clone()),
+        }
     }
 
-    pub fn delete_row(&self, row: &TableRow, interpreter: &Interpreter) -> Result<()> {
-        for key in interpreter
-            .foreign_keys()?
-            .parent_foreign_keys(self.unaliased_table_name(), interpreter)
-        {
-            let key = key?;
-            key.check_parent_rows(&row, self, Action::Delete, interpreter)?;
+    /// Returns an iterator over the rows that could match `predicate`, skipping partitions that cannot hold any.
+    /// The rows returned still need to be filtered by `predicate`.
+    pub fn iter_where(&self, predicate: Option<&Expression>) -> TableIter {
+        if let Some(iter) = self.index_scan(predicate) {
+            return iter;
+        }
+        match self.matching_partitions(predicate) {
+            Some(trees) => TableIter::partitions(trees),
+            None => self.iter(),
+        }
+    }
+
+    /// Calls `f` on every row that could match `predicate`, scanning the partitions of a partitioned table on up to
+    /// one thread per core. Returns the results that are `Some`, in the same order as `iter_where`.
+    pub fn par_filter_map<T, F>(&self, predicate: Option<&Expression>, f: F) -> Result<Vec<T>>
+    where
+        T: Send,
+        F: Fn(&TableRow) -> Result<Option<T>> + Sync,
+    {
+        let scan = |iter: TableIter| -> Result<Vec<T>> {
+            let mut results = Vec::new();
+            for row in iter {
+                if let Some(result) = f(&row?)? {
+                    results.push(result);
+                }
+            }
+            Ok(results)
+        };
+        let trees = match self.matching_partitions(predicate) {
+            Some(trees) if trees.len() > 1 && self.index_for(predicate).is_none() => trees,
+            _ => return scan(self.iter_where(predicate)),
+        };
+        let num_threads = thread::available_parallelism()
+            .map_or(1, NonZeroUsize::get)
+            .min(trees.len());
+        let next_partition = AtomicUsize::new(0);
+        let mut partitions = thread::scope(|scope| {
+            let workers = (0..num_threads)
+                .map(|_| {
+                    scope.spawn(|| {
+                        let mut scanned = Vec::new();
+                        loop {
+                            let index = next_partition.fetch_add(1, Ordering::Relaxed);
+                            match trees.get(index) {
+                                Some(tree) => {
+                                    scanned.push((index, scan(TableIter::new(tree.clone()))?))
+                                }
+                                None => return Ok(scanned),
+                            }
+                        }
+                    })
+                })
+                .collect::<Vec<_>>();
+            workers
+                .into_iter()
+                .map(|worker| {
+                    worker.join().unwrap_or_else(|_| {
+                        Err(Error::Internal("Partition scan panicked".to_owned()))
+                    })
+                })
+                .collect::<Result<Vec<_>>>()
+        })?
+        .into_iter()
+        .flatten()
+        .collect::<Vec<_>>();
+        partitions.sort_unstable_by_key(|(index, _)| *index);
+        Ok(partitions
+            .into_iter()
+            .flat_map(|(_, results)| results)
+            .collect())
+    }
+
+    /// Returns a ready index that `predicate` can use, and the encoded values of the keys of the entries of the rows
+    /// that can match it.
+    fn index_for(&self, predicate: Option<&Expression>) -> Option<(&Index, Vec<u8>)> {
+        let predicate = predicate?;
+        self.indexes
+            .iter()
+            .filter(|index| index.is_ready())
+            .find_map(|index| {
+                let prefix = index.lookup(predicate, self.aliased_table_name(), self.columns())?;
+                Some((index, prefix))
+            })
+    }
+
+    /// Returns an iterator over the rows found with an index, if there is an index that `predicate` can use. Frozen
+    /// tables are always scanned.
+    fn index_scan(&self, predicate: Option<&Expression>) -> Option<TableIter> {
+        let (index, prefix) = self.index_for(predicate)?;
+        let trees = match &self.storage {
+            TableStorage::Tree(tree) => vec![tree.clone()],
+            TableStorage::Frozen(_) => return None,
+            TableStorage::Partitioned { .. } => self.matching_partitions(predicate)?,
+        };
+        Some(TableIter::index(index.tree().clone(), prefix, trees))
+    }
+
+    pub fn is_partitioned(&self) -> bool {
+        matches!(self.storage, TableStorage::Partitioned { .. })
+    }
+
+    fn matching_partitions(&self, predicate: Option<&Expression>) -> Option<Vec<Tree>> {
+        let (partitioning, trees) = match &self.storage {
+            TableStorage::Partitioned {
+                partitioning,
+                trees,
+                ..
+            } => (partitioning, trees),
+            _ => return None,
+        };
+        Some(match predicate {
+            Some(predicate) => trees
+                .iter()
+                .zip(partitioning.prune(predicate, self.aliased_table_name()))
+                .filter(|(_, matching)| *matching)
+                .map(|(tree, _)| tree.clone())
+                .collect(),
+            None => trees.clone(),
+        })
+    }
+
+    pub fn storage(&self) -> &TableStorage {
+        &self.storage
+    }
+
+    /// Returns an error if the table is frozen and so cannot be modified.
+    fn check_writable(&self) -> Result<()> {
+        match &self.storage {
+            TableStorage::Frozen(_) => {
+                Err(ExecutionError::FrozenTable(self.unaliased_table_name().to_owned()).into())
+            }
+            _ => Ok(()),
         }
-        self.tree.remove(&row.left)?;
+    }
+
+    /// Returns the index in `trees` of the tree that stores, or would store, the row with the encoded values `right`,
+    /// written with the schema version `version`.
+    fn tree_index(&self, version: usize, right: &[u8]) -> Result<usize> {
+        match &self.storage {
+            TableStorage::Tree(_) => Ok(0),
+            TableStorage::Frozen(_) => {
+                Err(ExecutionError::FrozenTable(self.unaliased_table_name().to_owned()).into())
+            }
+            TableStorage::Partitioned {
+                partitioning,
+                column,
+                ..
+            } => {
+                let value = self.decode(*column, version, right)?;
+                partitioning.find(&value).ok_or_else(|| {
+                    ExecutionError::RowOutsidePartitions(self.unaliased_table_name().to_owned())
+                        .into()
+                })
+            }
+        }
+    }
+
+    fn tree_for(&self, row: &TableRow) -> Result<&Tree> {
+        Ok(&self.trees()?[self.tree_index(schema_version(&row.left), &row.right)?])
+    }
+
+    fn is_hash_partitioned(&self) -> bool {
+        matches!(
+            self.storage,
+            TableStorage::Partitioned {
+                partitioning: Partitioning::Hash(_),
+                ..
+            }
+        )
+    }
+
+    /// Returns the next key of the row in the tree at `index` in `trees`. Each partition of a hash partitioned table
+    /// has its own sequence of keys, so inserts into different partitions don't read the same tree. Other tables have
+    /// a single sequence, so that keys are unique across partitions.
+    fn next_key(&self, index: usize) -> Result<u64> {
+        if self.is_hash_partitioned() {
+            Ok(match last_key(&self.trees()?[index])? {
+                Some(key) => key + 1,
+                None => hash_partition_key(index, 0),
+            })
+        } else {
+            self.generate_next_index()
+        }
+    }
+
+    /// Returns the next key of the row in the tree at `index`, continuing the keys already used by `batch`.
+    fn next_batch_key(&self, index: usize, batch: &mut RowBatch) -> Result<u64> {
+        let (sequence, num_sequences) = if self.is_hash_partitioned() {
+            (index, self.trees()?.len())
+        } else {
+            (0, 1)
+        };
+        batch.next_keys.resize(num_sequences, None);
+        let key = match batch.next_keys[sequence] {
+            Some(key) => key,
+            None => self.next_key(index)?,
+        };
+        batch.next_keys[sequence] = Some(key + 1);
+        Ok(key)
+    }
+
+    /// Returns every tree storing rows of the table.
+    pub(crate) fn trees(&self) -> Result<&[Tree]> {
+        match &self.storage {
+            TableStorage::Tree(tree) => Ok(std::slice::from_ref(tree)),
+            TableStorage::Frozen(_) => {
+                Err(ExecutionError::FrozenTable(self.unaliased_table_name().to_owned()).into())
+            }
+            TableStorage::Partitioned { trees, .. } => Ok(trees),
+        }
+    }
+
+    pub fn delete_row(&self, row: &TableRow, interpreter: &Interpreter) -> Result<()> {
+        let tree = self.tree_for(row)?;
+        self.check_delete(std::slice::from_ref(row), interpreter)?;
+        tree.remove(&row.left)?;
+        self.write_index_entries(&row.left, &row.right, false, interpreter)?;
+        interpreter.write_counts().add(tree, 1);
+        interpreter
+            .key_filters()
+            .remove(self.unaliased_table_name(), 1);
+        interpreter
+            .replication()
+            .record(tree, |tree| Change::Remove {
+                tree,
+                key: row.left.to_vec(),
+            });
         Ok(())
     }
 
-    fn update_get_left_right(
+    /// Adds the deletion of `row` to `batch`. Foreign key actions on rows referring to it are carried out for every
+    /// deleted row together when the batch is applied.
+    pub fn delete_row_batch(
         &self,
         row: TableRow,
         interpreter: &Interpreter,
-        new_row: Vec<Value>,
-    ) -> Result<(IVec, Vec<u8>)> {
-        self.check_row(&new_row, interpreter, Some(&row))?;
+        batch: &mut RowBatch,
+    ) -> Result<()> {
+        self.check_writable()?;
+        batch.removed.push((row.left.to_vec(), row.right.to_vec()));
+        batch.deleted.push(row);
+        interpreter
+            .key_filters()
+            .remove(self.unaliased_table_name(), 1);
+        Ok(())
+    }
+
+    /// Deletes `rows` in a single batch.
+    pub fn delete_rows(&self, rows: Vec<TableRow>, interpreter: &Interpreter) -> Result<()> {
+        let mut batch = RowBatch::default();
+        for row in rows {
+            self.delete_row_batch(row, interpreter, &mut batch)?;
+        }
+        self.apply_batch(batch, interpreter)
+    }
+
+    /// Carries out the actions of the foreign keys referring to `rows`, which are being deleted. Rows whose deletion
+    /// cascades from them are found level by level, each acted on in turn before any is deleted, and deleted before
+    /// `rows`, deepest first.
+    fn check_delete(&self, rows: &[TableRow], interpreter: &Interpreter) -> Result<()> {
+        if rows.is_empty() {
+            return Ok(());
+        }
+        let mut deletions = Deletions::new(self.unaliased_table_name(), rows);
+        self.act_on_delete(rows, &mut deletions, interpreter)?;
+        let mut cascaded = Vec::new();
+        while let Some((handler, rows)) = deletions.pop() {
+            handler.act_on_delete(&rows, &mut deletions, interpreter)?;
+            cascaded.push((handler, rows));
+        }
+        for (handler, rows) in cascaded.into_iter().rev() {
+            let mut batch = RowBatch::default();
+            for row in rows {
+                handler.delete_row_batch(row, interpreter, &mut batch)?;
+            }
+            handler.write_batch(batch, interpreter)?;
+        }
+        Ok(())
+    }
+
+    fn act_on_delete(
+        &self,
+        rows: &[TableRow],
+        deletions: &mut Deletions,
+        interpreter: &Interpreter,
+    ) -> Result<()> {
         for key in interpreter
             .foreign_keys()?
             .parent_foreign_keys(self.unaliased_table_name(), interpreter)
         {
             let key = key?;
-            key.check_parent_rows(&row, self, Action::Update(&new_row), interpreter)?;
+            key.check_parent_rows(rows, self, Action::Delete(deletions), interpreter)?;
         }
-        let right = self
-            .table_definition
-            .columns()
-            .generate_row(new_row.into_iter())?;
-        Ok((row.left, right))
+        Ok(())
     }
 
-    pub fn update_row(
+    /// Adds the update of `row` to `new_row` to `batch`. Its constraints are checked, and foreign key actions on rows
+    /// referring to it carried out, for every updated row together when the batch is applied.
+    pub fn update_row_batch(
         &self,
         row: TableRow,
         interpreter: &Interpreter,
         new_row: Vec<Value>,
+        batch: &mut RowBatch,
     ) -> Result<()> {
-        let (left, right) = self.update_get_left_right(row, interpreter, new_row)?;
-        self.tree.insert(left, right)?;
+        let old_version = schema_version(&row.left);
+        let outdated = old_version != self.current_version();
+        let old_right = match self.storage {
+            TableStorage::Partitioned { .. } => Some(row.right.to_vec()),
+            _ if outdated || !self.indexes.is_empty() => Some(row.right.to_vec()),
+            _ => None,
+        };
+        self.check_writable()?;
+        self.check_values(&new_row)?;
+        let right = self
+            .table_definition
+            .columns()
+            .generate_row(new_row.iter().cloned())?;
+        let left = row.left.clone();
+        batch.updated.push((row, new_row));
+        let mut key = self.row_key(row_id(&left)?);
+        if let Some(old_right) = old_right {
+            let index = self.tree_index(self.current_version(), &right)?;
+            let moved = self.tree_index(old_version, &old_right)? != index;
+            if moved || outdated {
+                batch.removed.push((left.to_vec(), old_right));
+            } else if !self.indexes.is_empty() {
+                batch.replaced.push((left.to_vec(), old_right));
+            }
+            if moved && self.is_hash_partitioned() {
+                key = self.row_key(self.next_batch_key(index, batch)?);
+            }
+        }
+        batch.rows.push((key, right));
+        interpreter
+            .key_filters()
+            .remove(self.unaliased_table_name(), 1);
         Ok(())
     }
 
-    pub fn update_row_batch(
+    /// Updates each row of `rows` to its new values in a single batch. `cascaded_key` is the foreign key whose
+    /// cascading update this carries out, if any.
+    pub fn update_rows(
         &self,
-        row: TableRow,
+        rows: Vec<(TableRow, Vec<Value>)>,
+        cascaded_key: Option<String>,
         interpreter: &Interpreter,
-        new_row: Vec<Value>,
-        batch: &mut Batch,
     ) -> Result<()> {
-        let (left, right) = self.update_get_left_right(row, interpreter, new_row)?;
-        batch.insert(left, right);
-        Ok(())
+        let mut batch = RowBatch {
+            cascaded_key,
+            ..Default::default()
+        };
+        for (row, new_row) in rows {
+            self.update_row_batch(row, interpreter, new_row, &mut batch)?;
+        }
+        self.apply_batch(batch, interpreter)
     }
 
-    pub fn insert_values(&self, values: Vec<Value>, interpreter: &Interpreter) -> Result<()> {
+    /// Inserts a row with `values`, returning its key.
+    pub fn insert_values(&self, values: Vec<Value>, interpreter: &Interpreter) -> Result<Vec<u8>> {
+        self.check_writable()?;
         self.check_row(&values, interpreter, None)?;
-        let key = self.generate_next_index()?;
         let value = self
             .table_definition
             .columns()
             .generate_row(values.into_iter())?;
-        self.tree.insert(key.to_be_bytes(), value)?;
-        Ok(())
+        let index = self.tree_index(self.current_version(), &value)?;
+        let tree = &self.trees()?[index];
+        let key = self.row_key(self.next_key(index)?);
+        tree.insert(key.as_slice(), value.as_slice())?;
+        interpreter.write_counts().add(tree, 1);
+        self.write_index_entries(&key, &value, true, interpreter)?;
+        self.add_to_key_filters(
+            std::iter::once((key.as_slice(), value.as_slice())),
+            interpreter,
+        )?;
+        interpreter
+            .replication()
+            .record(tree, |tree| Change::Insert {
+                tree,
+                key: key.clone(),
+                value,
+            });
+        Ok(key)
     }
 
-    pub fn insert_values_batch(
-        &self,
-        values: Vec<Value>,
-        interpreter: &Interpreter,
-        batch: &mut Batch,
-        key: &mut u64,
-    ) -> Result<()> {
-        self.check_row(&values, interpreter, None)?;
+    /// Adds the insertion of `values` to `batch`. Unique constraints and foreign keys are checked for every row of the
+    /// batch when it is applied, so rows inserted together may refer to each other.
+    pub fn insert_values_batch(&self, values: Vec<Value>, batch: &mut RowBatch) -> Result<()> {
+        self.check_writable()?;
+        self.check_values(&values)?;
         let value = self
             .table_definition
             .columns()
-            .generate_row(values.into_iter())?;
-        batch.insert(&key.to_be_bytes(), value);
-        *key += 1;
+            .generate_row(values.iter().cloned())?;
+        batch.inserted.push(values);
+        let index = self.tree_index(self.current_version(), &value)?;
+        let key = self.row_key(self.next_batch_key(index, batch)?);
+        batch.rows.push((key, value));
         Ok(())
     }
 
-    pub fn apply_batch(&self, batch: Batch) -> Result<()> {
-        self.tree.apply_batch(batch)?;
+    pub fn apply_batch(&self, batch: RowBatch, interpreter: &Interpreter) -> Result<()> {
+        self.check_deferred(&batch, interpreter)?;
+        self.write_batch(batch, interpreter)
+    }
+
+    /// Writes `batch` without checking its constraints or acting on the foreign keys referring to its rows.
+    fn write_batch(&self, batch: RowBatch, interpreter: &Interpreter) -> Result<()> {
+        let trees = self.trees()?;
+        let mut sled_batches = vec![Batch::default(); trees.len()];
+        let mut batch_lens = vec![0; trees.len()];
+        let mut changes = Vec::with_capacity(batch.removed.len() + batch.rows.len());
+        // Entries are removed before they are inserted, so an entry that an update leaves unchanged is kept.
+        let mut index_batches = vec![Batch::default(); self.indexes.len()];
+        let mut index_changes = Vec::new();
+        let removed_rows = batch.removed.iter().chain(&batch.replaced);
+        for (inserted, (key, value)) in removed_rows
+            .map(|row| (false, row))
+            .chain(batch.rows.iter().map(|row| (true, row)))
+        {
+            for (position, index) in self.indexes.iter().enumerate() {
+                let entry = match self.index_entry(index, key, value)? {
+                    Some(entry) => entry,
+                    None => continue,
+                };
+                if inserted {
+                    index_batches[position].insert(entry.as_slice(), &[]);
+                } else {
+                    index_batches[position].remove(entry.as_slice());
+                }
+                index_changes.push((position, entry, inserted));
+            }
+        }
+        for (key, old_value) in batch.removed {
+            let index = self.tree_index(schema_version(&key), &old_value)?;
+            sled_batches[index].remove(key.as_slice());
+            batch_lens[index] += 1;
+            changes.push((index, key, None));
+        }
+        for (key, value) in batch.rows {
+            let index = self.tree_index(schema_version(&key), &value)?;
+            sled_batches[index].insert(key.as_slice(), value.as_slice());
+            batch_lens[index] += 1;
+            changes.push((index, key, Some(value)));
+        }
+        for ((tree, sled_batch), batch_len) in trees.iter().zip(sled_batches).zip(batch_lens) {
+            tree.apply_batch(sled_batch)?;
+            interpreter.write_counts().add(tree, batch_len);
+        }
+        let inserted = changes
+            .iter()
+            .filter_map(|(_, key, value)| Some((key.as_slice(), value.as_deref()?)));
+        self.add_to_key_filters(inserted, interpreter)?;
+        for (index, index_batch) in self.indexes.iter().zip(index_batches) {
+            index.tree().apply_batch(index_batch)?;
+        }
+        let replication = interpreter.replication();
+        for (index, key, value) in changes {
+            replication.record(&trees[index], |tree| match value {
+                Some(value) => Change::Insert { tree, key, value },
+                None => Change::Remove { tree, key },
+            });
+        }
+        for (position, key, inserted) in index_changes {
+            let tree = self.indexes[position].tree();
+            interpreter.write_counts().add(tree, 1);
+            replication.record(tree, |tree| {
+                if inserted {
+                    Change::Insert {
+                        tree,
+                        key,
+                        value: Vec::new(),
+                    }
+                } else {
+                    Change::Remove { tree, key }
+                }
+            });
+        }
         Ok(())
     }
 
@@ -173,8 +767,31 @@ impl<C: Borrow<Columns>, N: AsRef<str>> TableHandler<C, N> {
         interpreter: &Interpreter,
         exclude: Option<&TableRow>,
     ) -> Result<()> {
-        for (check, name) in self.table_definition.checks() {
-            if !evaluate_expression(check, &(self, row))?.is_true() {
+        self.check_values(row)?;
+        // Unique column sets whose values the table's key filter has never seen cannot conflict.
+        let mut uniques = Vec::new();
+        for (unique_set, name) in self.uniques() {
+            let values = unique_set.iter().map(|&i| &row[i]).collect::<Vec<_>>();
+            if self.may_contain_key(unique_set, &values, false, interpreter)? {
+                uniques.push((unique_set, name));
+            }
+        }
+        let exclude = exclude.iter().map(|row| &*row.left).collect();
+        self.check_unique_scan(row, &uniques, &exclude)?;
+        for foreign_key in interpreter.foreign_keys()?.child_foreign_keys(
+            self.unaliased_table_name(),
+            self.table_definition.columns(),
+            interpreter,
+        ) {
+            foreign_key?.check_row_contains(row, interpreter)?;
+        }
+        Ok(())
+    }
+
+    /// Checks the constraints of `row` that don't depend on other rows.
+    fn check_values(&self, row: &[Value]) -> Result<()> {
+        for (check, (_, name)) in self.checks.iter().zip(self.table_definition.checks()) {
+            if !check.evaluate(&(self, row))?.is_true() {
                 return Err(ExecutionError::CheckConstraintFailed(name.to_owned()).into());
             }
         }
@@ -191,14 +808,26 @@ impl<C: Borrow<Columns>, N: AsRef<str>> TableHandler<C, N> {
                 .into());
             }
         }
+        Ok(())
+    }
+
+    /// Scans the table for a row, other than those with the keys in `exclude`, with the same values as `row` in one of
+    /// `uniques`.
+    fn check_unique_scan(
+        &self,
+        row: &[Value],
+        uniques: &[(&[usize], &str)],
+        exclude: &HashSet<&[u8]>,
+    ) -> Result<()> {
+        if uniques.is_empty() {
+            return Ok(());
+        }
         for tree_row in self.iter() {
             let tree_row = tree_row?;
-            if let Some(exclude) = exclude {
-                if &tree_row == exclude {
-                    continue;
-                }
+            if exclude.contains(&*tree_row.left) {
+                continue;
             }
-            for (unique_set, name) in self.uniques() {
+            for &(unique_set, name) in uniques {
                 let mut identical = true;
                 for &index in unique_set {
                     let other_value = self.get_value(index, &tree_row)?;
@@ -212,11 +841,196 @@ impl<C: Borrow<Columns>, N: AsRef<str>> TableHandler<C, N> {
                 }
             }
         }
-        for foreign_key in interpreter
+        Ok(())
+    }
+
+    /// Checks the unique constraints and foreign keys of the rows inserted or updated by `batch`, and carries out the
+    /// actions of the foreign keys referring to the rows it updates or deletes, deferred until every row of the batch
+    /// is known. Each constraint is verified for all the rows at once: their keys are collected into a hash set, which
+    /// finds duplicates among them, and the table is scanned at most once for the keys it already holds. Rows of the
+    /// batch may refer to each other.
+    fn check_deferred(&self, batch: &RowBatch, interpreter: &Interpreter) -> Result<()> {
+        self.check_delete(&batch.deleted, interpreter)?;
+        let rows = batch
+            .inserted
+            .iter()
+            .map(Vec::as_slice)
+            .chain(batch.updated.iter().map(|(_, new_row)| new_row.as_slice()))
+            .collect::<Vec<_>>();
+        if rows.is_empty() {
+            return Ok(());
+        }
+        // Updated rows are compared with their new values only.
+        let updated = batch
+            .updated
+            .iter()
+            .map(|(row, _)| &*row.left)
+            .collect::<HashSet<_>>();
+        for (unique_set, name) in self.uniques() {
+            self.check_unique_rows(&rows, &updated, unique_set, name, interpreter)?;
+        }
+        for foreign_key in interpreter.foreign_keys()?.child_foreign_keys(
+            self.unaliased_table_name(),
+            self.table_definition.columns(),
+            interpreter,
+        ) {
+            let foreign_key = foreign_key?;
+            if batch.cascaded_key.as_deref() != Some(foreign_key.name()) {
+                foreign_key.check_rows_contain(&rows, self.unaliased_table_name(), interpreter)?;
+            }
+        }
+        if batch.updated.is_empty() {
+            return Ok(());
+        }
+        let parent_keys = interpreter
             .foreign_keys()?
-            .child_foreign_keys(self.unaliased_table_name(), interpreter)
-        {
-            foreign_key?.check_row_contains(row)?;
+            .parent_foreign_keys(self.unaliased_table_name(), interpreter)
+            .collect::<Result<Vec<_>>>()?;
+        if !parent_keys.is_empty() {
+            let (old_rows, new_rows): (Vec<_>, Vec<_>) = batch.updated.iter().cloned().unzip();
+            for key in parent_keys {
+                key.check_parent_rows(&old_rows, self, Action::Update(&new_rows), interpreter)?;
+            }
+        }
+        Ok(())
+    }
+
+    fn check_unique_rows(
+        &self,
+        rows: &[&[Value]],
+        updated: &HashSet<&[u8]>,
+        unique_set: &[usize],
+        name: &str,
+        interpreter: &Interpreter,
+    ) -> Result<()> {
+        let conflict = || Err(ExecutionError::UniqueConstraintFailed(name.to_owned()).into());
+        let mut keys = HashSet::with_capacity(rows.len());
+        let mut candidates = HashSet::new();
+        for (position, row) in rows.iter().enumerate() {
+            let key = unique_set.iter().map(|&i| &row[i]).collect::<Vec<_>>();
+            if key.iter().any(|value| value.is_null()) {
+                continue;
+            }
+            if !self.has_column_types(unique_set, &key)? {
+                // Values of another type compare equal to values with different encodings, so can't be hashed.
+                let identical = |other: &&[Value]| {
+                    unique_set
+                        .iter()
+                        .all(|&i| row[i].compare(&other[i]).is_equal())
+                };
+                if rows[..position]
+                    .iter()
+                    .chain(&rows[position + 1..])
+                    .any(identical)
+                {
+                    return conflict();
+                }
+                self.check_unique_scan(row, &[(unique_set, name)], updated)?;
+                continue;
+            }
+            if self.may_contain_key(unique_set, &key, false, interpreter)? {
+                candidates.insert(key.clone());
+            }
+            if !keys.insert(key) {
+                return conflict();
+            }
+        }
+        if candidates.is_empty() {
+            return Ok(());
+        }
+        for tree_row in self.iter() {
+            let tree_row = tree_row?;
+            if updated.contains(&*tree_row.left) {
+                continue;
+            }
+            let version = schema_version(&tree_row.left);
+            let key = unique_set
+                .iter()
+                .map(|&i| self.decode(i, version, &tree_row.right))
+                .collect::<Result<Vec<_>>>()?;
+            if candidates.contains(&key.iter().collect::<Vec<_>>()) {
+                return conflict();
+            }
+        }
+        Ok(())
+    }
+
+    /// Returns whether each of `values` has the type of its column in `columns`, so isn't null.
+    pub(crate) fn has_column_types(&self, columns: &[usize], values: &[&Value]) -> Result<bool> {
+        for (&column, value) in columns.iter().zip(values) {
+            let column_type = self
+                .table_definition
+                .get_data_type(self.table_definition.column_name(column)?);
+            match value {
+                Value::TypedValue(contents) if Some(contents.get_type()) == column_type => {}
+                _ => return Ok(false),
+            }
+        }
+        Ok(true)
+    }
+
+    /// Returns false if no row of the table has `values` in `columns`, according to the table's key filter. If
+    /// `nulls_match`, rows with a null in `columns` are taken to have every value, as foreign keys compare them.
+    /// Values that are null or don't have the column's type cannot be looked up, as they compare equal to values with
+    /// different encodings, so the table may contain them.
+    pub(crate) fn may_contain_key(
+        &self,
+        columns: &[usize],
+        values: &[&Value],
+        nulls_match: bool,
+        interpreter: &Interpreter,
+    ) -> Result<bool> {
+        if !self.has_column_types(columns, values)? {
+            return Ok(true);
+        }
+        let may_contain = |key: &[u8]| {
+            interpreter
+                .key_filters()
+                .may_contain(self.unaliased_table_name(), columns, key, || {
+                    self.iter()
+                        .map(|row| {
+                            let row = row?;
+                            self.filter_key(columns, &row.left, &row.right)
+                        })
+                        .collect()
+                })
+        };
+        let key = bincode::serialize(values)?;
+        Ok(match may_contain(&key)? {
+            Some(true) | None => true,
+            Some(false) => nulls_match && may_contain(NULL_FILTER_KEY)? != Some(false),
+        })
+    }
+
+    /// Encodes the values in `columns` of the row with the key `left` and encoded values `right`, as looked up in the
+    /// table's key filters. Rows with a null in `columns` all have the key `NULL_FILTER_KEY`.
+    fn filter_key(&self, columns: &[usize], left: &[u8], right: &[u8]) -> Result<Vec<u8>> {
+        let version = schema_version(left);
+        let values = columns
+            .iter()
+            .map(|&column| self.decode(column, version, right))
+            .collect::<Result<Vec<_>>>()?;
+        if values.iter().any(Value::is_null) {
+            return Ok(NULL_FILTER_KEY.to_vec());
+        }
+        Ok(bincode::serialize(&values)?)
+    }
+
+    /// Adds the written rows `rows` to the table's key filters that have been built.
+    fn add_to_key_filters<'a, I>(&self, rows: I, interpreter: &Interpreter) -> Result<()>
+    where
+        I: IntoIterator<Item = (&'a [u8], &'a [u8])>,
+    {
+        let column_sets = interpreter
+            .key_filters()
+            .column_sets(self.unaliased_table_name());
+        if column_sets.is_empty() {
+            return Ok(());
+        }
+        for (left, right) in rows {
+            for (columns, slot) in &column_sets {
+                KeyFilters::insert(slot, &self.filter_key(columns, left, right)?);
+            }
         }
         Ok(())
     }
@@ -232,18 +1046,38 @@ impl<C: Borrow<Columns>, N: AsRef<str>> TableHandler<C, N> {
             .unwrap_or_else(|| self.table_name.as_ref())
     }
 
+    /// Returns a key greater than every key in the table. Keys are unique across all partitions of a table.
     pub fn generate_next_index(&self) -> Result<u64> {
-        if let Some((last_key, _)) = self.tree.last()? {
-            let bytes = last_key
-                .get(..size_of::<u64>())
-                .ok_or_else(|| Error::Internal("Key is wrong number of bytes".to_owned()))?
-                .try_into()
-                .unwrap();
-            let value = u64::from_be_bytes(bytes) + 1;
-            Ok(value)
-        } else {
-            Ok(0u64)
+        let mut next = 0u64;
+        for tree in self.trees()? {
+            if let Some(key) = last_key(tree)? {
+                next = next.max(key + 1);
+            }
         }
+        Ok(next)
+    }
+}
+
+fn last_key(tree: &Tree) -> Result<Option<u64>> {
+    tree.last()?.map(|(key, _)| row_id(&key)).transpose()
+}
+
+/// Returns the id of the row with the key `key`, which is unique across all partitions of a table.
+fn row_id(key: &[u8]) -> Result<u64> {
+    let bytes = key
+        .get(..size_of::<u64>())
+        .ok_or_else(|| Error::Internal("Key is wrong number of bytes".to_owned()))?
+        .try_into()
+        .unwrap();
+    Ok(u64::from_be_bytes(bytes))
+}
+
+/// Returns the schema version a row was written with. Rows written before the table was first altered have no
+/// version in their key.
+fn schema_version(key: &[u8]) -> usize {
+    match key.get(size_of::<u64>()..) {
+        Some([high, low]) => u16::from_be_bytes([*high, *low]) as usize,
+        _ => 0,
     }
 }
 
@@ -255,21 +1089,72 @@ impl<C: Borrow<Columns>, N: AsRef<str>> Deref for TableHandler<C, N> {
     }
 }
 
+/// Iterates over the rows of one or more trees or frozen tables, one after another.
 pub struct TableIter {
-    iter: sled::Iter,
+    sources: Vec<RowSource>,
+    next_source: usize,
+    rows: Option<Rows>,
+}
+
+enum RowSource {
+    Tree(Tree),
+    Frozen(Arc<FrozenTable>),
+    /// The rows whose keys follow `prefix` in the keys of an index, found in one of `trees`.
+    Index {
+        index: Tree,
+        prefix: Vec<u8>,
+        trees: Vec<Tree>,
+    },
+}
+
+enum Rows {
+    Tree(sled::Iter),
+    Frozen(FrozenRows),
+    Index {
+        entries: sled::Iter,
+        prefix_len: usize,
+        trees: Vec<Tree>,
+    },
 }
 
 impl TableIter {
     pub fn new(tree: Tree) -> Self {
-        Self { iter: tree.iter() }
+        Self::from_sources(vec![RowSource::Tree(tree)])
+    }
+
+    pub fn frozen(table: &Arc<FrozenTable>) -> Self {
+        Self::from_sources(vec![RowSource::Frozen(table.clone())])
+    }
+
+    pub fn partitions(trees: Vec<Tree>) -> Self {
+        Self::from_sources(trees.into_iter().map(RowSource::Tree).collect())
+    }
+
+    /// Returns an iterator over the rows with an entry in `index` starting with `prefix`, stored in one of `trees`.
+    pub(crate) fn index(index: Tree, prefix: Vec<u8>, trees: Vec<Tree>) -> Self {
+        Self::from_sources(vec![RowSource::Index {
+            index,
+            prefix,
+            trees,
+        }])
+    }
+
+    fn from_sources(sources: Vec<RowSource>) -> Self {
+        Self {
+            sources,
+            next_source: 0,
+            rows: None,
+        }
+    }
+
+    /// Moves back to the first row.
+    pub fn restart(&mut self) {
+        self.next_source = 0;
+        self.rows = None;
     }
 
     pub fn get_next(&mut self) -> Result<Option<TableRow>> {
-        Ok(self
-            .iter
-            .next()
-            .transpose()?
-            .map(|(left, right)| TableRow::new(left, right)))
+        self.next().transpose()
     }
 
     pub fn filter_where<'a, C: Borrow<Columns>, N: AsRef<str>>(
@@ -277,9 +1162,10 @@ impl TableIter {
         predicate: &'a Expression,
         handler: &'a TableHandler<C, N>,
     ) -> impl Iterator<Item = Result<TableRow>> + 'a {
+        let predicate = TypedExpression::compile(predicate, handler);
         self.filter(move |r| {
             if let Ok(row) = r {
-                if let Ok(evaluated) = evaluate_expression(predicate, &(handler, row)) {
+                if let Ok(evaluated) = predicate.evaluate(&(handler, row)) {
                     return evaluated.is_true();
                 }
             }
@@ -292,34 +1178,143 @@ impl Iterator for TableIter {
     type Item = Result<TableRow>;
 
     fn next(&mut self) -> Option<Self::Item> {
-        Some(
-            self.iter
-                .next()?
-                .map(|(left, right)| TableRow::new(left, right))
-                .map_err(Into::into),
-        )
+        loop {
+            let next = match &mut self.rows {
+                Some(Rows::Tree(iter)) => iter.next().map(|row| {
+                    row.map(|(left, right)| {
+                        TableRow::new(RowBytes::Tree(left), RowBytes::Tree(right))
+                    })
+                    .map_err(Into::into)
+                }),
+                Some(Rows::Frozen(iter)) => iter
+                    .next()
+                    .map(|row| row.map(|(left, right)| TableRow::new(left, right))),
+                Some(Rows::Index {
+                    entries,
+                    prefix_len,
+                    trees,
+                }) => match next_indexed_row(entries, *prefix_len, trees) {
+                    Ok(Some(row)) => Some(Ok(row)),
+                    Ok(None) => None,
+                    Err(error) => Some(Err(error)),
+                },
+                None => None,
+            };
+            if next.is_some() {
+                return next;
+            }
+            self.rows = Some(match self.sources.get(self.next_source)? {
+                RowSource::Tree(tree) => Rows::Tree(tree.iter()),
+                RowSource::Frozen(table) => Rows::Frozen(table.rows()),
+                RowSource::Index {
+                    index,
+                    prefix,
+                    trees,
+                } => Rows::Index {
+                    entries: index.scan_prefix(prefix),
+                    prefix_len: prefix.len(),
+                    trees: trees.clone(),
+                },
+            });
+            self.next_source += 1;
+        }
     }
 }
 
-#[derive(Default, Clone)]
+/// A row being written, whose columns are read by the expressions of indexes. Index expressions only refer to the
+/// columns of their table, so the table name of each column is not checked.
+struct EncodedRow<'a, C: Borrow<Columns>, N: AsRef<str>> {
+    handler: &'a TableHandler<C, N>,
+    version: usize,
+    right: &'a [u8],
+}
+
+impl<C: Borrow<Columns>, N: AsRef<str>> GetData for EncodedRow<'_, C, N> {
+    fn get_data(&self, column_name: &ResolvedColumn) -> Result<Value> {
+        self.handler
+            .decode(column_name.column_name(), self.version, self.right)
+    }
+}
+
+/// Returns the row of the next entry of an index, skipping entries whose row was deleted after the entry was read.
+fn next_indexed_row(
+    entries: &mut sled::Iter,
+    prefix_len: usize,
+    trees: &[Tree],
+) -> Result<Option<TableRow>> {
+    for entry in entries {
+        let (entry, _) = entry?;
+        let key = IVec::from(&entry[prefix_len..]);
+        for tree in trees {
+            if let Some(value) = tree.get(&key)? {
+                return Ok(Some(TableRow::new(
+                    RowBytes::Tree(key),
+                    RowBytes::Tree(value),
+                )));
+            }
+        }
+    }
+    Ok(None)
+}
+
+/// The key or value of a row, either owned by sled or referring to the mapping of a frozen table.
+#[derive(Debug, Clone)]
+pub enum RowBytes {
+    Tree(IVec),
+    Mapped(Arc<Mmap>, Range<usize>),
+}
+
+impl Default for RowBytes {
+    fn default() -> Self {
+        Self::Tree(IVec::default())
+    }
+}
+
+impl Deref for RowBytes {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        match self {
+            RowBytes::Tree(bytes) => bytes,
+            RowBytes::Mapped(map, range) => &map[range.clone()],
+        }
+    }
+}
+
+impl AsRef<[u8]> for RowBytes {
+    fn as_ref(&self) -> &[u8] {
+        self
+    }
+}
+
+#[derive(Debug, Default, Clone)]
 pub struct TableRow {
-    left: IVec,
-    right: IVec,
+    left: RowBytes,
+    right: RowBytes,
 }
 
 impl TableRow {
-    fn new(left: IVec, right: IVec) -> Self {
+    fn new(left: RowBytes, right: RowBytes) -> Self {
         Self { left, right }
     }
 
     pub fn is_empty(&self) -> bool {
         self.left.is_empty() && self.right.is_empty()
     }
+
+    /// Returns the key of the row in its tree.
+    pub fn key(&self) -> &[u8] {
+        &self.left
+    }
+
+    pub fn into_parts(self) -> (RowBytes, RowBytes) {
+        (self.left, self.right)
+    }
 }
 
 impl PartialEq for &TableRow {
     fn eq(&self, other: &Self) -> bool {
-        self.left == other.left
+        *self.left == *other.left
     }
 }
 
@@ -402,6 +1397,13 @@ impl<C: Borrow<Columns>, N: AsRef<str>> TableColumns for TableHandler<C, N> {
         }
         Err(Error::Execution(ExecutionError::NoColumn(column_name)))
     }
+
+    fn column_type(&self, column: &ResolvedColumn) -> Option<Type> {
+        if column.table_name() != self.aliased_table_name() {
+            return None;
+        }
+        self.table_definition.get_data_type(column.column_name())
+    }
 }
 
 impl<'a, C: Borrow<Columns>, N: AsRef<str>> GetData for (&'a TableHandler<C, N>, &'a TableRow) {
@@ -412,9 +1414,11 @@ impl<'a, C: Borrow<Columns>, N: AsRef<str>> GetData for (&'a TableHandler<C, N>,
         }
 
         if column_name.table_name() == handler.aliased_table_name() {
-            handler
-                .table_definition
-                .get_data(column_name.column_name(), &row.right)
+            handler.decode(
+                column_name.column_name(),
+                schema_version(&row.left),
+                &row.right,
+            )
         } else {
             Err(Error::Internal(format!(
                 "Table name resolved incorrectly for Single Table Row: {}",
@@ -1535,3 +1535,1543 @@ fn update_self_referential() {
         vec!["name", "age"],
     )
 }
+
+#[test]
+fn c_column_batch_fetch() {
+    use crate::c_interface::{
+        close_db, close_row_set, execute_query, get_int_column, get_string_column,
+        temp_db as c_temp_db, Db, ROW_SET_INIT, STARDUST_DB_BUFFER_TOO_SMALL, STARDUST_DB_END,
+        STARDUST_DB_OK, STARDUST_DB_VALUE_NULL,
+    };
+    use std::{ffi::CString, ptr::null_mut};
+
+    unsafe {
+        let mut db = Db::Ordinary(null_mut());
+        assert_eq!(c_temp_db(&mut db), STARDUST_DB_OK);
+        let mut row_set = ROW_SET_INIT;
+        let mut err_buff = [0; 128];
+        let query = CString::new(
+            "CREATE TABLE test (name string, age int);
+            INSERT INTO test VALUES ('User', 23), (NULL, 27), ('User3', NULL);
+            SELECT name, age FROM test",
+        )
+        .unwrap();
+        assert_eq!(
+            execute_query(
+                &mut db,
+                query.as_ptr(),
+                &mut row_set,
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_OK
+        );
+
+        let mut ages = [0; 4];
+        let mut nulls = [0; 4];
+        let mut fetched = 0;
+        assert_eq!(
+            get_int_column(
+                &row_set,
+                1,
+                0,
+                4,
+                ages.as_mut_ptr(),
+                nulls.as_mut_ptr(),
+                &mut fetched
+            ),
+            STARDUST_DB_OK
+        );
+        assert_eq!(fetched, 3);
+        assert_eq!(&ages[..3], &[23, 27, 0]);
+        assert_eq!(&nulls[..3], &[0, 0, 1]);
+        assert_eq!(
+            get_int_column(
+                &row_set,
+                1,
+                0,
+                4,
+                ages.as_mut_ptr(),
+                null_mut(),
+                &mut fetched
+            ),
+            STARDUST_DB_VALUE_NULL
+        );
+        assert_eq!(fetched, 2);
+        assert_eq!(
+            get_int_column(
+                &row_set,
+                1,
+                3,
+                4,
+                ages.as_mut_ptr(),
+                null_mut(),
+                &mut fetched
+            ),
+            STARDUST_DB_END
+        );
+
+        let mut offsets = [0; 4];
+        let mut data = [0; 16];
+        assert_eq!(
+            get_string_column(
+                &row_set,
+                0,
+                0,
+                3,
+                offsets.as_mut_ptr(),
+                data.as_mut_ptr(),
+                data.len(),
+                nulls.as_mut_ptr(),
+                &mut fetched
+            ),
+            STARDUST_DB_OK
+        );
+        assert_eq!(fetched, 3);
+        assert_eq!(offsets, [0, 4, 4, 9]);
+        assert_eq!(&nulls[..3], &[0, 1, 0]);
+        let data = data.iter().map(|&c| c as u8).collect::<Vec<_>>();
+        assert_eq!(&data[..9], b"UserUser3");
+
+        let mut small = [0; 6];
+        assert_eq!(
+            get_string_column(
+                &row_set,
+                0,
+                0,
+                3,
+                offsets.as_mut_ptr(),
+                small.as_mut_ptr(),
+                small.len(),
+                nulls.as_mut_ptr(),
+                &mut fetched
+            ),
+            STARDUST_DB_OK
+        );
+        assert_eq!(fetched, 2);
+        assert_eq!(
+            get_string_column(
+                &row_set,
+                0,
+                2,
+                1,
+                offsets.as_mut_ptr(),
+                small.as_mut_ptr(),
+                3,
+                nulls.as_mut_ptr(),
+                &mut fetched
+            ),
+            STARDUST_DB_BUFFER_TOO_SMALL
+        );
+
+        close_row_set(&mut row_set);
+        close_db(&mut db);
+    }
+}
+
+#[test]
+fn c_string_ref() {
+    use crate::c_interface::{
+        close_db, close_row_set, execute_query, get_string_index, get_string_len_named,
+        get_string_ref_index, get_string_ref_named, temp_db as c_temp_db, Db, ROW_SET_INIT,
+        STARDUST_DB_BUFFER_TOO_SMALL, STARDUST_DB_OK, STARDUST_DB_VALUE_WRONG_TYPE,
+    };
+    use std::{ffi::CString, ptr::null, ptr::null_mut, slice};
+
+    unsafe {
+        let mut db = Db::Ordinary(null_mut());
+        assert_eq!(c_temp_db(&mut db), STARDUST_DB_OK);
+        let mut row_set = ROW_SET_INIT;
+        let mut err_buff = [0; 128];
+        let query = CString::new(
+            "CREATE TABLE test (name string, age int);
+            INSERT INTO test VALUES ('User', 23);
+            SELECT name, age FROM test",
+        )
+        .unwrap();
+        assert_eq!(
+            execute_query(
+                &mut db,
+                query.as_ptr(),
+                &mut row_set,
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_OK
+        );
+
+        let mut string_ptr = null();
+        let mut string_len = 0;
+        assert_eq!(
+            get_string_ref_index(&row_set, 0, &mut string_ptr, &mut string_len),
+            STARDUST_DB_OK
+        );
+        assert_eq!(
+            slice::from_raw_parts(string_ptr as *const u8, string_len),
+            b"User"
+        );
+        assert_eq!(
+            get_string_ref_index(&row_set, 1, &mut string_ptr, &mut string_len),
+            STARDUST_DB_VALUE_WRONG_TYPE
+        );
+
+        let name = CString::new("name").unwrap();
+        let mut named_ptr = null();
+        assert_eq!(
+            get_string_ref_named(&row_set, name.as_ptr(), &mut named_ptr, &mut string_len),
+            STARDUST_DB_OK
+        );
+        assert_eq!(named_ptr, string_ptr);
+        string_len = 0;
+        assert_eq!(
+            get_string_len_named(&row_set, name.as_ptr(), &mut string_len),
+            STARDUST_DB_OK
+        );
+        assert_eq!(string_len, 4);
+
+        let mut buffer = [0; 4];
+        assert_eq!(
+            get_string_index(&row_set, 0, buffer.as_mut_ptr(), buffer.len()),
+            STARDUST_DB_BUFFER_TOO_SMALL
+        );
+        let mut buffer = [0; 5];
+        assert_eq!(
+            get_string_index(&row_set, 0, buffer.as_mut_ptr(), buffer.len()),
+            STARDUST_DB_OK
+        );
+
+        close_row_set(&mut row_set);
+        close_db(&mut db);
+    }
+}
+
+#[test]
+fn c_resolve_column() {
+    use crate::c_interface::{
+        close_db, close_row_set, execute_query, get_int_index, resolve_column,
+        temp_db as c_temp_db, Db, ROW_SET_INIT, STARDUST_DB_NO_COLUMN, STARDUST_DB_OK,
+    };
+    use std::{ffi::CString, ptr::null_mut};
+
+    unsafe {
+        let mut db = Db::Ordinary(null_mut());
+        assert_eq!(c_temp_db(&mut db), STARDUST_DB_OK);
+        let mut row_set = ROW_SET_INIT;
+        let mut err_buff = [0; 128];
+        let query = CString::new(
+            "CREATE TABLE test (name string, age int);
+            INSERT INTO test VALUES ('User', 23);
+            SELECT name, age FROM test",
+        )
+        .unwrap();
+        assert_eq!(
+            execute_query(
+                &mut db,
+                query.as_ptr(),
+                &mut row_set,
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_OK
+        );
+
+        let age = CString::new("age").unwrap();
+        let mut index = 0;
+        assert_eq!(
+            resolve_column(&row_set, age.as_ptr(), &mut index),
+            STARDUST_DB_OK
+        );
+        assert_eq!(index, 1);
+        let mut value = 0;
+        assert_eq!(get_int_index(&row_set, index, &mut value), STARDUST_DB_OK);
+        assert_eq!(value, 23);
+
+        let missing = CString::new("missing").unwrap();
+        assert_eq!(
+            resolve_column(&row_set, missing.as_ptr(), &mut index),
+            STARDUST_DB_NO_COLUMN
+        );
+
+        close_row_set(&mut row_set);
+        close_db(&mut db);
+    }
+}
+
+#[test]
+fn c_reuse_row_set() {
+    use crate::c_interface::{
+        close_db, close_row_set, execute_query, get_int_index, get_row_set_stats, next_row,
+        temp_db as c_temp_db, Db, ROW_SET_INIT, STARDUST_DB_EXECUTION_ERROR, STARDUST_DB_OK,
+    };
+    use std::{ffi::CString, ptr::null_mut};
+
+    unsafe {
+        let mut db = Db::Ordinary(null_mut());
+        assert_eq!(c_temp_db(&mut db), STARDUST_DB_OK);
+        let mut row_set = ROW_SET_INIT;
+        let mut err_buff = [0; 128];
+        let query = CString::new(
+            "CREATE TABLE test (id int);
+            INSERT INTO test VALUES (1), (2), (3), (4)",
+        )
+        .unwrap();
+        assert_eq!(
+            execute_query(
+                &mut db,
+                query.as_ptr(),
+                &mut row_set,
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_OK
+        );
+
+        let select = CString::new("SELECT id FROM test ORDER BY id DESC").unwrap();
+        let mut capacity = 0;
+        let mut peak_rows = 0;
+        for _ in 0..3 {
+            assert_eq!(
+                execute_query(
+                    &mut db,
+                    select.as_ptr(),
+                    &mut row_set,
+                    err_buff.as_mut_ptr(),
+                    err_buff.len()
+                ),
+                STARDUST_DB_OK
+            );
+            let mut value = 0;
+            for expected in (1..=4).rev() {
+                assert_eq!(get_int_index(&row_set, 0, &mut value), STARDUST_DB_OK);
+                assert_eq!(value, expected);
+                next_row(&mut row_set);
+            }
+            let previous_capacity = capacity;
+            assert_eq!(
+                get_row_set_stats(&row_set, &mut capacity, &mut peak_rows),
+                STARDUST_DB_OK
+            );
+            assert!(capacity >= 4);
+            assert!(previous_capacity == 0 || previous_capacity == capacity);
+            assert_eq!(peak_rows, 4);
+        }
+
+        let filtered = CString::new("SELECT id FROM test WHERE id = 2").unwrap();
+        assert_eq!(
+            execute_query(
+                &mut db,
+                filtered.as_ptr(),
+                &mut row_set,
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_OK
+        );
+        let mut reused_capacity = 0;
+        assert_eq!(
+            get_row_set_stats(&row_set, &mut reused_capacity, &mut peak_rows),
+            STARDUST_DB_OK
+        );
+        assert_eq!(reused_capacity, capacity);
+        assert_eq!(peak_rows, 4);
+
+        let missing = CString::new("SELECT id FROM missing").unwrap();
+        assert_eq!(
+            execute_query(
+                &mut db,
+                missing.as_ptr(),
+                &mut row_set,
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_EXECUTION_ERROR
+        );
+        let mut value = 0;
+        assert_ne!(get_int_index(&row_set, 0, &mut value), STARDUST_DB_OK);
+
+        close_row_set(&mut row_set);
+        close_db(&mut db);
+    }
+}
+
+#[test]
+fn bulk_insert() {
+    use crate::bulk_insert::{BulkColumn, BulkValues};
+
+    let db = temp_db();
+    let _ = db
+        .execute_query("CREATE TABLE test (id int UNIQUE, name string, age int DEFAULT 18);")
+        .unwrap();
+    let columns = [
+        BulkColumn {
+            name: None,
+            values: BulkValues::Integer(&[1, 2, 3]),
+            nulls: None,
+        },
+        BulkColumn {
+            name: Some("name"),
+            values: BulkValues::String {
+                offsets: &[0, 4, 4, 9],
+                data: b"UserFirst",
+            },
+            nulls: Some(&[0, 1, 0]),
+        },
+    ];
+    db.bulk_insert("test", 3, &columns).unwrap();
+    let result = db.execute_query("SELECT * FROM test;").unwrap();
+    result[0].assert_equals(
+        set![
+            vec![1.into(), "User".into(), 18.into()],
+            vec![2.into(), Value::Null, 18.into()],
+            vec![3.into(), "First".into(), 18.into()]
+        ],
+        vec!["id", "name", "age"],
+    );
+
+    let result = db.bulk_insert("test", 1, &columns);
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::UniqueConstraintFailed(_)))
+    ));
+    let result = db.bulk_insert("test", 4, &columns);
+    assert!(
+        matches!(result, Err(Error::Execution(ExecutionError::InvalidColumnData(c))) if c == "0")
+    );
+    let result = db.execute_query("SELECT * FROM test;").unwrap();
+    assert_eq!(result[0].num_rows(), 3);
+
+    let ages = BulkColumn {
+        name: Some("age"),
+        values: BulkValues::Integer(&[20]),
+        nulls: None,
+    };
+    let id = BulkColumn {
+        name: Some("id"),
+        values: BulkValues::Integer(&[4]),
+        nulls: None,
+    };
+    let result = db.bulk_insert("test", 1, &[ages, id, ages]);
+    assert!(
+        matches!(result, Err(Error::Execution(ExecutionError::DuplicateColumn(c))) if c == "age")
+    );
+    let unnamed_id = BulkColumn { name: None, ..id };
+    let result = db.bulk_insert("test", 1, &[unnamed_id, id]);
+    assert!(
+        matches!(result, Err(Error::Execution(ExecutionError::DuplicateColumn(c))) if c == "id")
+    );
+    let result = db.execute_query("SELECT * FROM test;").unwrap();
+    assert_eq!(result[0].num_rows(), 3);
+}
+
+#[test]
+fn c_bulk_insert() {
+    use crate::c_interface::{
+        bulk_insert, close_db, close_row_set, execute_query, get_int_index, get_string_index,
+        next_row, temp_db as c_temp_db, Db, StardustColumn, ROW_SET_INIT,
+        STARDUST_DB_EXECUTION_ERROR, STARDUST_DB_INTEGER_COLUMN, STARDUST_DB_INVALID_COLUMN,
+        STARDUST_DB_OK, STARDUST_DB_STRING_COLUMN, STARDUST_DB_VALUE_NULL,
+    };
+    use std::{
+        ffi::{CStr, CString},
+        ptr::{null, null_mut},
+    };
+
+    unsafe {
+        let mut db = Db::Ordinary(null_mut());
+        assert_eq!(c_temp_db(&mut db), STARDUST_DB_OK);
+        let mut row_set = ROW_SET_INIT;
+        let mut err_buff = [0; 128];
+        let query = CString::new("CREATE TABLE test (name string, age int)").unwrap();
+        assert_eq!(
+            execute_query(
+                &mut db,
+                query.as_ptr(),
+                &mut row_set,
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_OK
+        );
+
+        let table = CString::new("test").unwrap();
+        let ages = [23, 0];
+        let age_nulls = [0, 1];
+        let offsets = [0, 4, 9];
+        let names = b"UserFirst";
+        let mut columns = [
+            StardustColumn {
+                name: null(),
+                column_type: STARDUST_DB_STRING_COLUMN,
+                int_values: null(),
+                offsets: offsets.as_ptr(),
+                data: names.as_ptr() as *const _,
+                null_buffer: null(),
+            },
+            StardustColumn {
+                name: null(),
+                column_type: STARDUST_DB_INTEGER_COLUMN,
+                int_values: ages.as_ptr(),
+                offsets: null(),
+                data: null(),
+                null_buffer: age_nulls.as_ptr(),
+            },
+        ];
+        assert_eq!(
+            bulk_insert(
+                &mut db,
+                table.as_ptr(),
+                2,
+                columns.as_ptr(),
+                columns.len(),
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_OK
+        );
+
+        let query = CString::new("SELECT name, age FROM test ORDER BY name DESC").unwrap();
+        assert_eq!(
+            execute_query(
+                &mut db,
+                query.as_ptr(),
+                &mut row_set,
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_OK
+        );
+        let mut name = [0; 16];
+        let mut age = 0;
+        assert_eq!(
+            get_string_index(&row_set, 0, name.as_mut_ptr(), name.len()),
+            STARDUST_DB_OK
+        );
+        assert_eq!(CStr::from_ptr(name.as_ptr()).to_str().unwrap(), "User");
+        assert_eq!(get_int_index(&row_set, 1, &mut age), STARDUST_DB_OK);
+        assert_eq!(age, 23);
+        next_row(&mut row_set);
+        assert_eq!(
+            get_string_index(&row_set, 0, name.as_mut_ptr(), name.len()),
+            STARDUST_DB_OK
+        );
+        assert_eq!(CStr::from_ptr(name.as_ptr()).to_str().unwrap(), "First");
+        assert_eq!(get_int_index(&row_set, 1, &mut age), STARDUST_DB_VALUE_NULL);
+
+        columns[1].int_values = null();
+        assert_eq!(
+            bulk_insert(
+                &mut db,
+                table.as_ptr(),
+                2,
+                columns.as_ptr(),
+                columns.len(),
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_INVALID_COLUMN
+        );
+
+        let age_name = CString::new("age").unwrap();
+        columns[1].int_values = ages.as_ptr();
+        columns[0] = StardustColumn {
+            name: age_name.as_ptr(),
+            ..columns[1]
+        };
+        assert_eq!(
+            bulk_insert(
+                &mut db,
+                table.as_ptr(),
+                2,
+                columns.as_ptr(),
+                columns.len(),
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_EXECUTION_ERROR
+        );
+        assert_eq!(
+            CStr::from_ptr(err_buff.as_ptr()).to_str().unwrap(),
+            "column `age` is given more than once"
+        );
+
+        close_row_set(&mut row_set);
+        close_db(&mut db);
+    }
+}
+
+#[test]
+fn c_execute_batch() {
+    use crate::c_interface::{
+        close_db, close_result_list, close_row_set, execute_batch, get_int_index, next_result,
+        num_columns, num_results, temp_db as c_temp_db, Db, RESULT_LIST_INIT, ROW_SET_INIT,
+        STARDUST_DB_END, STARDUST_DB_OK,
+    };
+    use std::{ffi::CString, ptr::null_mut};
+
+    unsafe {
+        let mut db = Db::Ordinary(null_mut());
+        assert_eq!(c_temp_db(&mut db), STARDUST_DB_OK);
+        let mut results = RESULT_LIST_INIT;
+        let mut row_set = ROW_SET_INIT;
+        let mut err_buff = [0; 128];
+        let query = CString::new(
+            "CREATE TABLE test (id int, age int);
+            INSERT INTO test VALUES (1, 23), (2, 25);
+            SELECT id FROM test WHERE id = 2;
+            SELECT age, id FROM test WHERE id = 1",
+        )
+        .unwrap();
+        assert_eq!(
+            execute_batch(
+                &mut db,
+                query.as_ptr(),
+                &mut results,
+                err_buff.as_mut_ptr(),
+                err_buff.len()
+            ),
+            STARDUST_DB_OK
+        );
+        let mut count = 0;
+        assert_eq!(num_results(&results, &mut count), STARDUST_DB_OK);
+        assert_eq!(count, 4);
+
+        assert_eq!(next_result(&mut results, &mut row_set), STARDUST_DB_OK);
+        assert_eq!(next_result(&mut results, &mut row_set), STARDUST_DB_OK);
+        assert_eq!(next_result(&mut results, &mut row_set), STARDUST_DB_OK);
+        let mut value = 0;
+        assert_eq!(get_int_index(&row_set, 0, &mut value), STARDUST_DB_OK);
+        assert_eq!(value, 2);
+
+        assert_eq!(next_result(&mut results, &mut row_set), STARDUST_DB_OK);
+        assert_eq!(num_columns(&row_set, &mut count), STARDUST_DB_OK);
+        assert_eq!(count, 2);
+        assert_eq!(get_int_index(&row_set, 0, &mut value), STARDUST_DB_OK);
+        assert_eq!(value, 23);
+        assert_eq!(next_result(&mut results, &mut row_set), STARDUST_DB_END);
+
+        close_result_list(&mut results);
+        close_row_set(&mut row_set);
+        close_db(&mut db);
+    }
+}
+
+#[test]
+fn execute_queries_group() {
+    let db = temp_db();
+    let results = db
+        .execute_queries(vec![
+            "CREATE TABLE test (id int UNIQUE);",
+            "INSERT INTO test VALUES (1);",
+            "INSERT INTO test VALUES (1);",
+            "INSERT INTO test VALUES (2);",
+            "SELECT * FROM test;",
+        ])
+        .unwrap();
+    assert_eq!(results.len(), 5);
+    assert!(matches!(
+        &results[2],
+        Err(Error::Execution(ExecutionError::UniqueConstraintFailed(_)))
+    ));
+    results[4].as_ref().unwrap()[0].assert_equals(set![vec![1.into()], vec![2.into()]], vec!["id"]);
+}
+
+#[test]
+fn server_pipelined_queries() {
+    use crate::server::{protocol::Response, Client, Server};
+    use std::net::TcpListener;
+
+    let server = Server::new(temp_db(), 2);
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let mut client = Client::connect_tcp(listener.local_addr().unwrap()).unwrap();
+    let (stream, _) = listener.accept().unwrap();
+    server.serve_connection(stream).unwrap();
+
+    assert!(matches!(
+        client
+            .query("CREATE TABLE test (id int, name string);")
+            .unwrap(),
+        Response::Results(_)
+    ));
+    client.send("INSERT INTO test VALUES (1, 'User');").unwrap();
+    client
+        .send("INSERT INTO test VALUES (2, 'Other');")
+        .unwrap();
+    client.send("SELECT * FROM missing;").unwrap();
+    client.send("SELECT * FROM test;").unwrap();
+    client.flush().unwrap();
+    for _ in 0..2 {
+        assert!(matches!(client.receive().unwrap(), Response::Results(_)));
+    }
+    assert!(matches!(client.receive().unwrap(), Response::Error(_)));
+    match client.receive().unwrap() {
+        Response::Results(relations) => relations[0].assert_equals(
+            set![
+                vec![1.into(), "User".into()],
+                vec![2.into(), "Other".into()]
+            ],
+            vec!["id", "name"],
+        ),
+        Response::Error(e) => panic!("unexpected error {}", e),
+    }
+}
+
+#[test]
+fn server_concurrent_inserts() {
+    use crate::server::{protocol::Response, Client, Server};
+    use std::{net::TcpListener, thread};
+
+    let server = Server::new(temp_db(), 4);
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let address = listener.local_addr().unwrap();
+    let _ = server
+        .database()
+        .execute_query("CREATE TABLE test (id int UNIQUE);")
+        .unwrap();
+    let clients = (0..4)
+        .map(|client| {
+            thread::spawn(move || {
+                let mut connection = Client::connect_tcp(address).unwrap();
+                for i in 0..50 {
+                    let sql = format!("INSERT INTO test VALUES ({});", client * 50 + i);
+                    assert!(matches!(
+                        connection.query(&sql).unwrap(),
+                        Response::Results(_)
+                    ));
+                }
+            })
+        })
+        .collect::<Vec<_>>();
+    for _ in 0..4 {
+        let (stream, _) = listener.accept().unwrap();
+        server.serve_connection(stream).unwrap();
+    }
+    for client in clients {
+        client.join().unwrap();
+    }
+    let result = server
+        .database()
+        .execute_query("SELECT * FROM test;")
+        .unwrap();
+    assert_eq!(result[0].num_rows(), 200);
+}
+
+#[test]
+fn replicate_to_replica() {
+    use crate::Database;
+    use std::{env::temp_dir, fs};
+
+    let directory = temp_dir().join(format!("stardust_replication_{}", std::process::id()));
+    let _ = fs::remove_dir_all(&directory);
+    {
+        let primary =
+            Database::open_primary(directory.join("primary"), directory.join("log")).unwrap();
+        let _ = primary
+            .execute_query(
+                "CREATE TABLE test (id int, name string);
+                INSERT INTO test VALUES (1, 'User'), (2, 'Other');",
+            )
+            .unwrap();
+        let replica =
+            Database::open_replica(directory.join("replica"), directory.join("log")).unwrap();
+        let result = replica.execute_query("SELECT * FROM test;").unwrap();
+        result[0].assert_equals(
+            set![
+                vec![1.into(), "User".into()],
+                vec![2.into(), "Other".into()]
+            ],
+            vec!["id", "name"],
+        );
+
+        let _ = primary
+            .execute_query(
+                "DELETE FROM test WHERE id = 1;
+                UPDATE test SET name = 'Changed';",
+            )
+            .unwrap();
+        let status = replica.replication_status().unwrap().unwrap();
+        assert!(status.lag_bytes() > 0);
+        assert_eq!(replica.poll_replication().unwrap(), 1);
+        let status = replica.replication_status().unwrap().unwrap();
+        assert_eq!(status.lag_bytes(), 0);
+        assert_eq!(status.lag, std::time::Duration::default());
+        let result = replica.execute_query("SELECT * FROM test;").unwrap();
+        result[0].assert_equals(set![vec![2.into(), "Changed".into()]], vec!["id", "name"]);
+
+        let result = replica.execute_query("INSERT INTO test VALUES (3, 'Replica');");
+        assert!(matches!(
+            result,
+            Err(Error::Execution(ExecutionError::ReadOnlyReplica))
+        ));
+        let _ = primary.execute_query("DROP TABLE test;").unwrap();
+        replica.poll_replication().unwrap();
+        let result = replica.execute_query("SELECT * FROM test;");
+        assert!(matches!(
+            result,
+            Err(Error::Execution(ExecutionError::NoTable(_)))
+        ));
+    }
+    fs::remove_dir_all(&directory).unwrap();
+}
+
+#[test]
+fn backup_and_restore() {
+    use crate::Database;
+    use std::{env::temp_dir, fs};
+
+    let directory = temp_dir().join(format!("stardust_backup_{}", std::process::id()));
+    let _ = fs::remove_dir_all(&directory);
+    fs::create_dir_all(&directory).unwrap();
+    {
+        let db = temp_db();
+        let _ = db
+            .execute_query(
+                "CREATE TABLE parent (id int PRIMARY KEY, name string);
+                CREATE TABLE child (id int, parent_id int REFERENCES parent(id));
+                INSERT INTO parent VALUES (1, 'User'), (2, 'Other');
+                INSERT INTO child VALUES (1, 1), (2, 1), (3, 2);",
+            )
+            .unwrap();
+        let stats = db.backup_to(directory.join("backup")).unwrap();
+        assert!(stats.entries >= 5);
+        assert!(stats.compressed_bytes > 0);
+        let _ = db.execute_query("DELETE FROM child;").unwrap();
+
+        let (restored, restore_stats) =
+            Database::restore_from(directory.join("backup"), directory.join("restored")).unwrap();
+        assert_eq!(restore_stats.entries, stats.entries);
+        assert_eq!(restore_stats.trees, stats.trees);
+        let result = restored.execute_query("SELECT * FROM child;").unwrap();
+        result[0].assert_equals(
+            set![
+                vec![1.into(), 1.into()],
+                vec![2.into(), 1.into()],
+                vec![3.into(), 2.into()]
+            ],
+            vec!["id", "parent_id"],
+        );
+        let result = restored.execute_query("INSERT INTO child VALUES (4, 3);");
+        assert!(matches!(
+            result,
+            Err(Error::Execution(
+                ExecutionError::ForeignKeyConstraintFailed(_)
+            ))
+        ));
+
+        assert!(
+            Database::restore_from(directory.join("backup"), directory.join("restored")).is_err()
+        );
+    }
+    fs::remove_dir_all(&directory).unwrap();
+}
+
+#[test]
+fn freeze_table() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE country (code string PRIMARY KEY, name string);
+            CREATE TABLE city (name string, country string REFERENCES country(code));
+            INSERT INTO country VALUES ('GB', 'United Kingdom'), ('FR', 'France'), ('DE', 'Germany');",
+        )
+        .unwrap();
+    db.freeze_table("country").unwrap();
+    db.freeze_table("country").unwrap();
+
+    let result = db
+        .execute_query("SELECT name FROM country WHERE code = 'FR';")
+        .unwrap();
+    result[0].assert_equals(set![vec!["France".into()]], vec!["name"]);
+    let _ = db
+        .execute_query("INSERT INTO city VALUES ('Paris', 'FR');")
+        .unwrap();
+    let result = db.execute_query("INSERT INTO city VALUES ('Rome', 'IT');");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(
+            ExecutionError::ForeignKeyConstraintFailed(_)
+        ))
+    ));
+    let result = db.execute_query("INSERT INTO country VALUES ('IT', 'Italy');");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::FrozenTable(table))) if table == "country"
+    ));
+    let result = db.execute_query("DELETE FROM country WHERE code = 'DE';");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::FrozenTable(_)))
+    ));
+
+    let _ = db
+        .execute_query("DROP TABLE city; DROP TABLE country;")
+        .unwrap();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE country (code string);
+            INSERT INTO country VALUES ('IT');",
+        )
+        .unwrap();
+    let result = db.execute_query("SELECT code FROM country;").unwrap();
+    result[0].assert_equals(set![vec!["IT".into()]], vec!["code"]);
+}
+
+#[test]
+fn range_partitioning() {
+    use crate::partition::{PartitionBound, RangePartition};
+
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE events (id int, time int);
+            INSERT INTO events VALUES (1, 5), (2, 15), (3, 25);",
+        )
+        .unwrap();
+    let bound = |i| Some(PartitionBound::Integer(i));
+    db.partition_by_range(
+        "events",
+        "time",
+        vec![
+            RangePartition::new("early", None, bound(10)),
+            RangePartition::new("middle", bound(10), bound(20)),
+        ],
+    )
+    .unwrap_err();
+    db.partition_by_range(
+        "events",
+        "time",
+        vec![
+            RangePartition::new("early", None, bound(10)),
+            RangePartition::new("middle", bound(10), bound(20)),
+            RangePartition::new("late", bound(20), bound(30)),
+        ],
+    )
+    .unwrap();
+
+    let result = db
+        .execute_query("SELECT id FROM events WHERE time >= 10;")
+        .unwrap();
+    result[0].assert_equals(set![vec![2.into()], vec![3.into()]], vec!["id"]);
+    let result = db.execute_query("INSERT INTO events VALUES (4, 35);");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::RowOutsidePartitions(table))) if table == "events"
+    ));
+    db.add_partition("events", RangePartition::new("latest", bound(30), None))
+        .unwrap();
+    let _ = db
+        .execute_query(
+            "INSERT INTO events VALUES (4, 35);
+            UPDATE events SET time = 12 WHERE id = 1;",
+        )
+        .unwrap();
+    let result = db
+        .execute_query("SELECT id, time FROM events WHERE time < 20;")
+        .unwrap();
+    result[0].assert_equals(
+        set![vec![1.into(), 12.into()], vec![2.into(), 15.into()]],
+        vec!["id", "time"],
+    );
+
+    db.drop_partition("events", "middle").unwrap();
+    let result = db.execute_query("SELECT id FROM events;").unwrap();
+    result[0].assert_equals(set![vec![3.into()], vec![4.into()]], vec!["id"]);
+    let result = db.execute_query("INSERT INTO events VALUES (5, 15);");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::RowOutsidePartitions(_)))
+    ));
+    let result = db.freeze_table("events");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::PartitionedTable(_)))
+    ));
+
+    let _ = db
+        .execute_query(
+            "DROP TABLE events;
+            CREATE TABLE events (id int);
+            INSERT INTO events VALUES (6);",
+        )
+        .unwrap();
+    let result = db.execute_query("SELECT id FROM events;").unwrap();
+    result[0].assert_equals(set![vec![6.into()]], vec!["id"]);
+}
+
+#[test]
+fn hash_partitioning() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE events (id int PRIMARY KEY, user int);
+            INSERT INTO events VALUES (1, 10), (2, 11), (3, 12), (4, 13);",
+        )
+        .unwrap();
+    let result = db.partition_by_hash("events", "user", 0);
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::InvalidPartitionCount(0)))
+    ));
+    db.partition_by_hash("events", "user", 4).unwrap();
+    let _ = db
+        .execute_query(
+            "INSERT INTO events VALUES (5, 10), (6, 14);
+            UPDATE events SET user = 15 WHERE id = 2;",
+        )
+        .unwrap();
+    let result = db.execute_query("INSERT INTO events VALUES (6, 16);");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::UniqueConstraintFailed(_)))
+    ));
+
+    let result = db
+        .execute_query("SELECT id FROM events WHERE user = 10;")
+        .unwrap();
+    result[0].assert_equals(set![vec![1.into()], vec![5.into()]], vec!["id"]);
+    let result = db
+        .execute_query("SELECT id, user FROM events WHERE id > 1;")
+        .unwrap();
+    result[0].assert_equals(
+        set![
+            vec![2.into(), 15.into()],
+            vec![3.into(), 12.into()],
+            vec![4.into(), 13.into()],
+            vec![5.into(), 10.into()],
+            vec![6.into(), 14.into()]
+        ],
+        vec!["id", "user"],
+    );
+    let result = db.drop_partition("events", "0");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::NotRangePartitioned(_)))
+    ));
+    let _ = db
+        .execute_query("DELETE FROM events WHERE user = 10;")
+        .unwrap();
+    let result = db.execute_query("SELECT id FROM events;").unwrap();
+    assert_eq!(result[0].num_rows(), 4);
+}
+
+#[test]
+fn row_expiry() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE sessions (id string, expires int);
+            INSERT INTO sessions VALUES ('a', 0), ('b', 1), ('c', 4000000000), ('d', NULL), ('e', 2);",
+        )
+        .unwrap();
+    let result = db.set_expiry_column("sessions", Some("id"));
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::TypeError { .. }))
+    ));
+    assert_eq!(db.reap_expired_rows(10).unwrap(), 0);
+    db.set_expiry_column("sessions", Some("expires")).unwrap();
+    assert_eq!(db.reap_expired_rows(2).unwrap(), 2);
+    assert_eq!(db.reap_expired_rows(10).unwrap(), 1);
+    assert_eq!(db.reap_expired_rows(10).unwrap(), 0);
+    let result = db.execute_query("SELECT id FROM sessions;").unwrap();
+    result[0].assert_equals(set![vec!["c".into()], vec!["d".into()]], vec!["id"]);
+
+    let _ = db
+        .execute_query("INSERT INTO sessions VALUES ('f', 3);")
+        .unwrap();
+    db.set_expiry_column("sessions", None).unwrap();
+    assert_eq!(db.reap_expired_rows(10).unwrap(), 0);
+    db.set_expiry_column("sessions", Some("expires")).unwrap();
+    let _ = db.execute_query("DROP TABLE sessions;").unwrap();
+    assert_eq!(db.reap_expired_rows(10).unwrap(), 0);
+}
+
+#[test]
+fn row_expiry_blocked_by_foreign_key() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE parents (id int PRIMARY KEY, expires int);
+            CREATE TABLE children (parent int, FOREIGN KEY (parent) REFERENCES parents(id));
+            CREATE TABLE logs (expires int);
+            INSERT INTO parents VALUES (1, 0);
+            INSERT INTO children VALUES (1);
+            INSERT INTO logs VALUES (0), (4000000000);",
+        )
+        .unwrap();
+    db.set_expiry_column("parents", Some("expires")).unwrap();
+    db.set_expiry_column("logs", Some("expires")).unwrap();
+    let result = db.reap_expired_rows(10);
+    assert!(matches!(
+        result,
+        Err(Error::Execution(
+            ExecutionError::ForeignKeyConstraintFailed(_)
+        ))
+    ));
+    let result = db.execute_query("SELECT expires FROM logs;").unwrap();
+    result[0].assert_equals(set![vec![4000000000.into()]], vec!["expires"]);
+    // Neither table is scanned again until it is written to.
+    assert_eq!(db.reap_expired_rows(10).unwrap(), 0);
+
+    let _ = db
+        .execute_query("DELETE FROM children; UPDATE parents SET expires = 0;")
+        .unwrap();
+    assert_eq!(db.reap_expired_rows(10).unwrap(), 1);
+    let result = db.execute_query("SELECT id FROM parents;").unwrap();
+    result[0].assert_equals(set![], vec!["id"]);
+}
+
+#[test]
+fn vacuum() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE test (id int, name string);
+            INSERT INTO test VALUES (1, 'a'), (2, 'b'), (3, 'c'), (4, 'd');
+            UPDATE test SET name = 'e';
+            UPDATE test SET name = 'f';
+            DELETE FROM test WHERE id > 2;",
+        )
+        .unwrap();
+    let metrics = db.storage_metrics().unwrap();
+    assert_eq!(metrics.trees.len(), 1);
+    let tree = &metrics.trees[0];
+    assert_eq!(tree.table, "test");
+    assert_eq!(tree.live_entries, 2);
+    assert_eq!(tree.writes_since_vacuum, 14);
+    assert_eq!(tree.write_amplification(), 7.0);
+    assert!(metrics.size_on_disk > 0);
+
+    assert_eq!(db.vacuum_fragmented(10.0).unwrap(), 0);
+    assert_eq!(db.vacuum_fragmented(4.0).unwrap(), 1);
+    let metrics = db.storage_metrics().unwrap();
+    assert_eq!(metrics.trees[0].writes_since_vacuum, 0);
+    db.vacuum(Some("test")).unwrap();
+    db.vacuum(None).unwrap();
+    let result = db.execute_query("SELECT id, name FROM test;").unwrap();
+    result[0].assert_equals(
+        set![vec![1.into(), "f".into()], vec![2.into(), "f".into()]],
+        vec!["id", "name"],
+    );
+    let result = db.vacuum(Some("missing"));
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::NoTable(_)))
+    ));
+}
+
+#[test]
+fn alter_table_add_column() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE users (id int PRIMARY KEY, name string);
+            INSERT INTO users VALUES (1, 'a'), (2, 'b');
+            ALTER TABLE users ADD COLUMN age int DEFAULT 30;
+            ALTER TABLE users ADD COLUMN email string;",
+        )
+        .unwrap();
+    let result = db.execute_query("ALTER TABLE users ADD COLUMN score int NOT NULL;");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::NotNullWithoutDefault(_)))
+    ));
+    let result = db.execute_query("ALTER TABLE users ADD COLUMN score int UNIQUE;");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::AddColumnConstraint(_)))
+    ));
+    let result = db.execute_query("ALTER TABLE users ADD COLUMN name string;");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::ColumnExists(_)))
+    ));
+    let _ = db
+        .execute_query(
+            "INSERT INTO users VALUES (3, 'c', 40, 'c@example.com');
+            UPDATE users SET email = 'a@example.com' WHERE id = 1;",
+        )
+        .unwrap();
+
+    let result = db
+        .execute_query("SELECT id, name, age, email FROM users;")
+        .unwrap();
+    result[0].assert_equals(
+        set![
+            vec![1.into(), "a".into(), 30.into(), "a@example.com".into()],
+            vec![2.into(), "b".into(), 30.into(), Value::Null],
+            vec![3.into(), "c".into(), 40.into(), "c@example.com".into()]
+        ],
+        vec!["id", "name", "age", "email"],
+    );
+    let result = db
+        .execute_query("SELECT id FROM users WHERE age = 30;")
+        .unwrap();
+    result[0].assert_equals(set![vec![1.into()], vec![2.into()]], vec!["id"]);
+    let result = db.execute_query("INSERT INTO users (id, name) VALUES (2, 'd');");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::UniqueConstraintFailed(_)))
+    ));
+}
+
+#[test]
+fn alter_table_unsupported() {
+    let db = temp_db();
+    let _ = db
+        .execute_query("CREATE TABLE test (id int, name string);")
+        .unwrap();
+    let result = db.execute_query("ALTER TABLE test DROP COLUMN name;");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::UnsupportedAlterTable(_)))
+    ));
+}
+
+#[test]
+fn create_index() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE orders (id int PRIMARY KEY, status string, customer int);
+            INSERT INTO orders VALUES (1, 'open', 10), (2, 'closed', 10), (3, 'open', 11);",
+        )
+        .unwrap();
+    db.create_index("orders", "by_status", &["status"]).unwrap();
+    let result = db.create_index("orders", "by_status", &["customer"]);
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::IndexExists(_)))
+    ));
+    let result = db.create_index("orders", "by_missing", &["missing"]);
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::NoColumn(_)))
+    ));
+    let _ = db
+        .execute_query(
+            "INSERT INTO orders VALUES (4, 'open', 12);
+            UPDATE orders SET status = 'closed' WHERE id = 1;
+            DELETE FROM orders WHERE id = 3;",
+        )
+        .unwrap();
+    let result = db
+        .execute_query("SELECT id FROM orders WHERE status = 'open';")
+        .unwrap();
+    result[0].assert_equals(set![vec![4.into()]], vec!["id"]);
+
+    let db = std::sync::Arc::new(db);
+    crate::index::create_index_concurrently(&db, "orders", "by_customer", &["customer"], None)
+        .unwrap()
+        .join()
+        .unwrap()
+        .unwrap();
+    db.partition_by_hash("orders", "id", 4).unwrap();
+    let result = db
+        .execute_query("SELECT id FROM orders WHERE customer = 10 AND status = 'closed';")
+        .unwrap();
+    result[0].assert_equals(set![vec![1.into()], vec![2.into()]], vec!["id"]);
+    let indexes = db.indexes().unwrap();
+    assert_eq!(indexes.len(), 2);
+    assert!(indexes
+        .iter()
+        .all(|index| index.state == crate::index::IndexState::Ready));
+    db.drop_index("orders", "by_status").unwrap();
+    let result = db.drop_index("orders", "by_status");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::NoIndex(_)))
+    ));
+}
+
+#[test]
+fn partial_and_expression_indexes() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE tickets (id int PRIMARY KEY, status string, priority int);
+            INSERT INTO tickets VALUES (1, 'open', 1), (2, 'closed', 1), (3, 'open', 2), (4, 'open', 12);",
+        )
+        .unwrap();
+    db.create_partial_index(
+        "tickets",
+        "open_by_priority",
+        &["priority"],
+        "status = 'open'",
+    )
+    .unwrap();
+    db.create_index("tickets", "by_priority_band", &["priority / 10"])
+        .unwrap();
+    let result = db.create_partial_index("tickets", "invalid", &["*"], "status = 'open'");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::InvalidIndexExpression(_)))
+    ));
+    let _ = db
+        .execute_query(
+            "INSERT INTO tickets VALUES (5, 'open', 1), (6, 'closed', 2);
+            UPDATE tickets SET status = 'closed' WHERE id = 3;
+            UPDATE tickets SET status = 'open' WHERE id = 2;",
+        )
+        .unwrap();
+
+    let result = db
+        .execute_query("SELECT id FROM tickets WHERE status = 'open' AND priority = 1;")
+        .unwrap();
+    result[0].assert_equals(
+        set![vec![1.into()], vec![2.into()], vec![5.into()]],
+        vec!["id"],
+    );
+    let result = db
+        .execute_query("SELECT id FROM tickets WHERE priority = 2;")
+        .unwrap();
+    result[0].assert_equals(set![vec![3.into()], vec![6.into()]], vec!["id"]);
+    let result = db
+        .execute_query("SELECT id FROM tickets WHERE priority / 10 = 1;")
+        .unwrap();
+    result[0].assert_equals(set![vec![4.into()]], vec!["id"]);
+}
+
+#[test]
+fn key_filters() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE users (name string, age int, CONSTRAINT users_key PRIMARY KEY (name));
+            INSERT INTO users VALUES ('Alice', 30), ('Bob', 25);
+            CREATE TABLE posts (author string, title string, CONSTRAINT author_key FOREIGN KEY (author) REFERENCES users(name));
+            INSERT INTO posts VALUES ('Alice', 'Hello');",
+        )
+        .unwrap();
+    let result = db.execute_query("INSERT INTO users VALUES ('Bob', 40);");
+    assert!(
+        matches!(result, Err(Error::Execution(ExecutionError::UniqueConstraintFailed(err))) if err == "users_key")
+    );
+    let result = db.execute_query("INSERT INTO posts VALUES ('Carol', 'Hi');");
+    assert!(
+        matches!(result, Err(Error::Execution(ExecutionError::ForeignKeyConstraintFailed(err))) if err == "author_key")
+    );
+    let _ = db
+        .execute_query(
+            "UPDATE users SET name = 'Carol' WHERE name = 'Bob';
+            INSERT INTO posts VALUES ('Carol', 'Hi');
+            DELETE FROM users WHERE age = 40;",
+        )
+        .unwrap();
+    let result = db.execute_query("DELETE FROM users WHERE name = 'Alice';");
+    assert!(
+        matches!(result, Err(Error::Execution(ExecutionError::ForeignKeyConstraintFailed(err))) if err == "author_key")
+    );
+    db.set_key_filters(false);
+    let result = db.execute_query("INSERT INTO users VALUES ('Carol', 40);");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::UniqueConstraintFailed(_)))
+    ));
+    let result = db
+        .execute_query("SELECT author FROM posts WHERE title = 'Hi';")
+        .unwrap();
+    result[0].assert_equals(set![vec!["Carol".into()]], vec!["author"]);
+}
+
+#[test]
+fn insert_checks_constraints_per_statement() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE employees (id int PRIMARY KEY, manager int, CONSTRAINT manager_key FOREIGN KEY (manager) REFERENCES employees(id));
+            INSERT INTO employees VALUES (1, NULL);
+            INSERT INTO employees VALUES (3, 2), (2, 1), (4, 3);",
+        )
+        .unwrap();
+    let result = db.execute_query("INSERT INTO employees VALUES (5, 1), (5, 2);");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::UniqueConstraintFailed(_)))
+    ));
+    let result = db.execute_query("INSERT INTO employees VALUES (6, 7), (7, 8);");
+    assert!(
+        matches!(result, Err(Error::Execution(ExecutionError::ForeignKeyConstraintFailed(err))) if err == "manager_key")
+    );
+    let result = db
+        .execute_query("SELECT id FROM employees WHERE manager = 3;")
+        .unwrap();
+    result[0].assert_equals(set![vec![4.into()]], vec!["id"]);
+}
+
+#[test]
+fn foreign_key_cascades() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE authors (name string PRIMARY KEY);
+            INSERT INTO authors VALUES ('Ann'), ('Ben');
+            CREATE TABLE books (title string PRIMARY KEY, author string, FOREIGN KEY (author) REFERENCES authors(name) ON DELETE CASCADE ON UPDATE CASCADE);
+            INSERT INTO books VALUES ('A1', 'Ann'), ('A2', 'Ann'), ('B1', 'Ben');
+            CREATE TABLE reviews (book string, stars int, FOREIGN KEY (book) REFERENCES books(title) ON DELETE CASCADE);
+            INSERT INTO reviews VALUES ('A1', 5), ('A2', 3), ('B1', 4), ('A1', 2);
+            CREATE TABLE quotes (book string, line string, FOREIGN KEY (book) REFERENCES books(title) ON DELETE SET NULL);
+            INSERT INTO quotes VALUES ('A2', 'First'), ('B1', 'Second');
+            UPDATE authors SET name = 'Benjamin' WHERE name = 'Ben';
+            DELETE FROM authors WHERE name = 'Ann';",
+        )
+        .unwrap();
+    let result = db.execute_query("SELECT * FROM books").unwrap();
+    result[0].assert_equals(
+        set![vec!["B1".into(), "Benjamin".into()]],
+        vec!["title", "author"],
+    );
+    let result = db.execute_query("SELECT * FROM reviews").unwrap();
+    result[0].assert_equals(set![vec!["B1".into(), 4.into()]], vec!["book", "stars"]);
+    let result = db.execute_query("SELECT * FROM quotes").unwrap();
+    result[0].assert_equals(
+        set![
+            vec![Value::Null, "First".into()],
+            vec!["B1".into(), "Second".into()]
+        ],
+        vec!["book", "line"],
+    );
+}
+
+#[test]
+fn foreign_key_self_cascade_null_root() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE nodes (id int PRIMARY KEY, parent int, FOREIGN KEY (parent) REFERENCES nodes(id) ON DELETE CASCADE);
+            INSERT INTO nodes VALUES (1, NULL), (2, 1), (3, 2), (4, 2), (5, 1);
+            DELETE FROM nodes WHERE id = 4;",
+        )
+        .unwrap();
+    // The root has no parent, so refers to no other row and isn't deleted with its descendants.
+    let result = db.execute_query("SELECT id FROM nodes").unwrap();
+    result[0].assert_equals(
+        set![
+            vec![1.into()],
+            vec![2.into()],
+            vec![3.into()],
+            vec![5.into()]
+        ],
+        vec!["id"],
+    );
+    let _ = db.execute_query("DELETE FROM nodes WHERE id = 2;").unwrap();
+    let result = db.execute_query("SELECT id FROM nodes").unwrap();
+    result[0].assert_equals(set![vec![1.into()], vec![5.into()]], vec!["id"]);
+    let _ = db.execute_query("DELETE FROM nodes WHERE id = 1;").unwrap();
+    let result = db.execute_query("SELECT id FROM nodes").unwrap();
+    result[0].assert_equals(set![], vec!["id"]);
+}
+
+#[test]
+fn drop_table_foreign_key_dependencies() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE teams (name string PRIMARY KEY);
+            CREATE TABLE players (name string PRIMARY KEY, team string, mentor string, FOREIGN KEY (mentor) REFERENCES players(name), CONSTRAINT team_key FOREIGN KEY (team) REFERENCES teams(name));
+            CREATE TABLE coaches (name string);
+            INSERT INTO teams VALUES ('Reds');
+            INSERT INTO players VALUES ('Ann', 'Reds', NULL);",
+        )
+        .unwrap();
+    let result = db.execute_query("DROP TABLE teams;");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::ForeignKeyDependencyDelete { parent_table, key_name }))
+            if parent_table == "players" && key_name == "team_key"
+    ));
+    let _ = db
+        .execute_query("DROP TABLE coaches; DROP TABLE players; DROP TABLE teams;")
+        .unwrap();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE teams (name string);
+            INSERT INTO teams VALUES ('Blues');
+            DROP TABLE teams;",
+        )
+        .unwrap();
+}
+
+#[test]
+fn typed_comparisons() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE test (id int, name string);
+            INSERT INTO test VALUES (7, '7'), (12, 'b'), (NULL, NULL);
+            UPDATE test SET id = id + '1' WHERE id = ' 7';",
+        )
+        .unwrap();
+    let result = db
+        .execute_query("SELECT id, name FROM test WHERE id < '10' OR name = 12;")
+        .unwrap();
+    result[0].assert_equals(set![vec![8.into(), "7".into()]], vec!["id", "name"]);
+    let result = db
+        .execute_query("SELECT id * 2 AS doubled FROM test WHERE name > 'a';")
+        .unwrap();
+    result[0].assert_equals(set![vec![24.into()]], vec!["doubled"]);
+}
+
+#[test]
+fn typed_join_filters() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE people (id int, name string, CONSTRAINT small_id CHECK (id < '100'));
+            INSERT INTO people VALUES (1, 'Ann'), (2, 'Ben'), (3, 'Cy');
+            CREATE TABLE pets (owner string, pet string);
+            INSERT INTO pets VALUES ('1', 'Cat'), (' 2', 'Dog'), ('x', 'Fish');",
+        )
+        .unwrap();
+    let result = db
+        .execute_query(
+            "SELECT name, pet FROM people INNER JOIN pets ON people.id = pets.owner WHERE people.id < '2' OR pet = 'Dog';",
+        )
+        .unwrap();
+    result[0].assert_equals(
+        set![
+            vec!["Ann".into(), "Cat".into()],
+            vec!["Ben".into(), "Dog".into()]
+        ],
+        vec!["name", "pet"],
+    );
+    let result = db.execute_query("INSERT INTO people VALUES (150, 'Di');");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::CheckConstraintFailed(name))) if name == "small_id"
+    ));
+}
+
+#[test]
+fn foreign_key_batch_composite_nulls() {
+    let db = temp_db();
+    let _ = db
+        .execute_query(
+            "CREATE TABLE parents (a int, b int, UNIQUE(a, b));
+            CREATE TABLE children (a int, b int, CONSTRAINT fkey FOREIGN KEY (a, b) REFERENCES parents(a, b));
+            INSERT INTO parents VALUES (NULL, 1);",
+        )
+        .unwrap();
+    let result = db.execute_query("INSERT INTO children VALUES (2, 1), (2, 2);");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::ForeignKeyConstraintFailed(key))) if key == "fkey"
+    ));
+    let _ = db
+        .execute_query("INSERT INTO children VALUES (2, 1), (3, 1);")
+        .unwrap();
+
+    let _ = db
+        .execute_query(
+            "CREATE TABLE nodes (id int, grp int, parent int, UNIQUE(id, grp), CONSTRAINT parent_key FOREIGN KEY (parent, grp) REFERENCES nodes(id, grp));",
+        )
+        .unwrap();
+    // A key with a null is compared with the other rows of the batch, as well as the table.
+    let _ = db
+        .execute_query("INSERT INTO nodes VALUES (1, NULL, 2), (2, NULL, NULL);")
+        .unwrap();
+    let result = db.execute_query("INSERT INTO nodes VALUES (3, NULL, 4);");
+    assert!(matches!(
+        result,
+        Err(Error::Execution(ExecutionError::ForeignKeyConstraintFailed(key))) if key == "parent_key"
+    ));
+}
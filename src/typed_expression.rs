@@ -0,0 +1,299 @@
+//! Expressions compiled for evaluation against many rows.
+//!
+//! Evaluating a resolved [`Expression`] compares and combines values whatever their types, so comparing an integer
+//! column to a string literal parses the literal again for every row. Compiling the expression infers the type of
+//! each operand from the types of the columns it reads, converts literals to the type they are compared or combined
+//! with once, and picks the comparison or arithmetic for those types. Values of an unexpected type, such as nulls,
+//! fall back to the general comparison, so a compiled expression always evaluates to the same value as the expression.
+//!
+//! The resolved expression is still used to plan which partitions and index entries are read.
+
+use std::cmp::Ordering;
+
+use crate::{
+    ast::{BinaryOp, ComparisonOp, MathematicalOp},
+    data_types::{Comparison, IntegerStorage, Type, TypeContents, Value},
+    error::Result,
+    resolved_expression::{Expression, ResolvedColumn},
+    Empty, GetData, TableColumns,
+};
+
+#[derive(Debug, Clone)]
+pub(crate) enum TypedExpression {
+    Value(Value),
+    Identifier(ResolvedColumn),
+    And(Box<TypedExpression>, Box<TypedExpression>),
+    Or(Box<TypedExpression>, Box<TypedExpression>),
+    /// A comparison of two integer operands.
+    CompareIntegers(Box<TypedExpression>, ComparisonOp, Box<TypedExpression>),
+    /// A comparison of two string operands.
+    CompareStrings(Box<TypedExpression>, ComparisonOp, Box<TypedExpression>),
+    /// A comparison of operands of unknown or different types.
+    Compare(Box<TypedExpression>, ComparisonOp, Box<TypedExpression>),
+    /// Arithmetic on two integer operands.
+    IntegerArithmetic(Box<TypedExpression>, MathematicalOp, Box<TypedExpression>),
+    /// Arithmetic on operands that may need to be cast to integers.
+    Arithmetic(Box<TypedExpression>, MathematicalOp, Box<TypedExpression>),
+}
+
+impl TypedExpression {
+    /// Compiles `expression`, taking the types of the columns it reads from `columns`.
+    pub fn compile(expression: &Expression, columns: &impl TableColumns) -> Self {
+        Self::compile_typed(expression, columns).0
+    }
+
+    /// Returns the compiled expression and the type of the values it evaluates to, if it is known. A value of a known
+    /// type may still be null.
+    fn compile_typed(expression: &Expression, columns: &impl TableColumns) -> (Self, Option<Type>) {
+        match expression {
+            Expression::Value(v) => (Self::Value(v.clone()), value_type(v)),
+            Expression::Identifier(column) => (
+                Self::Identifier(column.clone()),
+                columns.column_type(column),
+            ),
+            Expression::BinaryOp(l, op, r) => {
+                let (left, left_type) = Self::compile_typed(l, columns);
+                let (right, right_type) = Self::compile_typed(r, columns);
+                let compiled = match op {
+                    BinaryOp::And => Self::And(Box::new(left), Box::new(right)),
+                    BinaryOp::Or => Self::Or(Box::new(left), Box::new(right)),
+                    BinaryOp::Comparison(c) => {
+                        // Comparing an integer to a string compares the integer to the string's integer value, so a
+                        // string literal compared to an integer can be converted once. A string column compared to an
+                        // integer is still converted for each row.
+                        let (left, left_type) = cast_literal(left, left_type, right_type);
+                        let (right, right_type) = cast_literal(right, right_type, left_type);
+                        match (left_type, right_type) {
+                            (Some(Type::Integer), Some(Type::Integer)) => {
+                                Self::CompareIntegers(Box::new(left), *c, Box::new(right))
+                            }
+                            (Some(Type::String), Some(Type::String)) => {
+                                Self::CompareStrings(Box::new(left), *c, Box::new(right))
+                            }
+                            _ => Self::Compare(Box::new(left), *c, Box::new(right)),
+                        }
+                    }
+                    BinaryOp::Mathematical(m) => {
+                        let (left, left_type) = cast_literal(left, left_type, Some(Type::Integer));
+                        let (right, right_type) =
+                            cast_literal(right, right_type, Some(Type::Integer));
+                        match (left_type, right_type) {
+                            (Some(Type::Integer), Some(Type::Integer)) => {
+                                Self::IntegerArithmetic(Box::new(left), *m, Box::new(right))
+                            }
+                            _ => Self::Arithmetic(Box::new(left), *m, Box::new(right)),
+                        }
+                    }
+                };
+                // Logical operators, comparisons and arithmetic all evaluate to integers or null.
+                (compiled.fold(), Some(Type::Integer))
+            }
+        }
+    }
+
+    /// Evaluates an operator whose operands are both literals, so that it isn't evaluated for every row.
+    fn fold(self) -> Self {
+        let is_constant = match &self {
+            Self::And(l, r)
+            | Self::Or(l, r)
+            | Self::CompareIntegers(l, _, r)
+            | Self::CompareStrings(l, _, r)
+            | Self::Compare(l, _, r)
+            | Self::IntegerArithmetic(l, _, r)
+            | Self::Arithmetic(l, _, r) => {
+                matches!(**l, Self::Value(_)) && matches!(**r, Self::Value(_))
+            }
+            Self::Value(_) | Self::Identifier(_) => false,
+        };
+        if is_constant {
+            if let Ok(value) = self.evaluate(&Empty) {
+                return Self::Value(value);
+            }
+        }
+        self
+    }
+
+    pub fn evaluate<H>(&self, row: &H) -> Result<Value>
+    where
+        H: GetData,
+    {
+        match self {
+            Self::Value(v) => Ok(v.clone()),
+            Self::Identifier(column_name) => row.get_data(column_name),
+            Self::And(l, r) => Ok(l.evaluate(row)?.and(&r.evaluate(row)?)),
+            Self::Or(l, r) => Ok(l.evaluate(row)?.or(&r.evaluate(row)?)),
+            Self::CompareIntegers(l, c, r) => {
+                let (left, right) = (l.evaluate(row)?, r.evaluate(row)?);
+                match (&left, &right) {
+                    (
+                        Value::TypedValue(TypeContents::Integer(a)),
+                        Value::TypedValue(TypeContents::Integer(b)),
+                    ) => Ok(compare(a.cmp(b), c)),
+                    _ => Ok(left.compare(&right).get_value(c)),
+                }
+            }
+            Self::CompareStrings(l, c, r) => {
+                let (left, right) = (l.evaluate(row)?, r.evaluate(row)?);
+                match (&left, &right) {
+                    (
+                        Value::TypedValue(TypeContents::String(a)),
+                        Value::TypedValue(TypeContents::String(b)),
+                    ) => Ok(compare(a.cmp(b), c)),
+                    _ => Ok(left.compare(&right).get_value(c)),
+                }
+            }
+            Self::Compare(l, c, r) => Ok(l.evaluate(row)?.compare(&r.evaluate(row)?).get_value(c)),
+            Self::IntegerArithmetic(l, m, r) => match (l.evaluate(row)?, r.evaluate(row)?) {
+                (
+                    Value::TypedValue(TypeContents::Integer(left)),
+                    Value::TypedValue(TypeContents::Integer(right)),
+                ) => Ok(arithmetic(left, m, right)),
+                (left, right) => cast_arithmetic(left, m, right),
+            },
+            Self::Arithmetic(l, m, r) => cast_arithmetic(l.evaluate(row)?, m, r.evaluate(row)?),
+        }
+    }
+}
+
+/// Returns the type of a literal, or `None` if it is null.
+fn value_type(value: &Value) -> Option<Type> {
+    match value {
+        Value::Null => None,
+        Value::TypedValue(contents) => Some(contents.get_type()),
+    }
+}
+
+/// Converts `expression` to an integer if it is a literal and `other_type` is integer, returning the expression and its
+/// type afterwards.
+fn cast_literal(
+    expression: TypedExpression,
+    expression_type: Option<Type>,
+    other_type: Option<Type>,
+) -> (TypedExpression, Option<Type>) {
+    match (expression, other_type) {
+        (
+            TypedExpression::Value(v @ Value::TypedValue(TypeContents::String(_))),
+            Some(Type::Integer),
+        ) => (
+            TypedExpression::Value(v.cast(&Type::Integer)),
+            Some(Type::Integer),
+        ),
+        (expression, _) => (expression, expression_type),
+    }
+}
+
+fn compare(ordering: Ordering, op: &ComparisonOp) -> Value {
+    Comparison::from(ordering).get_value(op)
+}
+
+fn arithmetic(left: IntegerStorage, op: &MathematicalOp, right: IntegerStorage) -> Value {
+    match op {
+        MathematicalOp::Add => (left + right).into(),
+        MathematicalOp::Subtract => (left - right).into(),
+        MathematicalOp::Multiply => (left * right).into(),
+        MathematicalOp::Divide => left.checked_div(right).map_or(Value::Null, Value::from),
+        MathematicalOp::Modulus => left.checked_rem(right).map_or(Value::Null, Value::from),
+    }
+}
+
+/// Applies `op` to `left` and `right` cast to integers, or returns null if either is null.
+pub(crate) fn cast_arithmetic(left: Value, op: &MathematicalOp, right: Value) -> Result<Value> {
+    if left.is_null() || right.is_null() {
+        return Ok(Value::Null);
+    }
+    let left = left.cast(&Type::Integer).assume_integer()?;
+    let right = right.cast(&Type::Integer).assume_integer()?;
+    Ok(arithmetic(left, op, right))
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::{
+        ast::{BinaryOp, ComparisonOp, MathematicalOp},
+        data_types::{Type, Value},
+        error::Result,
+        resolved_expression::{Expression, ResolvedColumn},
+        storage::Columns,
+        GetData,
+    };
+
+    use super::TypedExpression;
+
+    struct Row(Value, Value);
+
+    impl GetData for Row {
+        fn get_data(&self, column_name: &ResolvedColumn) -> Result<Value> {
+            match column_name.column_name() {
+                "id" => Ok(self.0.clone()),
+                _ => Ok(self.1.clone()),
+            }
+        }
+    }
+
+    fn column(name: &str) -> Box<Expression> {
+        Box::new(Expression::Identifier(ResolvedColumn::new(
+            "t".to_owned(),
+            name.to_owned(),
+        )))
+    }
+
+    fn value(value: impl Into<Value>) -> Box<Expression> {
+        Box::new(Expression::Value(value.into()))
+    }
+
+    #[test]
+    fn typed_expression() {
+        let mut columns = Columns::new();
+        columns.add_column("id".to_owned(), Type::Integer).unwrap();
+        columns.add_column("name".to_owned(), Type::String).unwrap();
+        let compile = |expression| TypedExpression::compile(&expression, &(&columns, "t"));
+        let row = Row(7.into(), "7".into());
+        let null_row = Row(Value::Null, Value::Null);
+
+        let id_equals = compile(Expression::BinaryOp(
+            column("id"),
+            BinaryOp::Comparison(ComparisonOp::Eq),
+            value(" 7"),
+        ));
+        assert!(matches!(
+            &id_equals,
+            TypedExpression::CompareIntegers(_, _, r)
+                if matches!(**r, TypedExpression::Value(ref v) if *v == 7.into())
+        ));
+        assert_eq!(id_equals.evaluate(&row).unwrap(), 1.into());
+        assert_eq!(id_equals.evaluate(&null_row).unwrap(), Value::Null);
+
+        let name_less = compile(Expression::BinaryOp(
+            column("name"),
+            BinaryOp::Comparison(ComparisonOp::Lt),
+            value("8"),
+        ));
+        assert!(matches!(name_less, TypedExpression::CompareStrings(..)));
+        assert_eq!(name_less.evaluate(&row).unwrap(), 1.into());
+
+        let name_equals = compile(Expression::BinaryOp(
+            column("name"),
+            BinaryOp::Comparison(ComparisonOp::Eq),
+            value(7),
+        ));
+        assert!(matches!(name_equals, TypedExpression::Compare(..)));
+        assert_eq!(name_equals.evaluate(&row).unwrap(), 1.into());
+
+        let sum = compile(Expression::BinaryOp(
+            column("id"),
+            BinaryOp::Mathematical(MathematicalOp::Add),
+            Box::new(Expression::BinaryOp(
+                value("2"),
+                BinaryOp::Mathematical(MathematicalOp::Multiply),
+                value(3),
+            )),
+        ));
+        assert!(matches!(
+            &sum,
+            TypedExpression::IntegerArithmetic(_, _, r)
+                if matches!(**r, TypedExpression::Value(ref v) if *v == 6.into())
+        ));
+        assert_eq!(sum.evaluate(&row).unwrap(), 13.into());
+        assert_eq!(sum.evaluate(&null_row).unwrap(), Value::Null);
+    }
+}
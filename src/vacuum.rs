@@ -0,0 +1,302 @@
+//! Reclaiming the space left behind by deleted and overwritten rows.
+//!
+//! sled appends every write to its log, and only frees a segment of the log once most of it has been overwritten, so
+//! a wave of deletes or updates leaves the files large and scans slow. Vacuuming a table rewrites each of its rows in
+//! small batches, moving the live rows out of fragmented segments so that sled can free them.
+//!
+//! The number of entries written to each tree since it was last vacuumed is counted in memory, so the counts start
+//! from zero when the database is opened. `maintain` vacuums the tables whose write amplification, the number of
+//! writes per live row, crosses a threshold.
+
+use std::{
+    collections::HashMap,
+    ops::{Bound, Deref},
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc, RwLock,
+    },
+    thread::{self, JoinHandle},
+    time::Duration,
+};
+
+use sled::{Batch, IVec, Tree};
+
+use crate::{
+    error::{Error, ExecutionError, Result},
+    interpreter::Interpreter,
+    table_handler::TableStorage,
+    Database,
+};
+
+/// The number of rows rewritten while writes are paused.
+const VACUUM_BATCH_LEN: usize = 1024;
+
+/// The number of entries written to each tree since it was last vacuumed.
+#[derive(Debug, Default)]
+pub(crate) struct WriteCounts {
+    counts: RwLock<HashMap<IVec, Arc<TreeWrites>>>,
+}
+
+#[derive(Debug, Default)]
+struct TreeWrites {
+    since_vacuum: AtomicU64,
+    /// The number of entries written since the database was opened, which vacuuming doesn't reset.
+    total: AtomicU64,
+}
+
+impl WriteCounts {
+    /// Counts `count` entries inserted into or removed from `tree`.
+    pub fn add(&self, tree: &Tree, count: u64) {
+        let name = tree.name();
+        let counts = self.counts.read().unwrap_or_else(|e| e.into_inner());
+        let writes = match counts.get(&name) {
+            Some(writes) => writes.clone(),
+            None => {
+                drop(counts);
+                self.counts
+                    .write()
+                    .unwrap_or_else(|e| e.into_inner())
+                    .entry(name)
+                    .or_default()
+                    .clone()
+            }
+        };
+        writes.since_vacuum.fetch_add(count, Ordering::Relaxed);
+        writes.total.fetch_add(count, Ordering::Relaxed);
+    }
+
+    fn get(&self, tree: &[u8]) -> u64 {
+        let counts = self.counts.read().unwrap_or_else(|e| e.into_inner());
+        counts
+            .get(tree)
+            .map_or(0, |writes| writes.since_vacuum.load(Ordering::Relaxed))
+    }
+
+    /// Returns the number of entries written to `tree` since the database was opened.
+    pub fn total(&self, tree: &[u8]) -> u64 {
+        let counts = self.counts.read().unwrap_or_else(|e| e.into_inner());
+        counts
+            .get(tree)
+            .map_or(0, |writes| writes.total.load(Ordering::Relaxed))
+    }
+
+    fn reset(&self, tree: &[u8]) {
+        let counts = self.counts.read().unwrap_or_else(|e| e.into_inner());
+        if let Some(writes) = counts.get(tree) {
+            writes.since_vacuum.store(0, Ordering::Relaxed);
+        }
+    }
+}
+
+/// The size of a database and the trees storing its tables.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct StorageMetrics {
+    /// The size of the database's files.
+    pub size_on_disk: u64,
+    /// The trees storing the rows of each table. Frozen tables are not included.
+    pub trees: Vec<TreeMetrics>,
+}
+
+impl StorageMetrics {
+    /// Returns the size of the keys and values of every table.
+    pub fn live_bytes(&self) -> u64 {
+        self.trees.iter().map(|tree| tree.live_bytes).sum()
+    }
+
+    /// Returns the fraction of the database's files not taken up by the rows of tables, between 0 and 1.
+    pub fn fragmentation(&self) -> f64 {
+        if self.size_on_disk == 0 {
+            0.0
+        } else {
+            1.0 - (self.live_bytes() as f64 / self.size_on_disk as f64).min(1.0)
+        }
+    }
+}
+
+/// The size of a tree storing the rows of a table, or of one of its partitions.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct TreeMetrics {
+    pub table: String,
+    pub tree: String,
+    /// The number of rows in the tree.
+    pub live_entries: u64,
+    /// The size of the keys and values of the rows in the tree.
+    pub live_bytes: u64,
+    /// The number of rows inserted, updated or deleted since the tree was last vacuumed, or the database was opened.
+    pub writes_since_vacuum: u64,
+}
+
+impl TreeMetrics {
+    /// Returns the number of writes since the tree was last vacuumed for each row in the tree.
+    pub fn write_amplification(&self) -> f64 {
+        self.writes_since_vacuum as f64 / self.live_entries.max(1) as f64
+    }
+}
+
+/// Returns the size of every table, scanning each of their trees.
+pub(crate) fn storage_metrics(interpreter: &Interpreter) -> Result<StorageMetrics> {
+    let mut trees = Vec::new();
+    for table in table_names(interpreter)? {
+        for tree in table_trees(interpreter, &table)? {
+            let (mut live_entries, mut live_bytes) = (0, 0);
+            for entry in tree.iter() {
+                let (key, value) = entry?;
+                live_entries += 1;
+                live_bytes += (key.len() + value.len()) as u64;
+            }
+            let name = tree.name();
+            trees.push(TreeMetrics {
+                table: table.clone(),
+                tree: String::from_utf8_lossy(&name).into_owned(),
+                live_entries,
+                live_bytes,
+                writes_since_vacuum: interpreter.write_counts().get(&name),
+            });
+        }
+    }
+    Ok(StorageMetrics {
+        size_on_disk: interpreter.db().size_on_disk()?,
+        trees,
+    })
+}
+
+/// Rewrites every row of `table`, or of every table if it is `None`, so that sled can free the space left by
+/// deleted and overwritten rows. Writes are paused while each batch of rows is rewritten, but queries continue.
+pub(crate) fn vacuum(interpreter: &Interpreter, table: Option<&str>) -> Result<()> {
+    let tables = match table {
+        Some(table) => vec![table.to_owned()],
+        None => table_names(interpreter)?,
+    };
+    for table in tables {
+        for tree in table_trees(interpreter, &table)? {
+            vacuum_tree(interpreter, &tree)?;
+        }
+    }
+    interpreter.flush()
+}
+
+/// Vacuums the tables with a tree whose write amplification is at least `threshold`. Returns the number of tables
+/// vacuumed. An error on one table doesn't stop the others being vacuumed, and the first is returned afterwards.
+/// Tables dropped while this runs are skipped.
+pub(crate) fn vacuum_fragmented(interpreter: &Interpreter, threshold: f64) -> Result<usize> {
+    let mut vacuumed = 0;
+    let mut first_error = None;
+    for table in table_names(interpreter)? {
+        match vacuum_if_fragmented(interpreter, &table, threshold) {
+            Ok(true) => vacuumed += 1,
+            Ok(false) | Err(Error::Execution(ExecutionError::NoTable(_))) => {}
+            Err(e) => {
+                first_error.get_or_insert(e);
+            }
+        }
+    }
+    match first_error {
+        Some(e) => Err(e),
+        None => Ok(vacuumed),
+    }
+}
+
+/// Vacuums `table` if one of its trees is fragmented, returning whether it was.
+fn vacuum_if_fragmented(interpreter: &Interpreter, table: &str, threshold: f64) -> Result<bool> {
+    for tree in table_trees(interpreter, table)? {
+        if is_fragmented(interpreter, &tree, threshold)? {
+            vacuum(interpreter, Some(table))?;
+            return Ok(true);
+        }
+    }
+    Ok(false)
+}
+
+/// Returns whether the write amplification of `tree` is at least `threshold`. A tree without writes since it was
+/// last vacuumed isn't read, and the rows of other trees are only counted until there are too many for the
+/// threshold to be reached.
+fn is_fragmented(interpreter: &Interpreter, tree: &Tree, threshold: f64) -> Result<bool> {
+    let writes = interpreter.write_counts().get(&tree.name());
+    if writes == 0 || threshold <= 0.0 {
+        return Ok(writes > 0);
+    }
+    let max_rows = (writes as f64 / threshold).floor();
+    let mut rows = 0u64;
+    for key in tree.iter().keys() {
+        key?;
+        rows += 1;
+        if rows as f64 > max_rows {
+            return Ok(false);
+        }
+    }
+    Ok(writes as f64 / rows.max(1) as f64 >= threshold)
+}
+
+fn vacuum_tree(interpreter: &Interpreter, tree: &Tree) -> Result<()> {
+    let mut start = Bound::Unbounded;
+    loop {
+        let _writes = interpreter.pause_writes();
+        let mut batch = Batch::default();
+        let mut last_key = None;
+        for entry in tree
+            .range::<IVec, _>((start.clone(), Bound::Unbounded))
+            .take(VACUUM_BATCH_LEN)
+        {
+            let (key, value) = entry?;
+            batch.insert(key.clone(), value);
+            last_key = Some(key);
+        }
+        // Rewriting a row doesn't change it, so it is not recorded for replicas.
+        tree.apply_batch(batch)?;
+        match last_key {
+            Some(key) => start = Bound::Excluded(key),
+            None => break,
+        }
+    }
+    interpreter.write_counts().reset(&tree.name());
+    Ok(())
+}
+
+fn table_names(interpreter: &Interpreter) -> Result<Vec<String>> {
+    interpreter
+        .db()
+        .open_tree("@tables")?
+        .iter()
+        .keys()
+        .map(|name| {
+            String::from_utf8(name?.to_vec())
+                .map_err(|_| Error::Internal("Table name is not UTF-8".to_owned()))
+        })
+        .collect()
+}
+
+/// Returns the trees storing the rows of `table`. Frozen tables are stored outside sled, so have none.
+fn table_trees(interpreter: &Interpreter, table: &str) -> Result<Vec<Tree>> {
+    Ok(match interpreter.open_table(table, None)?.storage() {
+        TableStorage::Tree(tree) => vec![tree.clone()],
+        TableStorage::Frozen(_) => Vec::new(),
+        TableStorage::Partitioned { trees, .. } => trees.clone(),
+    })
+}
+
+/// Vacuums fragmented tables on a background thread every `interval`, until the database is dropped. A table is
+/// vacuumed once one of its trees has had at least `threshold` writes per row since it was last vacuumed. Errors are
+/// passed to `on_error`, and vacuuming is tried again after the next interval.
+pub fn maintain<D, E>(
+    database: &Arc<D>,
+    threshold: f64,
+    interval: Duration,
+    on_error: E,
+) -> JoinHandle<()>
+where
+    D: Deref<Target = Database> + Send + Sync + 'static,
+    E: Fn(Error) + Send + 'static,
+{
+    let database = Arc::downgrade(database);
+    thread::spawn(move || loop {
+        thread::sleep(interval);
+        match database.upgrade() {
+            Some(database) => {
+                if let Err(e) = database.vacuum_fragmented(threshold) {
+                    on_error(e);
+                }
+            }
+            None => return,
+        };
+    })
+}
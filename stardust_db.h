@@ -5,6 +5,40 @@
 
 #include <stdint.h>
 
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char *format;
+  const char *name;
+  const char *metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema **children;
+  struct ArrowSchema *dictionary;
+  void (*release)(struct ArrowSchema *schema);
+  void *private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void **buffers;
+  struct ArrowArray **children;
+  struct ArrowArray *dictionary;
+  void (*release)(struct ArrowArray *array);
+  void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
 /**
  * Returned on success.
  */
@@ -75,11 +109,46 @@
  */
 #define STARDUST_DB_TEMP_DB_ERROR 13
 
+/**
+ * Returned if the result could not be exported.
+ */
+#define STARDUST_DB_EXPORT_ERROR 14
+
+/**
+ * Returned if a `StardustColumn` passed to `bulk_insert` has an unknown type or a missing buffer.
+ */
+#define STARDUST_DB_INVALID_COLUMN 15
+
+/**
+ * Returned if the ResultList was not initialised.
+ */
+#define STARDUST_DB_NULL_RESULT_LIST 16
+
+/**
+ * Returned if a backup could not be written or restored.
+ */
+#define STARDUST_DB_BACKUP_ERROR 17
+
+/**
+ * The `column_type` of a `StardustColumn` holding integers.
+ */
+#define STARDUST_DB_INTEGER_COLUMN 0
+
+/**
+ * The `column_type` of a `StardustColumn` holding strings.
+ */
+#define STARDUST_DB_STRING_COLUMN 1
+
 /**
  * Contains a connection to a database.
  */
 typedef struct Database Database;
 
+/**
+ * The results of a batch of queries, in execution order.
+ */
+typedef struct QueryResults QueryResults;
+
 /**
  * Stores a list of rows returned by a query.
  */
@@ -120,11 +189,79 @@ typedef struct RowSet {
 
 typedef int64_t IntegerStorage;
 
+/**
+ * Stores the results of every query executed by `execute_batch` for the C interface.
+ */
+typedef struct ResultList {
+  struct QueryResults *results;
+} ResultList;
+
+/**
+ * A column of values passed to `bulk_insert`.
+ */
+typedef struct StardustColumn {
+  /**
+   * The name of the table column to insert into as a null-terminated string, or null for the table column at the same position.
+   */
+  const char *name;
+  /**
+   * `STARDUST_DB_INTEGER_COLUMN` or `STARDUST_DB_STRING_COLUMN`.
+   */
+  int column_type;
+  /**
+   * One integer for each row, used by integer columns.
+   */
+  const IntegerStorage *int_values;
+  /**
+   * `nrows + 1` offsets into `data`, used by string columns. The string for row `i` occupies the bytes from `offsets[i]` to `offsets[i + 1]`.
+   */
+  const uintptr_t *offsets;
+  /**
+   * UTF-8 strings placed back to back without null terminators, used by string columns.
+   */
+  const char *data;
+  /**
+   * One byte for each row, set to 1 if the value is null, otherwise 0. May be null if no values are null.
+   */
+  const uint8_t *null_buffer;
+} StardustColumn;
+
+/**
+ * Statistics describing a backup or restore.
+ */
+typedef struct BackupStats {
+  /**
+   * The number of trees copied, including the catalog.
+   */
+  uint64_t trees;
+  /**
+   * The number of entries copied.
+   */
+  uint64_t entries;
+  /**
+   * The size of the copied keys and values.
+   */
+  uint64_t bytes;
+  /**
+   * The size of the backup file.
+   */
+  uint64_t compressed_bytes;
+  /**
+   * The time taken.
+   */
+  double seconds;
+} BackupStats;
+
 /**
  * Used to zero-initialise the RowSet before using as an argument in `execute_query`.
  */
 #define ROW_SET_INIT (RowSet){ .relation = (Relation*)0, .current_row = 0 }
 
+/**
+ * Used to zero-initialise the ResultList before using as an argument in `execute_batch`.
+ */
+#define RESULT_LIST_INIT (ResultList){ .results = (QueryResults*)0 }
+
 /**
  * Opens the database at the specified path. Returns `STARDUST_DB_OK` on success.
  * # Safety
@@ -156,7 +293,9 @@ void close_row_set(struct RowSet *row_set);
 
 /**
  * Executes the query in `query` and places the result in `row_set`.
- * Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+ * The buffers of `row_set` are reused, so executing repeatedly into the same `RowSet` avoids reallocating.
+ * Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`,
+ * and `row_set` is left empty.
  * # Safety
  * `db` must point to a Db initialised by `open_database` or `temp_db`.
  * `query` must be a null-terminated string.
@@ -277,6 +416,36 @@ int get_int_index_cast(const struct RowSet *row_set,
                        uintptr_t column,
                        IntegerStorage *int_buffer);
 
+/**
+ * If the value at the specified column is a string, set `string_ptr` to point to the string and `string_len` to its length in bytes, otherwise a type error is returned.
+ * The string is not null-terminated. It remains valid until the next call to `execute_query` or `close_row_set` with this `RowSet`.
+ * # Safety
+ * `row_set` must point to a RowSet initialised by `execute_query`.
+ * `string_ptr` and `string_len` must point to valid pieces of memory.
+ */
+int get_string_ref_index(const struct RowSet *row_set,
+                         uintptr_t column,
+                         const char **string_ptr,
+                         uintptr_t *string_len);
+
+/**
+ * If the value at the specified column is a string, set `string_len` to its length in bytes, not including a null terminator, otherwise a type error is returned.
+ * # Safety
+ * `row_set` must point to a RowSet initialised by `execute_query`.
+ * `string_len` must point to a valid piece of memory.
+ */
+int get_string_len_index(const struct RowSet *row_set, uintptr_t column, uintptr_t *string_len);
+
+/**
+ * Sets the value in `index` to the index of the first column with the specified name, for use with the `*_index` functions.
+ * The index remains valid for later executions of the same query.
+ * # Safety
+ * `row_set` must point to a RowSet initialised by `execute_query`.
+ * `column` must be a null-terminated string.
+ * `index` must point to a valid piece of memory.
+ */
+int resolve_column(const struct RowSet *row_set, const char *column, uintptr_t *index);
+
 /**
  * Sets the value in `is_null` to 1 if the value at the specified column is null, otherwise 0.
  * # Safety
@@ -352,4 +521,194 @@ int get_int_named_cast(const struct RowSet *row_set,
                        const char *column,
                        IntegerStorage *int_buffer);
 
+/**
+ * If the value at the specified column is a string, set `string_ptr` to point to the string and `string_len` to its length in bytes, otherwise a type error is returned.
+ * The string is not null-terminated. It remains valid until the next call to `execute_query` or `close_row_set` with this `RowSet`.
+ * # Safety
+ * `row_set` must point to a RowSet initialised by `execute_query`.
+ * `column` must be a null-terminated string.
+ * `string_ptr` and `string_len` must point to valid pieces of memory.
+ */
+int get_string_ref_named(const struct RowSet *row_set,
+                         const char *column,
+                         const char **string_ptr,
+                         uintptr_t *string_len);
+
+/**
+ * If the value at the specified column is a string, set `string_len` to its length in bytes, not including a null terminator, otherwise a type error is returned.
+ * # Safety
+ * `row_set` must point to a RowSet initialised by `execute_query`.
+ * `column` must be a null-terminated string.
+ * `string_len` must point to a valid piece of memory.
+ */
+int get_string_len_named(const struct RowSet *row_set, const char *column, uintptr_t *string_len);
+
+/**
+ * Copies up to `num_rows` integers from the specified column, starting at `start_row`, into `int_buffer`.
+ * The number of values copied is placed in `num_fetched`, which is less than `num_rows` at the end of the `RowSet`.
+ * For each value, `null_buffer` is set to 1 if the value is null, otherwise 0. If `null_buffer` is null, `STARDUST_DB_VALUE_NULL` is returned on the first null value.
+ * A type error is returned on the first value that isn't an integer, and `STARDUST_DB_END` if `start_row` is past the end of the `RowSet`.
+ * # Safety
+ * `row_set` must point to a RowSet initialised by `execute_query`.
+ * `int_buffer` must point to a valid piece of memory, no shorter than `num_rows` integers.
+ * `null_buffer` must be null, or point to a valid piece of memory no shorter than `num_rows`.
+ * `num_fetched` must point to a valid piece of memory.
+ */
+int get_int_column(const struct RowSet *row_set,
+                   uintptr_t column,
+                   uintptr_t start_row,
+                   uintptr_t num_rows,
+                   IntegerStorage *int_buffer,
+                   uint8_t *null_buffer,
+                   uintptr_t *num_fetched);
+
+/**
+ * Copies up to `num_rows` strings from the specified column, starting at `start_row`, into `data_buffer`.
+ * The strings are placed back to back without null terminators. The string for fetched row `i` occupies the bytes from `offsets[i]` to `offsets[i + 1]`, so `offsets` must have room for `num_rows + 1` values.
+ * The number of values copied is placed in `num_fetched`. Fewer than `num_rows` values are copied at the end of the `RowSet`, or if the next string does not fit in `data_buffer`.
+ * `STARDUST_DB_BUFFER_TOO_SMALL` is returned if the first string does not fit.
+ * For each value, `null_buffer` is set to 1 if the value is null, otherwise 0. If `null_buffer` is null, `STARDUST_DB_VALUE_NULL` is returned on the first null value.
+ * A type error is returned on the first value that isn't a string, and `STARDUST_DB_END` if `start_row` is past the end of the `RowSet`.
+ * # Safety
+ * `row_set` must point to a RowSet initialised by `execute_query`.
+ * `offsets` must point to a valid piece of memory, no shorter than `num_rows + 1` values.
+ * `data_buffer` must point to a valid piece of memory, no shorter than `data_len`.
+ * `null_buffer` must be null, or point to a valid piece of memory no shorter than `num_rows`.
+ * `num_fetched` must point to a valid piece of memory.
+ */
+int get_string_column(const struct RowSet *row_set,
+                      uintptr_t column,
+                      uintptr_t start_row,
+                      uintptr_t num_rows,
+                      uintptr_t *offsets,
+                      char *data_buffer,
+                      uintptr_t data_len,
+                      uint8_t *null_buffer,
+                      uintptr_t *num_fetched);
+
+/**
+ * Exports every row of the `RowSet` through the Arrow C data interface, as a struct array with one child per column.
+ * Integer columns are exported as int64, and columns containing strings as utf8.
+ * The `release` callbacks of `schema` and `array` must be called once the caller is finished with them.
+ * # Safety
+ * `row_set` must point to a RowSet initialised by `execute_query`.
+ * `schema` and `array` must point to valid pieces of memory.
+ */
+int export_arrow(const struct RowSet *row_set, struct ArrowSchema *schema, struct ArrowArray *array);
+
+/**
+ * Reports the buffer usage of the `RowSet`.
+ * `value_capacity` is set to the number of values the `RowSet` can hold without reallocating,
+ * and `peak_rows` to the largest number of rows it has held.
+ * # Safety
+ * `row_set` must point to a RowSet initialised by `execute_query`.
+ * `value_capacity` and `peak_rows` must point to valid memory.
+ */
+int get_row_set_stats(const struct RowSet *row_set, uintptr_t *value_capacity, uintptr_t *peak_rows);
+
+/**
+ * Inserts `num_rows` rows into `table`, taking the values from the column arrays in `columns` rather than parsing SQL.
+ * Table columns missing from `columns` are set to their default values. Constraints are checked as for `INSERT`, and no rows are inserted if any row fails.
+ * Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+ * # Safety
+ * `db` must point to a Db initialised by `open_database` or `temp_db`.
+ * `table` must be a null-terminated string.
+ * `columns` must point to `num_columns` columns, each with buffers no shorter than described by `StardustColumn`.
+ * `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+ */
+int bulk_insert(struct Db *db,
+                const char *table,
+                uintptr_t num_rows,
+                const struct StardustColumn *columns,
+                uintptr_t num_columns,
+                char *err_buff,
+                uintptr_t err_buff_len);
+
+/**
+ * Executes every query in `query` and places the results in `results`, to be retrieved in order with `next_result`.
+ * Changes are flushed to disk once, after the last query.
+ * Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`,
+ * and `results` is left empty.
+ * # Safety
+ * `db` must point to a Db initialised by `open_database` or `temp_db`.
+ * `query` must be a null-terminated string.
+ * `results` must point to a ResultList initialised by `RESULT_LIST_INIT`, or a previous invocation of `execute_batch`.
+ * `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+ */
+int execute_batch(struct Db *db,
+                  const char *query,
+                  struct ResultList *results,
+                  char *err_buff,
+                  uintptr_t err_buff_len);
+
+/**
+ * Moves the next result of the `ResultList` into `row_set`, positioned at its first row.
+ * Returns `STARDUST_DB_END` once every result has been retrieved.
+ * # Safety
+ * `results` must point to a ResultList initialised by `execute_batch`.
+ * `row_set` must point to a RowSet initialised by `ROW_SET_INIT`, or a previous invocation of `execute_query` or `next_result`.
+ */
+int next_result(struct ResultList *results, struct RowSet *row_set);
+
+/**
+ * Gets the number of results in the `ResultList`, including those already retrieved.
+ * # Safety
+ * `results` must point to a ResultList initialised by `execute_batch`.
+ * `num_results` must point to a valid piece of memory.
+ */
+int num_results(const struct ResultList *results, uintptr_t *num_results);
+
+/**
+ * Frees the memory from the `ResultList`.
+ * # Safety
+ * `results` must point to a ResultList initialised by `execute_batch` or `RESULT_LIST_INIT`.
+ */
+void close_result_list(struct ResultList *results);
+
+/**
+ * Writes a consistent backup of the whole database to the file at `path`, while the database stays online.
+ * Queries continue to run during the backup, but statements that modify the database wait for it to finish.
+ * If `stats` is not null, statistics about the backup are placed in it.
+ * Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+ * # Safety
+ * `db` must point to a Db initialised by `open_database` or `temp_db`.
+ * `path` must be a null-terminated string.
+ * `stats` must be null or point to a valid piece of memory.
+ * `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+ */
+int backup_database(struct Db *db,
+                    const char *path,
+                    struct BackupStats *stats,
+                    char *err_buff,
+                    uintptr_t err_buff_len);
+
+/**
+ * Restores the backup at `backup_path` into a new database at `path`, and opens it in `db`.
+ * `path` must not exist, or must be an empty directory.
+ * If `stats` is not null, statistics about the restore are placed in it.
+ * Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+ * # Safety
+ * `backup_path` and `path` must be null-terminated strings.
+ * `db` must point to a valid piece of memory.
+ * `stats` must be null or point to a valid piece of memory.
+ * `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+ */
+int restore_database(const char *backup_path,
+                     const char *path,
+                     struct Db *db,
+                     struct BackupStats *stats,
+                     char *err_buff,
+                     uintptr_t err_buff_len);
+
+/**
+ * Freezes `table` into an immutable, memory-mapped file, so that it is read without copying and doesn't slow down opening the database.
+ * Frozen tables cannot be modified, but can be dropped.
+ * Errors will be placed in the buffer at `err_buf`, which must be no smaller than `err_buff_len`.
+ * # Safety
+ * `db` must point to a Db initialised by `open_database` or `temp_db`.
+ * `table` must be a null-terminated string.
+ * `err_buff` must point to a valid piece of memory, no shorter than `err_buff_len`.
+ */
+int freeze_table(struct Db *db, const char *table, char *err_buff, uintptr_t err_buff_len);
+
 #endif /* STARDUST_DB_H */